@@ -0,0 +1,764 @@
+#include "hash.hpp"
+#include "merkle_tree.hpp"
+#include "merkle_forest.hpp"
+#include "memory_resource.hpp"
+#include "hash_messages.hpp"
+#include "proof_cache.hpp"
+#include "merkle_diff.hpp"
+#include "piece_hasher.hpp"
+#include "hybrid_hasher.hpp"
+#include "file_hasher.hpp"
+
+#include <algorithm>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+//////////////
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief elapsedNs Nanoseconds elapsed since a given time point.
+ * @param start Start time point.
+ * @return      Elapsed time in nanoseconds.
+ */
+double elapsedNs(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+/**
+ * @brief makeBlocks Build n data blocks of blockSize bytes with distinct contents.
+ * @param n         Number of blocks.
+ * @param blockSize Size of every block in bytes.
+ * @return          Vector of data blocks.
+ */
+std::vector<std::string> makeBlocks(size_t n, size_t blockSize)
+{
+    std::vector<std::string> blocks(n, std::string(blockSize, 'x'));
+    for (size_t i = 0; i < n; ++i)
+        std::memcpy(&blocks[i][0], &i, sizeof(i));
+
+    return blocks;
+}
+//////////////
+
+/**
+ * @brief benchArity Build time, verification latency and proof size of a
+ *                   MerkleTree<std::string, K>.
+ * @param blocks    Data blocks added to the tree.
+ */
+template<size_t K>
+void benchArity(const std::vector<std::string>& blocks)
+{
+    Clock::time_point start = Clock::now();
+    MerkleTree<std::string, K> tree(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        tree.addBlock(i, blocks[i]);
+    double buildNs = elapsedNs(start);
+
+    MerkleTree<std::string, K> client(blocks.size(), tree.getRootHash());
+    std::vector<Hash<std::string> > proof(tree.proofSize());
+    std::vector<Hash<std::string> > leaves;
+    for (size_t i = 0; i < blocks.size(); ++i)
+        leaves.push_back(Hash<std::string>(blocks[i]));
+
+    double verifyNs = 0;
+    size_t verified = 0;
+    for (size_t i = 0; i < blocks.size(); i += 7, ++verified)
+    {
+        tree.getProof(i, proof.data(), proof.size());
+
+        start = Clock::now();
+        client.verifyBlock(i, leaves[i], proof.data(), proof.size());
+        verifyNs += elapsedNs(start);
+    }
+
+    std::printf("arity %2zu: build %8.2f ms | verify %8.2f us | proof %3zu hashes (%5zu bytes)\n",
+                K, buildNs / 1e6, verifyNs / verified / 1e3, tree.proofSize(), 32 * tree.proofSize());
+}
+
+/**
+ * @brief benchForest Create and free many small per-file trees, one MerkleTree
+ *                    object per file versus one MerkleForest for all files.
+ *                    Block counts are powers of two so that no padding has to
+ *                    be hashed and only allocation is measured.
+ * @param numFiles  Number of files (trees).
+ * @param blocks    Number of blocks per file.
+ */
+void benchForest(size_t numFiles, size_t blocks)
+{
+    Clock::time_point start = Clock::now();
+    {
+        std::vector<MerkleTree<std::string> > trees;
+        trees.reserve(numFiles);
+        for (size_t f = 0; f < numFiles; ++f)
+            trees.push_back(MerkleTree<std::string>(blocks));
+    }
+    double treesNs = elapsedNs(start);
+
+    start = Clock::now();
+    {
+        MerkleForest<std::string> forest;
+        forest.reserve(numFiles, numFiles * blocks);
+        for (size_t f = 0; f < numFiles; ++f)
+            forest.addTree(blocks);
+    }
+    double forestNs = elapsedNs(start);
+
+    std::printf("%zu files x %zu blocks: MerkleTree objects %8.2f ms | MerkleForest %8.2f ms\n",
+                numFiles, blocks, treesNs / 1e6, forestNs / 1e6);
+}
+
+/**
+ * @brief benchRandomVerify Random (local) verification of the blocks of a
+ *                          large tree whose nodes come from allocator alloc.
+ * @param name      Name of the allocator in the report.
+ * @param numBlocks Number of blocks of the tree.
+ * @param alloc     Allocator of the tree nodes.
+ */
+template<typename Alloc>
+void benchRandomVerify(const char* name, size_t numBlocks, const Alloc& alloc)
+{
+    MerkleTree<std::string, 2, Alloc> tree(numBlocks, alloc);
+    std::vector<Hash<std::string> > leaves;
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        leaves.push_back(Hash<std::string>(std::to_string(i)));
+        tree.addBlock(i, std::to_string(i));
+    }
+
+    std::srand(1);
+    size_t verifications = 50000;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < verifications; ++i)
+    {
+        size_t id = std::rand() % numBlocks;
+        tree.verifyBlock(id, leaves[id]);
+    }
+
+    std::printf("%-12s %zu blocks: %8.2f us per random verification\n",
+                name, numBlocks, elapsedNs(start) / verifications / 1e3);
+}
+
+/**
+ * @brief benchHashMessages Throughput of the hash messages codec: a seeder
+ *                          answers hash requests of a large tree (requested
+ *                          hashes plus uncle hashes) and a peer decodes them.
+ * @param numBlocks Number of blocks of the tree.
+ * @param length    Number of hashes per request.
+ */
+void benchHashMessages(size_t numBlocks, uint32_t length)
+{
+    MerkleTree<std::string> tree(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i)
+        tree.addBlock(i, std::to_string(i));
+
+    HashRequest req;
+    std::memcpy(req.piecesRoot, tree.getRootHash().data(), 32);
+    req.baseLayer = 0;
+    req.length = length;
+    req.proofLayers = (uint32_t)tree.depth();
+
+    size_t messages = 20000;
+    std::vector<unsigned char> out;
+    size_t bytes = 0;
+    double encodeNs = 0;
+    double decodeNs = 0;
+    HashMessage<std::string> msg;
+
+    for (size_t i = 0; i < messages; ++i)
+    {
+        req.index = (uint32_t)((i * length) % numBlocks);
+        out.clear();
+
+        Clock::time_point start = Clock::now();
+        bytes += encodeHashes(tree, req, out);
+        encodeNs += elapsedNs(start);
+
+        size_t consumed;
+        start = Clock::now();
+        decodeHashMessage(out.data(), out.size(), msg, consumed);
+        decodeNs += elapsedNs(start);
+    }
+
+    std::printf("%zu blocks, %3u hashes per request: encode %10.0f msg/s | decode %10.0f msg/s | %zu bytes per message\n",
+                numBlocks, length, messages / encodeNs * 1e9, messages / decodeNs * 1e9, bytes / messages);
+}
+
+/**
+ * @brief benchProofCache Flash crowd: many peers request the same few hot
+ *                        pieces; answer with and without a proof cache.
+ * @param numBlocks Number of blocks of the tree.
+ * @param hot       Number of distinct (hot) requests.
+ */
+void benchProofCache(size_t numBlocks, size_t hot)
+{
+    MerkleTree<std::string> tree(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i)
+        tree.addBlock(i, std::to_string(i));
+
+    HashRequest req;
+    std::memcpy(req.piecesRoot, tree.getRootHash().data(), 32);
+    req.baseLayer = 0;
+    req.length = 16;
+    req.proofLayers = (uint32_t)tree.depth();
+
+    ProofCache cache(16 << 20);
+    size_t messages = 200000;
+    std::vector<unsigned char> out;
+    double plainNs = 0;
+    double cachedNs = 0;
+
+    for (size_t i = 0; i < messages; ++i)
+    {
+        req.index = (uint32_t)((i % hot) * 997 * req.length % numBlocks);
+
+        out.clear();
+        Clock::time_point start = Clock::now();
+        encodeHashes(tree, req, out);
+        plainNs += elapsedNs(start);
+
+        out.clear();
+        start = Clock::now();
+        cache.encodeHashes(tree, req, out);
+        cachedNs += elapsedNs(start);
+    }
+
+    std::printf("%zu blocks, %zu hot requests: tree walk %10.0f msg/s | proof cache %10.0f msg/s (%zu hits)\n",
+                numBlocks, hot, messages / plainNs * 1e9, messages / cachedNs * 1e9, cache.hits());
+}
+
+/**
+ * @brief benchDiff Find a few changed blocks between two large trees with diff
+ *                  and by comparing every leaf hash.
+ * @param numBlocks Number of blocks of the trees.
+ * @param changed   Number of changed blocks.
+ */
+void benchDiff(size_t numBlocks, size_t changed)
+{
+    MerkleTree<std::string> older(numBlocks);
+    MerkleTree<std::string> newer(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        older.addBlock(i, std::to_string(i));
+        newer.addBlock(i, (i % (numBlocks / changed) == 1) ? "changed" : std::to_string(i));
+    }
+
+    Clock::time_point start = Clock::now();
+    size_t found = 0;
+    for (size_t i = 0; i < numBlocks; ++i)
+        if (older.getNode(0, i) != newer.getNode(0, i))
+            ++found;
+    double scanNs = elapsedNs(start);
+
+    start = Clock::now();
+    std::vector<BlockRange> ranges = diff(older, newer);
+    double diffNs = elapsedNs(start);
+
+    std::printf("%zu blocks, %zu changed: leaf scan %8.2f us | diff %8.2f us (%zu ranges)\n",
+                numBlocks, found, scanNs / 1e3, diffNs / 1e3, ranges.size());
+}
+
+/**
+ * @brief benchStream Hash a piece in one call and streamed in chunks (with
+ *                    Sha256Stream and with picosha2::hash256_one_by_one).
+ * @param pieceSize Size of the piece in bytes.
+ * @param chunkSize Size of the chunks in bytes.
+ */
+void benchStream(size_t pieceSize, size_t chunkSize)
+{
+    std::vector<unsigned char> piece(pieceSize);
+    for (size_t i = 0; i < pieceSize; ++i)
+        piece[i] = (unsigned char)(i * 31);
+
+    Clock::time_point start = Clock::now();
+    Hash<std::string> whole(piece.data(), piece.size());
+    double wholeNs = elapsedNs(start);
+
+    start = Clock::now();
+    Sha256Stream stream;
+    for (size_t i = 0; i < pieceSize; i += chunkSize)
+        stream.update(&piece[i], chunkSize);
+    Hash<std::string> streamed(stream);
+    double streamNs = elapsedNs(start);
+
+    start = Clock::now();
+    picosha2::hash256_one_by_one hasher;
+    for (size_t i = 0; i < pieceSize; i += chunkSize)
+        hasher.process(piece.begin() + i, piece.begin() + i + chunkSize);
+    hasher.finish();
+    double pico = elapsedNs(start);
+
+    std::printf("%zu KiB piece, %zu KiB chunks: one call %8.2f MB/s | Sha256Stream %8.2f MB/s | "
+                "hash256_one_by_one %8.2f MB/s%s\n", pieceSize >> 10, chunkSize >> 10,
+                pieceSize * 1e3 / wholeNs, pieceSize * 1e3 / streamNs, pieceSize * 1e3 / pico,
+                (whole == streamed) ? "" : " (MISMATCH)");
+}
+
+/**
+ * @brief benchPieceHasher Time left to hash a piece once its last block arrives:
+ *                         buffering the whole piece versus a PieceHasher.
+ * @param pieceSize Size of the piece in bytes.
+ * @param blockSize Size of the blocks in bytes.
+ */
+void benchPieceHasher(size_t pieceSize, size_t blockSize)
+{
+    std::vector<unsigned char> piece(pieceSize);
+    for (size_t i = 0; i < pieceSize; ++i)
+        piece[i] = (unsigned char)(i * 31);
+
+    std::vector<unsigned char> buffer;
+    PieceHasher<std::string> hasher(pieceSize, blockSize);
+    for (size_t offset = 0; offset + blockSize < pieceSize; offset += blockSize)
+    {
+        buffer.insert(buffer.end(), &piece[offset], &piece[offset] + blockSize);
+        hasher.add(offset, &piece[offset], blockSize);
+    }
+
+    size_t last = pieceSize - blockSize;
+    Clock::time_point start = Clock::now();
+    buffer.insert(buffer.end(), &piece[last], &piece[last] + blockSize);
+    Hash<std::string> buffered(buffer.data(), buffer.size());
+    double bufferedNs = elapsedNs(start);
+
+    start = Clock::now();
+    hasher.add(last, &piece[last], blockSize);
+    Hash<std::string> incremental = hasher.hash();
+    double incrementalNs = elapsedNs(start);
+
+    std::printf("%zu KiB piece, %zu KiB blocks: completion buffered %10.2f us | incremental %8.2f us%s\n",
+                pieceSize >> 10, blockSize >> 10, bufferedNs / 1e3, incrementalNs / 1e3,
+                (buffered == incremental) ? "" : " (MISMATCH)");
+}
+
+/**
+ * @brief timeHash Average time to hash a value with the Hash<T> container constructor.
+ * @param data  Value to hash.
+ * @param runs  Number of runs.
+ * @return      Average time in nanoseconds.
+ */
+template<typename C>
+double timeHash(const C& data, size_t runs)
+{
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < runs; ++i)
+        Hash<C> hash(data);
+
+    return elapsedNs(start) / runs;
+}
+
+/**
+ * @brief benchContainers Hash a block held in different containers, compared with
+ *                        the raw pointer constructor and with picosha2::hash256.
+ * @param blockSize Size of the block in bytes.
+ * @param runs      Number of runs.
+ */
+void benchContainers(size_t blockSize, size_t runs)
+{
+    std::string block = makeBlocks(1, blockSize)[0];
+    std::vector<unsigned char> bytes(block.begin(), block.end());
+    std::deque<char> deque(block.begin(), block.end());
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < runs; ++i)
+        Hash<std::string> hash((const unsigned char*)block.data(), block.size());
+    double pointerNs = elapsedNs(start) / runs;
+
+    start = Clock::now();
+    unsigned char digest[32];
+    for (size_t i = 0; i < runs; ++i)
+        picosha2::hash256(block, digest, digest + 32);
+    double picoNs = elapsedNs(start) / runs;
+
+    std::printf("%zu byte blocks: pointer %8.2f us | std::string %8.2f us | std::vector %8.2f us | "
+                "std::deque %8.2f us | picosha2::hash256 %8.2f us\n", blockSize, pointerNs / 1e3,
+                timeHash(block, runs) / 1e3, timeHash(bytes, runs) / 1e3, timeHash(deque, runs) / 1e3,
+                picoNs / 1e3);
+}
+
+/**
+ * @brief benchSegments Hash blocks split in packets: joined in a temporary buffer
+ *                      first versus hashed as a segment list.
+ * @param blockSize     Size of the blocks in bytes.
+ * @param packetSize    Size of the packets in bytes.
+ * @param runs          Number of runs.
+ */
+void benchSegments(size_t blockSize, size_t packetSize, size_t runs)
+{
+    std::string block = makeBlocks(1, blockSize)[0];
+    std::vector<std::vector<unsigned char> > packets;
+    std::vector<HashSegment> segments;
+    for (size_t i = 0; i < blockSize; i += packetSize)
+        packets.push_back(std::vector<unsigned char>(block.begin() + i,
+                                                     block.begin() + std::min(i + packetSize, blockSize)));
+    for (size_t i = 0; i < packets.size(); ++i)
+    {
+        HashSegment segment = { packets[i].data(), packets[i].size() };
+        segments.push_back(segment);
+    }
+
+    Clock::time_point start = Clock::now();
+    for (size_t r = 0; r < runs; ++r)
+    {
+        std::vector<unsigned char> joined;
+        for (size_t i = 0; i < packets.size(); ++i)
+            joined.insert(joined.end(), packets[i].begin(), packets[i].end());
+        Hash<std::string> hash(joined.data(), joined.size());
+    }
+    double joinedNs = elapsedNs(start) / runs;
+
+    start = Clock::now();
+    for (size_t r = 0; r < runs; ++r)
+        Hash<std::string> hash(segments.data(), segments.size());
+    double segmentsNs = elapsedNs(start) / runs;
+
+    std::printf("%zu byte blocks in %zu byte packets: joined %8.2f us | segments %8.2f us\n",
+                blockSize, packetSize, joinedNs / 1e3, segmentsNs / 1e3);
+}
+
+/**
+ * @brief benchHybrid Hash a file for a hybrid torrent: one read per hash (v1
+ *                    pieces, then v2 leaves) versus a single read fed to a
+ *                    HybridHasher. Reads are simulated by copies into a buffer.
+ * @param fileSize  Size of the file in bytes.
+ * @param pieceSize Size of the v1 pieces in bytes.
+ */
+void benchHybrid(size_t fileSize, size_t pieceSize)
+{
+    const size_t readSize = 1 << 16;
+    std::vector<unsigned char> file(fileSize);
+    for (size_t i = 0; i < fileSize; ++i)
+        file[i] = (unsigned char)(i * 31);
+    std::vector<unsigned char> buffer(readSize);
+
+    Clock::time_point start = Clock::now();
+    size_t bytesRead = 0;
+    std::vector<unsigned char> v1;
+    Sha1Stream piece;
+    for (size_t i = 0; i < fileSize; i += readSize, bytesRead += readSize)
+    {
+        std::memcpy(buffer.data(), &file[i], readSize);
+        for (size_t j = 0; j < readSize; j += pieceSize)
+        {
+            piece.update(&buffer[j], std::min(pieceSize, readSize));
+            if (piece.length() == pieceSize)
+            {
+                v1.resize(v1.size() + SHA1_DIGEST_SIZE);
+                piece.digest(&v1[v1.size() - SHA1_DIGEST_SIZE]);
+                piece.reset();
+            }
+        }
+    }
+    std::vector<Hash<std::string> > v2;
+    for (size_t i = 0; i < fileSize; i += readSize, bytesRead += readSize)
+    {
+        std::memcpy(buffer.data(), &file[i], readSize);
+        for (size_t j = 0; j < readSize; j += 16 << 10)
+            v2.push_back(Hash<std::string>(&buffer[j], 16 << 10));
+    }
+    double twoPassNs = elapsedNs(start);
+
+    start = Clock::now();
+    size_t hybridRead = 0;
+    HybridHasher<std::string> hybrid(pieceSize);
+    for (size_t i = 0; i < fileSize; i += readSize, hybridRead += readSize)
+    {
+        std::memcpy(buffer.data(), &file[i], readSize);
+        hybrid.update(buffer.data(), readSize);
+    }
+    std::vector<Hash<std::string> > blocks;
+    hybrid.endFile(blocks, true);
+    double onePassNs = elapsedNs(start);
+
+    std::printf("%zu MiB file, %zu KiB pieces: two passes %8.2f ms (%zu MiB read) | one pass %8.2f ms "
+                "(%zu MiB read)%s\n", fileSize >> 20, pieceSize >> 10, twoPassNs / 1e6, bytesRead >> 20,
+                onePassNs / 1e6, hybridRead >> 20, (v1 == hybrid.pieces() && v2 == blocks) ? "" : " (MISMATCH)");
+}
+
+/**
+ * @brief cycles Current value of the CPU time stamp counter (0 where there is none).
+ * @return  Time stamp counter.
+ */
+unsigned long long cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief benchPolicy Cycles and nanoseconds per byte to hash blocks and to build a
+ *                    tree over them with a hash policy.
+ * @param name      Name of the policy.
+ * @param blocks    Data blocks.
+ */
+template<typename Policy>
+void benchPolicy(const char* name, const std::vector<std::string>& blocks)
+{
+    size_t bytes = blocks.size() * blocks[0].size();
+
+    unsigned long long startCycles = cycles();
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < blocks.size(); ++i)
+        Hash<std::string, Policy> hash(blocks[i]);
+    double blockNs = elapsedNs(start);
+    double blockCycles = (double)(cycles() - startCycles);
+
+    start = Clock::now();
+    MerkleTree<std::string, 2, std::allocator<Hash<std::string> >, Policy> tree(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        tree.addBlock(i, blocks[i]);
+    double treeNs = elapsedNs(start);
+
+    std::printf("%-8s blocks %6.2f cycles/byte (%5.2f ns/byte) | tree build %8.2f ms\n", name,
+                blockCycles / bytes, blockNs / bytes, treeNs / 1e6);
+}
+
+/**
+ * @brief benchHex Write a tree's node hashes in hex form and parse them back.
+ * @param numNodes  Number of hashes.
+ */
+void benchHex(size_t numNodes)
+{
+    std::vector<Hash<std::string> > hashes;
+    for (size_t i = 0; i < numNodes; ++i)
+        hashes.push_back(Hash<std::string>((const unsigned char*)&i, sizeof(i)));
+
+    Clock::time_point start = Clock::now();
+    size_t chars = 0;
+    for (size_t i = 0; i < numNodes; ++i)
+        chars += picosha2::bytes_to_hex_string(hashes[i].data(), hashes[i].data() + 32).size();
+    double picoNs = elapsedNs(start);
+
+    std::vector<char> dump(64 * numNodes);
+    start = Clock::now();
+    for (size_t i = 0; i < numNodes; ++i)
+        hashes[i].toHex(&dump[64 * i]);
+    double encodeNs = elapsedNs(start);
+
+    start = Clock::now();
+    size_t parsed = 0;
+    Hash<std::string> hash;
+    for (size_t i = 0; i < numNodes; ++i)
+        parsed += hash.fromHex(&dump[64 * i], 64);
+    double decodeNs = elapsedNs(start);
+
+    std::printf("%zu hashes: bytes_to_hex_string %8.2f ms | toHex %8.2f ms | fromHex %8.2f ms%s\n",
+                numNodes, picoNs / 1e6, encodeNs / 1e6, decodeNs / 1e6,
+                (chars == dump.size() && parsed == numNodes) ? "" : " (MISMATCH)");
+}
+
+/**
+ * @brief benchZeroBlocks Build the tree of a sparse image (mostly zero blocks):
+ *                        hashing every block through the stream versus the zero
+ *                        block fast path and a bulk setLayer.
+ * @param numBlocks Number of blocks of the image.
+ * @param blockSize Size of the blocks in bytes.
+ * @param dataEvery One block in dataEvery holds data, the others are zeros.
+ */
+void benchZeroBlocks(size_t numBlocks, size_t blockSize, size_t dataEvery)
+{
+    std::vector<unsigned char> image(numBlocks * blockSize, 0);
+    for (size_t i = 0; i < numBlocks; i += dataEvery)
+        std::memset(&image[i * blockSize], (int)(i % 255 + 1), blockSize);
+
+    Clock::time_point start = Clock::now();
+    MerkleTree<std::string> hashed(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        Sha256Stream stream;
+        stream.update(&image[i * blockSize], blockSize);
+        hashed.addBlock(i, Hash<std::string>(stream));
+    }
+    double hashedNs = elapsedNs(start);
+
+    start = Clock::now();
+    std::vector<Hash<std::string> > leaves(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i)
+        leaves[i] = Hash<std::string>(&image[i * blockSize], blockSize);
+    MerkleTree<std::string> bulk(numBlocks);
+    bulk.setLayer(0, leaves.data(), numBlocks);
+    double bulkNs = elapsedNs(start);
+
+    std::printf("%zu blocks of %zu KiB, 1 in %zu with data: hash every block %8.2f ms (%7.1f MB/s) | "
+                "zero fast path %8.2f ms (%7.1f MB/s)%s\n", numBlocks, blockSize >> 10, dataEvery,
+                hashedNs / 1e6, image.size() * 1e3 / hashedNs, bulkNs / 1e6, image.size() * 1e3 / bulkNs,
+                (hashed.getRootHash() == bulk.getRootHash()) ? "" : " (MISMATCH)");
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief benchSparseFile Hash a sparse file: reading every block versus skipping
+ *                        the holes reported by the file system.
+ * @param fileSize  Size of the file in bytes.
+ * @param blockSize Size of the blocks in bytes.
+ * @param dataEvery One block in dataEvery is allocated, the others are holes.
+ */
+void benchSparseFile(size_t fileSize, size_t blockSize, size_t dataEvery)
+{
+    char path[] = "/tmp/merkle_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || ftruncate(fd, fileSize) != 0)
+        return;
+    unlink(path);
+
+    std::vector<unsigned char> block(blockSize, 'd');
+    for (size_t offset = 0; offset < fileSize; offset += dataEvery * blockSize)
+        if (pwrite(fd, block.data(), blockSize, offset) != (ssize_t)blockSize)
+            return;
+
+    size_t numBlocks = fileSize / blockSize;
+    Clock::time_point start = Clock::now();
+    std::vector<Hash<std::string> > leaves(numBlocks);
+    for (size_t i = 0; i < numBlocks; ++i)
+    {
+        if (pread(fd, block.data(), blockSize, i * blockSize) != (ssize_t)blockSize)
+            return;
+        leaves[i] = Hash<std::string>(block.data(), blockSize);
+    }
+    MerkleTree<std::string> readAll(numBlocks);
+    readAll.setLayer(0, leaves.data(), numBlocks);
+    double readAllNs = elapsedNs(start);
+
+    start = Clock::now();
+    FileHashStats stats;
+    MerkleTree<std::string> sparse(numBlocks);
+    hashFile(fd, blockSize, sparse, &stats);
+    double sparseNs = elapsedNs(start);
+    close(fd);
+
+    std::printf("%zu MiB file, 1 block in %zu allocated: read all %8.2f ms (%zu MiB read) | skip holes %8.2f ms "
+                "(%llu MiB read)%s\n", fileSize >> 20, dataEvery, readAllNs / 1e6, fileSize >> 20, sparseNs / 1e6,
+                (unsigned long long)(stats.bytesRead >> 20),
+                (readAll.getRootHash() == sparse.getRootHash()) ? "" : " (MISMATCH)");
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+    std::string filter = (argc > 1) ? argv[1] : "";
+
+    if (filter.empty() || filter == "arity")
+    {
+        std::vector<std::string> blocks = makeBlocks(1 << 14, 64);
+
+        std::printf("== MerkleTree arity (%zu blocks) ==\n", blocks.size());
+        benchArity<2>(blocks);
+        benchArity<4>(blocks);
+        benchArity<8>(blocks);
+        benchArity<16>(blocks);
+    }
+
+    if (filter.empty() || filter == "forest")
+    {
+        std::printf("== MerkleForest ==\n");
+        benchForest(100000, 2);
+        benchForest(100000, 16);
+    }
+
+    if (filter.empty() || filter == "alloc")
+    {
+        HugePageResource huge;
+
+        std::printf("== MerkleTree node allocators ==\n");
+        benchRandomVerify("std", 1 << 18, std::allocator<Hash<std::string> >());
+        benchRandomVerify("huge pages", 1 << 18, ResourceAllocator<Hash<std::string> >(&huge));
+    }
+
+    if (filter.empty() || filter == "codec")
+    {
+        std::printf("== Hash messages codec ==\n");
+        benchHashMessages(1 << 16, 2);
+        benchHashMessages(1 << 16, 512);
+    }
+
+    if (filter.empty() || filter == "cache")
+    {
+        std::printf("== Proof cache ==\n");
+        benchProofCache(1 << 18, 64);
+    }
+
+    if (filter.empty() || filter == "diff")
+    {
+        std::printf("== Merkle tree diff ==\n");
+        benchDiff(1 << 18, 8);
+    }
+
+    if (filter.empty() || filter == "stream")
+    {
+        std::printf("== Streaming SHA-256 ==\n");
+        benchStream(4 << 20, 16 << 10);
+    }
+
+    if (filter.empty() || filter == "piece")
+    {
+        std::printf("== Incremental piece hashing ==\n");
+        benchPieceHasher(4 << 20, 16 << 10);
+    }
+
+    if (filter.empty() || filter == "container")
+    {
+        std::printf("== Hash from containers ==\n");
+        benchContainers(16 << 10, 200);
+    }
+
+    if (filter.empty() || filter == "segments")
+    {
+        std::printf("== Hash from segments ==\n");
+        benchSegments(16 << 10, 1400, 200);
+    }
+
+    if (filter.empty() || filter == "hybrid")
+    {
+        std::printf("== Hybrid torrent hashing ==\n");
+        benchHybrid(32 << 20, 256 << 10);
+    }
+
+    if (filter.empty() || filter == "policy")
+    {
+        std::vector<std::string> blocks = makeBlocks(1 << 10, 16 << 10);
+
+        std::printf("== Hash policies (%zu blocks of %zu bytes) ==\n", blocks.size(), blocks[0].size());
+        benchPolicy<Sha256Policy>("sha256", blocks);
+        benchPolicy<Sha1Policy>("sha1", blocks);
+#ifdef HASH_USE_OPENSSL
+        benchPolicy<OpenSslSha256Policy>("openssl", blocks);
+#endif
+    }
+
+    if (filter.empty() || filter == "hex")
+    {
+        std::printf("== Hex codec ==\n");
+        benchHex(1 << 20);
+    }
+
+    if (filter.empty() || filter == "zero")
+    {
+        std::printf("== Zero blocks ==\n");
+        benchZeroBlocks(1 << 12, 16 << 10, 20);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    if (filter.empty() || filter == "sparse")
+    {
+        std::printf("== Sparse files ==\n");
+        benchSparseFile(256 << 20, 1 << 20, 20);
+    }
+#endif
+
+    return 0;
+}
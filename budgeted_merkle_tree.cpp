@@ -0,0 +1,493 @@
+#include "budgeted_merkle_tree.hpp"
+#include <stdexcept>
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::BudgetedMerkleTree Class constructor. Builds an
+ *                                                          empty tree without root hash
+ *                                                          large enough to accomodate n blocks.
+ * @param n             Number of data blocks in the build tree.
+ * @param byteBudget    Maximum bytes of node storage (the leaf layer and the top
+ *                      levels are always kept, even if they do not fit).
+ * @param topLevels     Number of levels from the root down always kept (at least 1).
+ * @param cacheSize     Number of recomputed hashes kept in the LRU cache.
+ */
+template<typename T, typename Policy>
+BudgetedMerkleTree<T, Policy>::BudgetedMerkleTree(size_t n, size_t byteBudget, size_t topLevels, size_t cacheSize)
+    : cacheSize(cacheSize)
+{
+    init(n, byteBudget, topLevels);
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::BudgetedMerkleTree Class constructor. Builds an
+ *                                                          empty tree with root hash large
+ *                                                          enough to accomodate n blocks.
+ * @param n             Number of data blocks in the build tree.
+ * @param rootHash      Hash of the root node.
+ * @param byteBudget    Maximum bytes of node storage (the leaf layer and the top
+ *                      levels are always kept, even if they do not fit).
+ * @param topLevels     Number of levels from the root down always kept (at least 1).
+ * @param cacheSize     Number of recomputed hashes kept in the LRU cache.
+ */
+template<typename T, typename Policy>
+BudgetedMerkleTree<T, Policy>::BudgetedMerkleTree(size_t n, const Hash<T, Policy>& rootHash, size_t byteBudget,
+                                          size_t topLevels, size_t cacheSize)
+    : cacheSize(cacheSize)
+{
+    init(n, byteBudget, topLevels);
+    levels[0][0] = rootHash;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::init Choose the resident levels and set the hash
+ *                                            of padding blocks. Middle levels are kept
+ *                                            every s levels up from the leaves, with the
+ *                                            smallest stride s that fits in the budget.
+ * @param n             Number of data blocks.
+ * @param byteBudget    Maximum bytes of node storage.
+ * @param topLevels     Number of levels from the root down always kept.
+ */
+template<typename T, typename Policy>
+void BudgetedMerkleTree<T, Policy>::init(size_t n, size_t byteBudget, size_t topLevels)
+{
+    numBlocks = n;
+    depth = 1;
+    while ((1UL << depth) < n)
+        ++depth;
+
+    if (topLevels < 1)
+        topLevels = 1;
+    if (topLevels > depth)
+        topLevels = depth;
+
+    //the leaves and the top levels are always resident
+    size_t base = (1UL << depth) + (1UL << topLevels) - 1;
+
+    size_t stride = 0;
+    for (size_t s = 1; s < depth && stride == 0; ++s)
+    {
+        size_t nodes = base;
+        for (size_t d = topLevels; d < depth; ++d)
+            if ((depth - d) % s == 0)
+                nodes += (1UL << d);
+
+        if (nodes * sizeof(Hash<T, Policy>) <= byteBudget)
+            stride = s;
+    }
+
+    levels.resize(depth + 1);
+    for (size_t d = 0; d <= depth; ++d)
+        if (d < topLevels || d == depth || (stride && (depth - d) % stride == 0))
+            levels[d].resize(1UL << d);
+
+    //set hash of padding blocks
+    static const unsigned char padHash[Policy::digestSize] = {0};
+    Hash<T, Policy> pad;
+    pad.setHash(padHash, sizeof(padHash));
+
+    for (size_t id = n; id < (1UL << depth); ++id)
+        setLeaf(id, pad);
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::setRootHash Assign root hash of tree.
+ * @param rootHash Hash set for the root node.
+ */
+template<typename T, typename Policy>
+void BudgetedMerkleTree<T, Policy>::setRootHash(const Hash<T, Policy>& rootHash)
+{
+    levels[0][0] = rootHash;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::getRootHash Return the root hash of Merkle tree.
+ * @return  Hash in the root node of Merkle tree. Throws a std::runtime_error
+ *          if the root hash is empty.
+ */
+template<typename T, typename Policy>
+Hash<T, Policy> BudgetedMerkleTree<T, Policy>::getRootHash() const
+{
+    if ((numBlocks == 0) || levels[0][0].isEmpty())
+        throw std::runtime_error("Runtime Error: Null Merkle Tree or Invalid/Empty Root Hash!");
+
+    return levels[0][0];
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::addBlock Add data block number blockID to the tree
+ *                                                and calculate descendent hashes if possible.
+ * @param blockID   ID for the added data block.
+ * @param block     STL sequential container representing the data block.
+ * @return          True if the data block is added successfully. Throws
+ *                  a std::runtime_error exception if no block-id in the tree.
+ */
+template<typename T, typename Policy>
+bool BudgetedMerkleTree<T, Policy>::addBlock(size_t blockID, const T& block)
+{
+    if (blockID >= numBlocks)
+        throw std::runtime_error("Range Error: Invalid Block ID!");
+
+    setLeaf(blockID, Hash<T, Policy>(block));
+
+    return true;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::addBlock Add data block number blockID to the tree
+ *                                                and calculate descendent hashes if possible.
+ * @param blockID   ID for the added data block.
+ * @param block     Unsigned char array representing the data block.
+ * @param size      Number of bytes in the block.
+ * @return          True if the data block is added successfully. Throws
+ *                  a std::runtime_error exception if no block-id in the tree.
+ */
+template<typename T, typename Policy>
+bool BudgetedMerkleTree<T, Policy>::addBlock(size_t blockID, const unsigned char* block, size_t size)
+{
+    if (blockID >= numBlocks)
+        throw std::runtime_error("Range Error: Invalid Block ID!");
+
+    setLeaf(blockID, Hash<T, Policy>(block, size));
+
+    return true;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::verifyBlock Verify integrity of block against the
+ *                                                   first known resident or pinned ancestor
+ *                                                   (siblings of evicted levels are pinned or
+ *                                                   recomputed). If block is verified add hash
+ *                                                   to tree.
+ * @param blockID   ID of the block.
+ * @param blockHash Hash of the block.
+ * @return          True if block is verified. False otherwise.
+ */
+template<typename T, typename Policy>
+bool BudgetedMerkleTree<T, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash)
+{
+    if (blockID >= numBlocks)
+        return false;
+
+    size_t node = (1UL << depth) - 1 + blockID;
+    Hash<T, Policy> unverHash = blockHash;
+    bool verified = false;
+
+    while (!verified && node > 0)
+    {
+        size_t sibl = (node % 2) ? node + 1 : node - 1;
+        Hash<T, Policy> siblHash = nodeHash(sibl);
+        if (siblHash.isEmpty())
+            return false;
+
+        unverHash = (node % 2) ? unverHash + siblHash : siblHash + unverHash;
+        node = (node - 1) / 2;
+
+        const Hash<T, Policy>* ancestor = known(node);
+        if (ancestor && !ancestor->isEmpty())
+        {
+            if (*ancestor != unverHash)
+                return false;
+
+            verified = true;
+        }
+    }
+
+    if (verified)
+        setLeaf(blockID, blockHash, true);
+
+    return verified;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::verifyBlock Verify integrity of block using attached
+ *                                                   list of sibling and descendent hashes. If
+ *                                                   block is verified add hash to tree and
+ *                                                   keep the sibling hashes (those of evicted
+ *                                                   levels are pinned, out of the LRU cache).
+ * @param blockID   ID of the block to verify.
+ * @param blockHash Hash of the block to verify.
+ * @param hashList  Contains (in order) hashes for block's sibling and all
+ *                  descendents' siblings up until root node.
+ * @param size      Number of hashes in in hashList
+ * @return          True if block is verified. False otherwise.
+ */
+template<typename T, typename Policy>
+bool BudgetedMerkleTree<T, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Hash<T, Policy> hashList[], size_t size)
+{
+    if (blockID >= numBlocks || size != depth || levels[0][0].isEmpty())
+        return false;
+
+    size_t node = (1UL << depth) - 1 + blockID;
+    Hash<T, Policy> unverHash = blockHash;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (hashList[i].isEmpty())
+            return false;
+
+        unverHash = (node % 2) ? unverHash + hashList[i] : hashList[i] + unverHash;
+        node = (node - 1) / 2;
+    }
+
+    if (unverHash != levels[0][0])
+        return false;
+
+    //keep sibling hashes (pinned for evicted levels: they can not be recomputed)
+    node = (1UL << depth) - 1 + blockID;
+    for (size_t i = 0; i < size; ++i)
+    {
+        size_t sibl = (node % 2) ? node + 1 : node - 1;
+        Hash<T, Policy>* known = stored(sibl);
+        if (known)
+            *known = hashList[i];
+        else
+        {
+            pinned[sibl] = hashList[i];
+
+            typename std::unordered_map<size_t, typename CacheList::iterator>::iterator it = cacheIndex.find(sibl);
+            if (it != cacheIndex.end())
+            {
+                cache.erase(it->second);
+                cacheIndex.erase(it);
+            }
+        }
+
+        node = (node - 1) / 2;
+    }
+
+    setLeaf(blockID, blockHash, true);
+
+    return true;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::proofSize Return the number of hashes in a
+ *                                                 verification proof.
+ * @return  One sibling hash for each level below the root.
+ */
+template<typename T, typename Policy>
+size_t BudgetedMerkleTree<T, Policy>::proofSize() const
+{
+    return depth;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::getProof Fill hashList with the sibling hashes of
+ *                                                every node in the path from block blockID
+ *                                                up to the root (evicted siblings are
+ *                                                recomputed).
+ * @param blockID   ID of the block.
+ * @param hashList  Output array for the proof hashes.
+ * @param size      Number of hashes that fit in hashList. Must be proofSize().
+ * @return          True if the proof is complete. False otherwise.
+ */
+template<typename T, typename Policy>
+bool BudgetedMerkleTree<T, Policy>::getProof(size_t blockID, Hash<T, Policy> hashList[], size_t size)
+{
+    if (blockID >= numBlocks || size != depth)
+        return false;
+
+    size_t node = (1UL << depth) - 1 + blockID;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hashList[i] = nodeHash((node % 2) ? node + 1 : node - 1);
+        if (hashList[i].isEmpty())
+            return false;
+
+        node = (node - 1) / 2;
+    }
+
+    return true;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::isResident Tell whether a level is kept in memory.
+ * @param depth Depth of the level (0 is the root level).
+ * @return      True if the level is resident. False if it is evicted.
+ */
+template<typename T, typename Policy>
+bool BudgetedMerkleTree<T, Policy>::isResident(size_t depth) const
+{
+    return (depth < levels.size()) && !levels[depth].empty();
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::memoryUsage Return the actual memory footprint of
+ *                                                   the tree: the object, its resident levels,
+ *                                                   the pinned hashes and the cache of
+ *                                                   recomputed hashes.
+ * @return  Number of bytes.
+ */
+template<typename T, typename Policy>
+size_t BudgetedMerkleTree<T, Policy>::memoryUsage() const
+{
+    size_t bytes = sizeof(*this) + levels.capacity() * sizeof(levels[0]);
+
+    for (size_t d = 0; d < levels.size(); ++d)
+        bytes += levels[d].capacity() * sizeof(Hash<T, Policy>);
+
+    //list nodes (value and two links) and hash map nodes (value and one link) plus buckets
+    bytes += cache.size() * (sizeof(typename CacheList::value_type) + 2 * sizeof(void*));
+    bytes += cacheIndex.size() * (sizeof(typename CacheList::iterator) + sizeof(size_t) + sizeof(void*));
+    bytes += cacheIndex.bucket_count() * sizeof(void*);
+    bytes += pinned.size() * (sizeof(typename std::unordered_map<size_t, Hash<T, Policy> >::value_type) + sizeof(void*));
+    bytes += pinned.bucket_count() * sizeof(void*);
+
+    return bytes;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::levelOf Return the depth of a node.
+ * @param node  Node index (root node at index zero, level by level).
+ * @return      Depth of the node (0 for the root).
+ */
+template<typename T, typename Policy>
+size_t BudgetedMerkleTree<T, Policy>::levelOf(size_t node)
+{
+    size_t d = 0;
+    while ((node + 1) >> (d + 1))
+        ++d;
+
+    return d;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::stored Return the stored hash of a node.
+ * @param node  Node index.
+ * @return      Pointer to the hash, or null if the node's level is evicted.
+ */
+template<typename T, typename Policy>
+Hash<T, Policy>* BudgetedMerkleTree<T, Policy>::stored(size_t node)
+{
+    size_t d = levelOf(node);
+    if (levels[d].empty())
+        return 0;
+
+    return &levels[d][node - ((1UL << d) - 1)];
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::known Return the stored or pinned hash of a node.
+ * @param node  Node index.
+ * @return      Pointer to the hash, or null if the node's level is evicted and
+ *              its hash is not pinned.
+ */
+template<typename T, typename Policy>
+const Hash<T, Policy>* BudgetedMerkleTree<T, Policy>::known(size_t node)
+{
+    Hash<T, Policy>* hash = stored(node);
+    if (hash)
+        return hash;
+
+    typename std::unordered_map<size_t, Hash<T, Policy> >::const_iterator pin = pinned.find(node);
+
+    return (pin != pinned.end()) ? &pin->second : 0;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::nodeHash Return the hash of a node. Hashes of
+ *                                                evicted nodes are pinned, taken from the
+ *                                                cache or recomputed from the levels below.
+ * @param node  Node index.
+ * @return      Hash of the node (empty if it is not known and can not be computed).
+ */
+template<typename T, typename Policy>
+Hash<T, Policy> BudgetedMerkleTree<T, Policy>::nodeHash(size_t node)
+{
+    const Hash<T, Policy>* hash = known(node);
+    if (hash)
+        return *hash;
+
+    typename std::unordered_map<size_t, typename CacheList::iterator>::iterator it = cacheIndex.find(node);
+    if (it != cacheIndex.end())
+    {
+        cache.splice(cache.begin(), cache, it->second);
+        return it->second->second;
+    }
+
+    Hash<T, Policy> lft = nodeHash(2 * node + 1);
+    if (lft.isEmpty())
+        return Hash<T, Policy>();
+
+    Hash<T, Policy> rgt = nodeHash(2 * node + 2);
+    if (rgt.isEmpty())
+        return Hash<T, Policy>();
+
+    Hash<T, Policy> sum = lft + rgt;
+    cachePut(node, sum);
+
+    return sum;
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::cachePut Keep the hash of an evicted node in the
+ *                                                LRU cache (dropping the least recently
+ *                                                used hash if the cache is full).
+ * @param node  Node index.
+ * @param hash  Hash of the node.
+ */
+template<typename T, typename Policy>
+void BudgetedMerkleTree<T, Policy>::cachePut(size_t node, const Hash<T, Policy>& hash)
+{
+    if (cacheSize == 0)
+        return;
+
+    typename std::unordered_map<size_t, typename CacheList::iterator>::iterator it = cacheIndex.find(node);
+    if (it != cacheIndex.end())
+    {
+        it->second->second = hash;
+        cache.splice(cache.begin(), cache, it->second);
+        return;
+    }
+
+    cache.push_front(std::make_pair(node, hash));
+    cacheIndex[node] = cache.begin();
+
+    if (cache.size() > cacheSize)
+    {
+        cacheIndex.erase(cache.back().first);
+        cache.pop_back();
+    }
+}
+
+/**
+ * @brief BudgetedMerkleTree<T, Policy>::setLeaf Set the hash of a leaf, drop the cached
+ *                                               hashes of its ancestors and recompute the
+ *                                               resident ancestors, if possible. Pinned
+ *                                               ancestors are kept only if the leaf is
+ *                                               verified (it matches them).
+ * @param blockID   ID of the block (or padding block).
+ * @param blockHash Hash of the block.
+ * @param verified  Whether the hash was verified against the tree.
+ */
+template<typename T, typename Policy>
+void BudgetedMerkleTree<T, Policy>::setLeaf(size_t blockID, const Hash<T, Policy>& blockHash, bool verified)
+{
+    size_t node = (1UL << depth) - 1 + blockID;
+    levels[depth][blockID] = blockHash;
+
+    while (node > 0)
+    {
+        node = (node - 1) / 2;
+
+        typename std::unordered_map<size_t, typename CacheList::iterator>::iterator it = cacheIndex.find(node);
+        if (it != cacheIndex.end())
+        {
+            cache.erase(it->second);
+            cacheIndex.erase(it);
+        }
+
+        if (!verified)
+            pinned.erase(node);
+
+        Hash<T, Policy>* known = stored(node);
+        if (known)
+        {
+            Hash<T, Policy> lft = nodeHash(2 * node + 1);
+            Hash<T, Policy> rgt = nodeHash(2 * node + 2);
+
+            if (!lft.isEmpty() && !rgt.isEmpty())
+                *known = lft + rgt;
+        }
+    }
+}
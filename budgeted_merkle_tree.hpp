@@ -0,0 +1,93 @@
+#ifndef _BUDGETED_MERKLE_TREE_H_
+#define _BUDGETED_MERKLE_TREE_H_
+
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "hash.hpp"
+
+// Binary Merkle tree for very large torrents that keeps only part of its
+// interior nodes in memory: the top levels and the leaf layer are always
+// resident, middle levels are kept (evenly spaced) only while they fit in a
+// byte budget, and hashes of evicted nodes are recomputed on demand from the
+// levels below (recent results are kept in an LRU cache); sibling hashes of
+// evicted levels received with verified proofs can not be recomputed, so they
+// are pinned outside the cache (and counted in memoryUsage)
+template <typename T, typename Policy = Sha256Policy>
+class BudgetedMerkleTree
+{
+public:
+  // Constructor: empty tree without root hash large enough to accomodate n blocks
+  // the topLevels levels from the root down are always resident; byteBudget bounds the node storage
+  // (exceeded only by the leaves and top levels); cacheSize is the number of recomputed hashes kept
+  BudgetedMerkleTree(size_t n, size_t byteBudget, size_t topLevels = 8, size_t cacheSize = 4096);
+
+  // Constructor: same as above, with root hash
+  BudgetedMerkleTree(size_t n, const Hash<T, Policy>& rootHash, size_t byteBudget, size_t topLevels = 8,
+                     size_t cacheSize = 4096);
+
+  // assign root hash of Merkle Tree
+  void setRootHash(const Hash<T, Policy>& rootHash);
+
+  // return root hash to user
+  Hash<T, Policy> getRootHash() const;
+
+  // add data block number blockID to the tree (calculate descendent hashes if possible)
+  // return range_error if not block-id not in tree
+  bool addBlock(size_t blockID, const T& block);
+
+  // same as above but block data is in array form (size is the number of bytes in block)
+  bool addBlock(size_t blockID, const unsigned char* block, size_t size);
+
+  // verify integrity of block (use sibling and descendents if hash of block isn't in the tree)
+  // if block is verified add hash to tree and calculate descendent hashes, if necessary
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash);
+
+  // verify integrity of block using attached list of sibling and descendent hashes (if hash of block isn't in the tree)
+  // if block is verified add hash to tree and keep the sibling hashes (those of evicted levels pinned)
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Hash<T, Policy> hashList[], size_t size);
+
+  // number of hashes in a verification proof (hashList) for any block of the tree
+  size_t proofSize() const;
+
+  // fill hashList with the proof of block blockID (recomputing evicted siblings)
+  // return false if some sibling can not be known
+  bool getProof(size_t blockID, Hash<T, Policy> hashList[], size_t size);
+
+  // whether the level at the given depth (0 is the root level) is kept in memory
+  bool isResident(size_t depth) const;
+
+  // actual memory footprint of the tree in bytes (resident levels, pinned hashes and cache)
+  size_t memoryUsage() const;
+
+private:
+  // resident levels (indexed by depth, empty if the level is evicted)
+  std::vector<std::vector<Hash<T, Policy> > > levels;
+  // number of levels under the root
+  size_t depth;
+  // number of non-padding blocks in the tree
+  size_t numBlocks;
+
+  // LRU cache of recomputed hashes of evicted nodes (most recent first)
+  typedef std::list<std::pair<size_t, Hash<T, Policy> > > CacheList;
+  CacheList cache;
+  std::unordered_map<size_t, typename CacheList::iterator> cacheIndex;
+  size_t cacheSize;
+  // verified hashes of evicted nodes (proof siblings), never dropped by the cache
+  std::unordered_map<size_t, Hash<T, Policy> > pinned;
+
+  void init(size_t n, size_t byteBudget, size_t topLevels); //choose resident levels and pad the tree
+  static size_t levelOf(size_t node); //depth of a node
+  Hash<T, Policy>* stored(size_t node); //stored hash of node (null if its level is evicted)
+  const Hash<T, Policy>* known(size_t node); //stored or pinned hash of node (null if neither)
+  Hash<T, Policy> nodeHash(size_t node); //hash of node, recomputed (and cached) if evicted
+  void cachePut(size_t node, const Hash<T, Policy>& hash); //keep hash of evicted node in the cache
+  void setLeaf(size_t blockID, const Hash<T, Policy>& blockHash, bool verified = false); //set leaf hash and update its ancestors (unverified: unpin them)
+};
+
+#include "budgeted_merkle_tree.cpp"
+#endif  //_BUDGETED_MERKLE_TREE_H_
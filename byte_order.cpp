@@ -0,0 +1,24 @@
+#include "byte_order.hpp"
+
+/**
+ * @brief putUint32 Write a 32-bit integer in big endian byte order.
+ * @param p Output buffer (at least 4 bytes).
+ * @param x Integer.
+ */
+inline void putUint32(unsigned char* p, uint32_t x)
+{
+    p[0] = (unsigned char)(x >> 24);
+    p[1] = (unsigned char)(x >> 16);
+    p[2] = (unsigned char)(x >> 8);
+    p[3] = (unsigned char)x;
+}
+
+/**
+ * @brief getUint32 Read a 32-bit integer in big endian byte order.
+ * @param p Input buffer (at least 4 bytes).
+ * @return  Integer.
+ */
+inline uint32_t getUint32(const unsigned char* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
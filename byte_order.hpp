@@ -0,0 +1,15 @@
+#ifndef _BYTE_ORDER_H_
+#define _BYTE_ORDER_H_
+
+#include <cstdint>
+
+// big endian (network byte order) integers of the wire formats (hash messages, shard results)
+
+// write x as 4 bytes big endian at p
+void putUint32(unsigned char* p, uint32_t x);
+
+// read 4 bytes big endian at p
+uint32_t getUint32(const unsigned char* p);
+
+#include "byte_order.cpp"
+#endif  //_BYTE_ORDER_H_
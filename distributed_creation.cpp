@@ -0,0 +1,376 @@
+#include "distributed_creation.hpp"
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+//////////////
+// size of a serialized result without pieces, for digests of digestSize bytes
+inline size_t shardResultHeader(size_t digestSize)
+{
+    return 4 + 4 + 4 + digestSize + 4 + 4;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief writeAll Write a whole buffer to a file descriptor (retrying partial and
+ *                 interrupted writes).
+ * @param fd    File descriptor.
+ * @param buf   Buffer.
+ * @param size  Number of bytes to write.
+ * @return      True if every byte is written. False on error.
+ */
+inline bool writeAll(int fd, const unsigned char* buf, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t done = ::write(fd, buf, size);
+        if (done < 0 && errno == EINTR)
+            continue;
+
+        if (done <= 0)
+            return false;
+
+        buf += done;
+        size -= done;
+    }
+
+    return true;
+}
+
+/**
+ * @brief readAll Read exactly size bytes from a file descriptor (retrying partial
+ *                and interrupted reads).
+ * @param fd    File descriptor.
+ * @param buf   Buffer.
+ * @param size  Number of bytes to read.
+ * @return      True if every byte is read. False on error or end of file.
+ */
+inline bool readAll(int fd, unsigned char* buf, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t done = ::read(fd, buf, size);
+        if (done < 0 && errno == EINTR)
+            continue;
+
+        if (done <= 0)
+            return false;
+
+        buf += done;
+        size -= done;
+    }
+
+    return true;
+}
+#endif
+//////////////
+
+/**
+ * @brief shardHeight Height of the subtrees that split a tree of n blocks into at
+ *                    least numShards subtrees with data blocks (as few as
+ *                    possible, i.e. the largest such height).
+ * @param n         Number of data blocks of the tree.
+ * @param numShards Wanted number of subtrees.
+ * @return          Height of the subtrees (at least 1, the smallest subtree
+ *                  holding K leaves, even if that makes fewer subtrees).
+ */
+template<size_t K>
+size_t shardHeight(size_t n, size_t numShards)
+{
+    size_t height = 1;
+    size_t width = K;
+
+    //go up while the next height still makes enough subtrees
+    while (width * K < n && (n + width * K - 1) / (width * K) >= numShards)
+    {
+        width *= K;
+        ++height;
+    }
+
+    return height;
+}
+
+/**
+ * @brief makeShardResult Build the result of a worker from its (complete) subtree.
+ * @param shard         Subtree of the worker.
+ * @param pieceHeight   Height of the piece layer to ship (none if greater than
+ *                      the subtree height).
+ * @return              Subtree root and pieces. Throws a std::runtime_error if
+ *                      the subtree root is not known.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+ShardResult<T, Policy> makeShardResult(const MerkleSubtree<T, K, Alloc, Policy>& shard, size_t pieceHeight)
+{
+    ShardResult<T, Policy> result;
+    result.height = (uint32_t)shard.height;
+    result.index = (uint32_t)shard.index;
+    result.root = shard.tree.getNode(shard.height, 0);
+    result.pieceHeight = 0;
+
+    if (result.root.isEmpty())
+        throw std::runtime_error("Runtime Error: Incomplete Subtree!");
+
+    if (pieceHeight <= shard.height)
+    {
+        result.pieceHeight = (uint32_t)pieceHeight;
+        result.pieces.resize(shard.tree.layerSize(pieceHeight));
+        shard.tree.getLayer(pieceHeight, result.pieces.data());
+    }
+
+    return result;
+}
+
+/**
+ * @brief encodeShardResult Append a serialized worker result to a buffer: length,
+ *                          height, index, root, piece height, number of pieces and
+ *                          pieces (integers are 32 bits big endian, hashes
+ *                          Policy::digestSize bytes).
+ * @param result    Worker result.
+ * @param out       Output buffer.
+ * @return          Number of bytes appended.
+ */
+template<typename T, typename Policy>
+size_t encodeShardResult(const ShardResult<T, Policy>& result, std::vector<unsigned char>& out)
+{
+    const size_t digest = Policy::digestSize;
+    size_t start = out.size();
+    size_t bytes = shardResultHeader(digest) + digest * result.pieces.size();
+    out.resize(start + bytes);
+
+    unsigned char* p = &out[start];
+    putUint32(p, (uint32_t)bytes);
+    putUint32(p + 4, result.height);
+    putUint32(p + 8, result.index);
+    std::memcpy(p + 12, result.root.data(), digest);
+    putUint32(p + 12 + digest, result.pieceHeight);
+    putUint32(p + 16 + digest, (uint32_t)result.pieces.size());
+
+    p += shardResultHeader(digest);
+    for (size_t i = 0; i < result.pieces.size(); ++i, p += digest)
+        std::memcpy(p, result.pieces[i].data(), digest);
+
+    return bytes;
+}
+
+/**
+ * @brief decodeShardResult Parse the serialized worker result at the beginning of
+ *                          a buffer.
+ * @param buf       Input buffer.
+ * @param size      Number of bytes in buf.
+ * @param result    Parsed result.
+ * @param consumed  Number of bytes of the serialized result.
+ * @return          True if buf starts with a complete and well formed result.
+ *                  False otherwise.
+ */
+template<typename T, typename Policy>
+bool decodeShardResult(const unsigned char* buf, size_t size, ShardResult<T, Policy>& result, size_t& consumed)
+{
+    const size_t digest = Policy::digestSize;
+    const size_t header = shardResultHeader(digest);
+    if (size < header)
+        return false;
+
+    size_t bytes = getUint32(buf);
+    size_t numPieces = getUint32(buf + 16 + digest);
+    if (bytes > size || bytes != header + digest * numPieces)
+        return false;
+
+    result.height = getUint32(buf + 4);
+    result.index = getUint32(buf + 8);
+    result.root.setHash(buf + 12, digest);
+    result.pieceHeight = getUint32(buf + 12 + digest);
+
+    result.pieces.resize(numPieces);
+    for (size_t i = 0; i < numPieces; ++i)
+        result.pieces[i].setHash(buf + header + digest * i, digest);
+
+    consumed = bytes;
+
+    return true;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+/**
+ * @brief writeShardResult Write a serialized worker result to a file descriptor.
+ * @param fd        File descriptor (e.g. a pipe or socket).
+ * @param result    Worker result.
+ * @return          True if written. False on error.
+ */
+template<typename T, typename Policy>
+bool writeShardResult(int fd, const ShardResult<T, Policy>& result)
+{
+    std::vector<unsigned char> buf;
+    encodeShardResult(result, buf);
+
+    return writeAll(fd, buf.data(), buf.size());
+}
+
+/**
+ * @brief readShardResult Read a serialized worker result from a file descriptor.
+ * @param fd        File descriptor (e.g. a pipe or socket).
+ * @param result    Worker result.
+ * @param maxPieces Largest number of pieces accepted (checked on the length
+ *                  before the result is read).
+ * @return          True if a well formed result is read. False on error, end
+ *                  of file or a result with more than maxPieces pieces.
+ */
+template<typename T, typename Policy>
+bool readShardResult(int fd, ShardResult<T, Policy>& result, size_t maxPieces)
+{
+    const size_t header = shardResultHeader(Policy::digestSize);
+    std::vector<unsigned char> buf(header);
+    if (!readAll(fd, buf.data(), 4))
+        return false;
+
+    size_t bytes = getUint32(buf.data());
+    if (bytes < header || (bytes - header) % Policy::digestSize || (bytes - header) / Policy::digestSize > maxPieces)
+        return false;
+
+    buf.resize(bytes);
+    size_t consumed;
+
+    return readAll(fd, buf.data() + 4, bytes - 4) && decodeShardResult(buf.data(), bytes, result, consumed);
+}
+#endif
+
+/**
+ * @brief TreeAssembler<T, K, Alloc, Policy>::TreeAssembler Class constructor. Prepares the
+ *                                                          assembly of a tree from the
+ *                                                          results of the workers.
+ * @param n         Number of data blocks of the tree.
+ * @param height    Height of the subtrees built by the workers (at least 1).
+ * @param alloc     Allocator of the tree nodes.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+TreeAssembler<T, K, Alloc, Policy>::TreeAssembler(size_t n, size_t height, const Alloc& alloc)
+    : whole(n, alloc), height(height), received(0), pieceHeight((size_t)-1)
+{
+    if (height == 0 || height > whole.depth())
+        throw std::runtime_error("Range Error: Invalid Subtree!");
+
+    size_t width = whole.layerSize(0) / whole.layerSize(height);
+    shards = (n + width - 1) / width;
+    roots.resize(shards);
+    pieces.resize(shards);
+}
+
+/**
+ * @brief TreeAssembler<T, K, Alloc, Policy>::numShards Return the number of subtrees with
+ *                                                     data blocks.
+ * @return  Number of results to receive.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t TreeAssembler<T, K, Alloc, Policy>::numShards() const
+{
+    return shards;
+}
+
+/**
+ * @brief TreeAssembler<T, K, Alloc, Policy>::maxPieces Return the largest piece layer a
+ *                                                     worker can ship, e.g. to bound
+ *                                                     readShardResult.
+ * @return  Number of leaves of a subtree.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t TreeAssembler<T, K, Alloc, Policy>::maxPieces() const
+{
+    return whole.layerSize(0) / whole.layerSize(height);
+}
+
+/**
+ * @brief TreeAssembler<T, K, Alloc, Policy>::add Take the result of a worker. Pieces, if
+ *                                               any, must reduce to the subtree root.
+ * @param result    Worker result.
+ * @return          True if taken. False if it does not fit the tree (wrong
+ *                  subtree, pieces not matching the root or of another height
+ *                  than the others, or subtree already received).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool TreeAssembler<T, K, Alloc, Policy>::add(const ShardResult<T, Policy>& result)
+{
+    if (result.height != height || result.index >= shards || result.root.isEmpty() || !roots[result.index].isEmpty())
+        return false;
+
+    if (!result.pieces.empty())
+    {
+        if (result.pieceHeight > height || (pieceHeight != (size_t)-1 && pieceHeight != result.pieceHeight))
+            return false;
+
+        size_t width = whole.layerSize(result.pieceHeight) / whole.layerSize(height);
+        if (result.pieces.size() != width)
+            return false;
+
+        std::vector<Hash<T, Policy> > level(result.pieces);
+        for (; width > 1; width /= K)
+        {
+            for (size_t i = 0; i < width; ++i)
+                if (level[i].isEmpty())
+                    return false;
+
+            for (size_t i = 0; i < width; i += K)
+                level[i / K] = Hash<T, Policy>::combine(&level[i], K);
+        }
+
+        if (level[0] != result.root)
+            return false;
+
+        pieceHeight = result.pieceHeight;
+        pieces[result.index] = result.pieces;
+    }
+
+    roots[result.index] = result.root;
+    ++received;
+
+    return true;
+}
+
+/**
+ * @brief TreeAssembler<T, K, Alloc, Policy>::complete Tell whether every subtree with data
+ *                                                    blocks has been received.
+ * @return  True if the tree can be assembled. False otherwise.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool TreeAssembler<T, K, Alloc, Policy>::complete() const
+{
+    return received == shards;
+}
+
+/**
+ * @brief TreeAssembler<T, K, Alloc, Policy>::assemble Install the piece layer (if every
+ *                                                     worker shipped it) or the subtree
+ *                                                     roots, and compute every node above.
+ * @return  True if the tree is assembled. False if not complete.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool TreeAssembler<T, K, Alloc, Policy>::assemble()
+{
+    if (!complete())
+        return false;
+
+    bool allPieces = true;
+    for (size_t i = 0; i < shards; ++i)
+        allPieces = allPieces && !pieces[i].empty();
+
+    if (!allPieces)
+        return whole.setLayer(height, roots.data(), shards);
+
+    std::vector<Hash<T, Policy> > layer;
+    for (size_t i = 0; i < shards; ++i)
+        layer.insert(layer.end(), pieces[i].begin(), pieces[i].end());
+
+    return whole.setLayer(pieceHeight, layer.data(), layer.size());
+}
+
+/**
+ * @brief TreeAssembler<T, K, Alloc, Policy>::tree Return the tree being assembled.
+ * @return  Reference to the tree (its root hash is known once assembled).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleTree<T, K, Alloc, Policy>& TreeAssembler<T, K, Alloc, Policy>::tree()
+{
+    return whole;
+}
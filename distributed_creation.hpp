@@ -0,0 +1,99 @@
+#ifndef _DISTRIBUTED_CREATION_H_
+#define _DISTRIBUTED_CREATION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "byte_order.hpp"
+#include "hash.hpp"
+#include "merkle_tree.hpp"
+
+// Creation of a tree split across workers (processes or hosts): every worker builds the subtree of an
+// aligned range of blocks (MerkleTree::emptySubtree then addBlock) and ships back its root and, optionally,
+// its piece layer; a TreeAssembler on the coordinator puts the results together into the whole tree
+
+// what a worker ships back: the root (and optionally the piece layer) of the subtree under node index of
+// the layer at height
+template <typename T, typename Policy = Sha256Policy>
+struct ShardResult
+{
+  uint32_t height;
+  uint32_t index;
+  Hash<T, Policy> root;
+  uint32_t pieceHeight; // height of the piece layer in the whole tree (if any)
+  std::vector<Hash<T, Policy> > pieces; // piece layer of the subtree (empty if not shipped)
+};
+
+// smallest height of the subtrees that split a tree of n blocks into at least numShards subtrees
+// (fewer if the tree is too small: every subtree has at least K leaves)
+template <size_t K>
+size_t shardHeight(size_t n, size_t numShards);
+
+// result of a worker whose subtree is complete; pieces (layer at pieceHeight of the whole tree) are
+// shipped if pieceHeight is not greater than the subtree height
+// return runtime_error if the subtree root is not known
+template <typename T, size_t K, typename Alloc, typename Policy>
+ShardResult<T, Policy> makeShardResult(const MerkleSubtree<T, K, Alloc, Policy>& shard, size_t pieceHeight = (size_t)-1);
+
+// append a serialized result (digests of Policy::digestSize bytes) to out; return number of bytes appended
+template <typename T, typename Policy>
+size_t encodeShardResult(const ShardResult<T, Policy>& result, std::vector<unsigned char>& out);
+
+// parse the serialized result at the beginning of buf (size bytes); consumed is its size
+// return false if buf does not start with a complete and well formed result
+template <typename T, typename Policy>
+bool decodeShardResult(const unsigned char* buf, size_t size, ShardResult<T, Policy>& result, size_t& consumed);
+
+#if defined(__unix__) || defined(__APPLE__)
+// write a serialized result to a file descriptor (e.g. a pipe or socket); return false on error
+template <typename T, typename Policy>
+bool writeShardResult(int fd, const ShardResult<T, Policy>& result);
+
+// read a serialized result from a file descriptor; return false on error or end of file
+// a length announcing more than maxPieces pieces (e.g. TreeAssembler::maxPieces()) is refused before
+// anything is allocated
+template <typename T, typename Policy>
+bool readShardResult(int fd, ShardResult<T, Policy>& result, size_t maxPieces);
+#endif
+
+// coordinator side: collects the results of the workers and assembles the whole tree
+template <typename T, size_t K = 2, typename Alloc = std::allocator<Hash<T> >,
+          typename Policy = Sha256Policy>
+class TreeAssembler
+{
+public:
+  // Constructor: tree of n blocks split in subtrees of the given height (at least 1)
+  TreeAssembler(size_t n, size_t height, const Alloc& alloc = Alloc());
+
+  // number of subtrees that hold data blocks (those only made of padding need no worker)
+  size_t numShards() const;
+
+  // largest piece layer a worker can ship (the leaves of a subtree)
+  size_t maxPieces() const;
+
+  // take the result of a worker; return false if it does not fit (wrong subtree, pieces that do not
+  // reduce to the root, or already received)
+  bool add(const ShardResult<T, Policy>& result);
+
+  // whether every subtree with data blocks has been received
+  bool complete() const;
+
+  // assemble the tree once complete: the subtree roots (or the piece layer, if every worker shipped
+  // it) and every node above them; return false if not complete
+  bool assemble();
+
+  // the tree being assembled (its root hash is known once assembled)
+  MerkleTree<T, K, Alloc, Policy>& tree();
+
+private:
+  MerkleTree<T, K, Alloc, Policy> whole;
+  size_t height;
+  size_t shards; // number of subtrees with data blocks
+  size_t received;
+  std::vector<Hash<T, Policy> > roots;
+  std::vector<std::vector<Hash<T, Policy> > > pieces; // by subtree
+  size_t pieceHeight; // (size_t)-1 until a result with pieces arrives
+};
+
+#include "distributed_creation.cpp"
+#endif  //_DISTRIBUTED_CREATION_H_
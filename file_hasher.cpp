@@ -0,0 +1,173 @@
+#include "file_hasher.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <algorithm>
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//////////////
+/**
+ * @brief preadAll Read exactly size bytes at an offset of a file (retrying partial
+ *                 and interrupted reads).
+ * @param fd        File descriptor.
+ * @param buf       Buffer.
+ * @param size      Number of bytes to read.
+ * @param offset    Offset in the file.
+ * @return          True if every byte is read. False on error or end of file.
+ */
+inline bool preadAll(int fd, unsigned char* buf, size_t size, off_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t done = ::pread(fd, buf, size, offset);
+        if (done < 0 && errno == EINTR)
+            continue;
+
+        if (done <= 0)
+            return false;
+
+        buf += done;
+        size -= done;
+        offset += done;
+    }
+
+    return true;
+}
+
+/**
+ * @brief nextDataExtent Find the first data extent [dataStart, holeStart) of a file
+ *                       that ends after an offset. Without hole reporting (or if
+ *                       the file system does not support it) the whole file is
+ *                       one data extent.
+ * @param fd        File descriptor.
+ * @param offset    Offset in the file.
+ * @param size      Size of the file.
+ * @param dataStart Start of the extent (size if only a hole is left).
+ * @param holeStart End of the extent (start of the next hole, or size).
+ * @return          True if found. False on error.
+ */
+inline bool nextDataExtent(int fd, off_t offset, off_t size, off_t& dataStart, off_t& holeStart)
+{
+#ifdef SEEK_DATA
+    dataStart = ::lseek(fd, offset, SEEK_DATA);
+    if (dataStart < 0 && errno == ENXIO)    //only a hole up to the end of the file
+    {
+        dataStart = holeStart = size;
+        return true;
+    }
+
+    if (dataStart >= 0)
+    {
+        holeStart = ::lseek(fd, dataStart, SEEK_HOLE);
+        return holeStart >= 0;
+    }
+
+    if (errno != EINVAL)
+        return false;
+#endif
+
+    dataStart = offset;
+    holeStart = size;
+    return true;
+}
+//////////////
+
+/**
+ * @brief hashBlocks Hash every block of a file into an array. Blocks that lie
+ *                   entirely in a hole are not read: they take the zero block hash
+ *                   (computed once for the block size, once more for a short last
+ *                   block). Other blocks (even partly in a hole) are read and hashed
+ *                   (all zero ones through the zero block fast path).
+ * @param fd        Open file descriptor (read access, seekable).
+ * @param size      Size of the file in bytes.
+ * @param blockSize Size of the blocks in bytes (the last one may be shorter).
+ * @param leaves    Output array for the hashes of the blocks, in order.
+ * @param stats     If not null, bytes read and bytes skipped as holes.
+ * @return          True if every block is hashed. False on I/O error.
+ */
+template<typename T, typename Policy>
+bool hashBlocks(int fd, off_t size, size_t blockSize, Hash<T, Policy> leaves[], FileHashStats* stats)
+{
+    size_t numBlocks = (size_t)((size + blockSize - 1) / blockSize);
+    std::vector<unsigned char> buffer(blockSize);
+    FileHashStats counts = { 0, 0 };
+    const Hash<T, Policy> zeroBlock = Hash<T, Policy>::zeroBlock(blockSize);
+
+    off_t dataStart = 0;
+    off_t holeStart = 0;    //extent to find
+    for (size_t b = 0; b < numBlocks; ++b)
+    {
+        off_t start = (off_t)(b * blockSize);
+        size_t length = (size_t)std::min((off_t)blockSize, size - start);
+
+        if (start >= holeStart && !nextDataExtent(fd, start, size, dataStart, holeStart))
+            return false;
+
+        if (dataStart >= start + (off_t)length)   //the whole block is in a hole
+        {
+            leaves[b] = (length == blockSize) ? zeroBlock : Hash<T, Policy>::zeroBlock(length);
+            counts.holeBytes += length;
+            continue;
+        }
+
+        if (!preadAll(fd, buffer.data(), length, start))
+            return false;
+
+        leaves[b] = Hash<T, Policy>(buffer.data(), length);
+        counts.bytesRead += length;
+    }
+
+    if (stats)
+        *stats = counts;
+
+    return true;
+}
+//////////////
+
+/**
+ * @brief hashFileBlocks Hash every block of a file (skipping holes, see hashBlocks).
+ * @param fd        Open file descriptor (read access, seekable).
+ * @param blockSize Size of the blocks in bytes (the last one may be shorter).
+ * @param leaves    Hashes of the blocks, in order.
+ * @param stats     If not null, bytes read and bytes skipped as holes.
+ * @return          True if every block is hashed. False on I/O error.
+ */
+template<typename T, typename Policy>
+bool hashFileBlocks(int fd, size_t blockSize, std::vector<Hash<T, Policy> >& leaves, FileHashStats* stats)
+{
+    struct stat st;
+    if (blockSize == 0 || ::fstat(fd, &st) != 0)
+        return false;
+
+    leaves.assign((size_t)((st.st_size + blockSize - 1) / blockSize), Hash<T, Policy>());
+    return hashBlocks(fd, st.st_size, blockSize, leaves.data(), stats);
+}
+
+/**
+ * @brief hashFile Hash every block of a file (skipping holes) straight into the leaf
+ *                 layer of a tree and install it in one bulk pass. If the tree has a
+ *                 root hash, it is a recheck: the layer is installed only if it
+ *                 matches.
+ * @param fd        Open file descriptor (read access, seekable).
+ * @param blockSize Size of the blocks in bytes (the last one may be shorter).
+ * @param tree      Tree with one block per file block.
+ * @param stats     If not null, bytes read and bytes skipped as holes.
+ * @return          True if the leaf layer is installed. False on I/O error, if the
+ *                  number of blocks differs or if the root hash does not match.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool hashFile(int fd, size_t blockSize, MerkleTree<T, K, Alloc, Policy>& tree, FileHashStats* stats)
+{
+    struct stat st;
+    if (blockSize == 0 || ::fstat(fd, &st) != 0)
+        return false;
+
+    if ((size_t)((st.st_size + blockSize - 1) / blockSize) != tree.getNumBlocks())
+        return false;
+
+    return tree.fillLeaves([&](Hash<T, Policy> leaves[], size_t) {
+        return hashBlocks(fd, st.st_size, blockSize, leaves, stats);
+    });
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef _FILE_HASHER_H_
+#define _FILE_HASHER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "hash.hpp"
+#include "merkle_tree.hpp"
+
+// Hashing of the blocks of a file (torrent creation and recheck) that skips the holes of sparse files:
+// regions reported as holes by lseek(SEEK_DATA/SEEK_HOLE) are never read, their blocks take the cached
+// zero block hash (Hash::zeroBlock); file systems without hole reporting are read entirely
+
+#if defined(__unix__) || defined(__APPLE__)
+// bytes read from disk and bytes of whole blocks skipped as holes
+struct FileHashStats
+{
+  uint64_t bytesRead;
+  uint64_t holeBytes;
+};
+
+// hash every block (blockSize bytes, the last one may be shorter) of the open file fd into leaves
+// return false on I/O error
+template <typename T, typename Policy>
+bool hashFileBlocks(int fd, size_t blockSize, std::vector<Hash<T, Policy> >& leaves, FileHashStats* stats = 0);
+
+// hash the blocks of the open file fd straight into the leaf layer of tree (MerkleTree::fillLeaves):
+// creation, or recheck against the root hash of the tree
+// return false on I/O error, if the tree does not have one block per file block or if the root does not match
+template <typename T, size_t K, typename Alloc, typename Policy>
+bool hashFile(int fd, size_t blockSize, MerkleTree<T, K, Alloc, Policy>& tree, FileHashStats* stats = 0);
+#endif
+
+#include "file_hasher.cpp"
+#endif  //_FILE_HASHER_H_
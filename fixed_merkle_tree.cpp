@@ -0,0 +1,258 @@
+#include "fixed_merkle_tree.hpp"
+#include <stdexcept>
+
+template<typename T, size_t N, typename Policy> constexpr size_t FixedMerkleTree<T, N, Policy>::numPads;
+template<typename T, size_t N, typename Policy> constexpr size_t FixedMerkleTree<T, N, Policy>::treeSize;
+template<typename T, size_t N, typename Policy> constexpr size_t FixedMerkleTree<T, N, Policy>::proofSize;
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::FixedMerkleTree Class constructor. Builds an empty
+ *                                                      tree without root hash.
+ */
+template<typename T, size_t N, typename Policy>
+FixedMerkleTree<T, N, Policy>::FixedMerkleTree()
+{
+    pad();
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::FixedMerkleTree Class constructor. Builds an empty
+ *                                                      tree with root hash.
+ * @param rootHash  Hash of the root node.
+ */
+template<typename T, size_t N, typename Policy>
+FixedMerkleTree<T, N, Policy>::FixedMerkleTree(const Hash<T, Policy>& rootHash)
+{
+    mktree[0] = rootHash;
+    pad();
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::setRootHash Assign root hash of tree.
+ * @param rootHash Hash set for the root node.
+ */
+template<typename T, size_t N, typename Policy>
+void FixedMerkleTree<T, N, Policy>::setRootHash(const Hash<T, Policy>& rootHash)
+{
+    mktree[0] = rootHash;
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::getRootHash Return the root hash of Merkle tree.
+ * @return  Hash in the root node of Merkle tree. Throws a std::runtime_error
+ *          if the root hash is empty.
+ */
+template<typename T, size_t N, typename Policy>
+Hash<T, Policy> FixedMerkleTree<T, N, Policy>::getRootHash() const
+{
+    if (mktree[0].isEmpty())
+        throw std::runtime_error("Runtime Error: Invalid/Empty Root Hash!");
+
+    return mktree[0];
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::addBlock Add data block number blockID to the tree
+ *                                               and calculate descendent hashes if possible.
+ * @param blockID   ID for the added data block.
+ * @param block     STL sequential container representing the data block.
+ * @return          True if the data block is added successfully. Throws
+ *                  a std::runtime_error exception if no block-id in the tree.
+ */
+template<typename T, size_t N, typename Policy>
+bool FixedMerkleTree<T, N, Policy>::addBlock(size_t blockID, const T& block)
+{
+    if (blockID >= N)
+        throw std::runtime_error("Range Error: Invalid Block ID!");
+
+    mktree[block2ind(blockID)] = Hash<T, Policy>(block);
+    updateTree(blockID);
+
+    return true;
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::addBlock Add data block number blockID to the tree
+ *                                               and calculate descendent hashes if possible.
+ * @param blockID   ID for the added data block.
+ * @param block     Unsigned char array representing the data block.
+ * @param size      Number of bytes in the block.
+ * @return          True if the data block is added successfully. Throws
+ *                  a std::runtime_error exception if no block-id in the tree.
+ */
+template<typename T, size_t N, typename Policy>
+bool FixedMerkleTree<T, N, Policy>::addBlock(size_t blockID, const unsigned char* block, size_t size)
+{
+    if (blockID >= N)
+        throw std::runtime_error("Range Error: Invalid Block ID!");
+
+    mktree[block2ind(blockID)] = Hash<T, Policy>(block, size);
+    updateTree(blockID);
+
+    return true;
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::verifyBlock Verify integrity of block (use sibling
+ *                                                  and descendents hashes of block hash). If
+ *                                                  block is verified add hash to tree.
+ * @param blockID   ID of the block.
+ * @param blockHash Hash of the block.
+ * @return          True if block is verified. False otherwise.
+ */
+template<typename T, size_t N, typename Policy>
+bool FixedMerkleTree<T, N, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash)
+{
+    if (blockID >= N)
+        return false;
+
+    size_t node = block2ind(blockID);
+    Hash<T, Policy> unverHash = blockHash;
+
+    while (node > 0)
+    {
+        const Hash<T, Policy>& sibl = mktree[getSibling(node)];
+        if (sibl.isEmpty())
+            return false;
+
+        unverHash = (node % 2) ? unverHash + sibl : sibl + unverHash;
+        node = getParent(node);
+
+        if (unverHash != mktree[node])
+            return false;
+    }
+
+    mktree[block2ind(blockID)] = blockHash;
+    updateTree(blockID);
+
+    return true;
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::verifyBlock Verify integrity of block using a proof
+ *                                                  of sibling hashes. If block is verified
+ *                                                  add hash to tree and incorporate the
+ *                                                  sibling hashes.
+ * @param blockID   ID of the block to verify.
+ * @param blockHash Hash of the block to verify.
+ * @param proof     Contains (in order) hashes for block's sibling and all
+ *                  descendents' siblings up until root node.
+ * @return          True if block is verified. False otherwise.
+ */
+template<typename T, size_t N, typename Policy>
+bool FixedMerkleTree<T, N, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Proof& proof)
+{
+    if (blockID >= N)
+        return false;
+
+    size_t node = block2ind(blockID);
+    Hash<T, Policy> unverHash = blockHash;
+
+    for (size_t i = 0; i < proofSize; ++i)
+    {
+        if (proof[i].isEmpty())
+            return false;
+
+        unverHash = (node % 2) ? unverHash + proof[i] : proof[i] + unverHash;
+        node = getParent(node);
+    }
+
+    if (unverHash != mktree[0])
+        return false;
+
+    //insert hashes into the tree
+    node = block2ind(blockID);
+    mktree[node] = blockHash;
+
+    for (size_t i = 0; i < proofSize; ++i)
+    {
+        mktree[getSibling(node)] = proof[i];
+        node = getParent(node);
+    }
+
+    updateTree(blockID);
+
+    return true;
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::getProof Fill proof with the sibling hashes of
+ *                                               every node in the path from block blockID
+ *                                               up to the root.
+ * @param blockID   ID of the block.
+ * @param proof     Output proof.
+ * @return          True if the proof is complete. False if the block does not
+ *                  exist or some sibling hash is not known by the tree.
+ */
+template<typename T, size_t N, typename Policy>
+bool FixedMerkleTree<T, N, Policy>::getProof(size_t blockID, Proof& proof) const
+{
+    if (blockID >= N)
+        return false;
+
+    size_t node = block2ind(blockID);
+    for (size_t i = 0; i < proofSize; ++i)
+    {
+        if (mktree[getSibling(node)].isEmpty())
+            return false;
+
+        proof[i] = mktree[getSibling(node)];
+        node = getParent(node);
+    }
+
+    return true;
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::pad Set hash of padding blocks; also update hashes
+ *                                          of descendents, if possible
+ */
+template<typename T, size_t N, typename Policy>
+void FixedMerkleTree<T, N, Policy>::pad()
+{
+    static const unsigned char padHash[Policy::digestSize] = {0};
+
+    for (size_t id = N; id < N + numPads; ++id)
+    {
+        mktree[block2ind(id)].setHash(padHash, sizeof(padHash));
+        updateTree(id);
+    }
+}
+
+/**
+ * @brief FixedMerkleTree<T, N, Policy>::updateTree Calculate descendent hashes after adding
+ *                                                 block, if possible.
+ * @param blockID   ID of added data block.
+ */
+template<typename T, size_t N, typename Policy>
+void FixedMerkleTree<T, N, Policy>::updateTree(size_t blockID)
+{
+    size_t node = block2ind(blockID);
+
+    while (node > 0)
+    {
+        size_t lftChild = (node % 2) ? node : node - 1;
+
+        if (mktree[lftChild].isEmpty() || mktree[lftChild + 1].isEmpty())
+            break;
+
+        node = getParent(node);
+        mktree[node] = mktree[lftChild] + mktree[lftChild + 1];
+    }
+}
+
+/**
+ * @brief operator << Overload ostream operator. Writes the Merkle Tree to an
+ *                    output stream.
+ * @param os    Output std::ostream.
+ * @param t     Merkle Tree writed to the stream
+ * @return      std::stream after the tree has been writed out.
+ */
+template<typename U, size_t M, typename P>
+std::ostream& operator<<(std::ostream& os, const FixedMerkleTree<U, M, P>& t)
+{
+    for (size_t i = 0; i < t.treeSize; ++i)
+        os << i << ":" << t.mktree[i] << std::endl;
+
+    return os;
+}
@@ -0,0 +1,90 @@
+#ifndef _FIXED_MERKLE_TREE_H_
+#define _FIXED_MERKLE_TREE_H_
+
+#include <array>
+#include <iostream>
+#include <string>
+
+#include "hash.hpp"
+
+// smallest power of two >= n (and >= 2): number of leaves of a tree of n blocks
+constexpr size_t fixedLeafCount(size_t n, size_t pow = 2)
+{
+  return (pow >= n) ? pow : fixedLeafCount(n, 2 * pow);
+}
+
+// log2 of a power of two
+constexpr size_t fixedLog2(size_t pow)
+{
+  return (pow <= 1) ? 0 : 1 + fixedLog2(pow / 2);
+}
+
+// Binary Merkle tree whose number of blocks N is known at compile time: the
+// geometry is constexpr and the nodes are stored inline (no heap allocation),
+// so trees can live on the stack or in arrays
+template <typename T, size_t N, typename Policy = Sha256Policy>
+class FixedMerkleTree
+{
+  static_assert(N > 0, "FixedMerkleTree needs at least one block");
+
+public:
+  // number of padding blocks in the tree
+  static constexpr size_t numPads = fixedLeafCount(N) - N;
+  // number of nodes (including root) in the tree
+  static constexpr size_t treeSize = 2 * fixedLeafCount(N) - 1;
+  // number of hashes in a verification proof
+  static constexpr size_t proofSize = fixedLog2(fixedLeafCount(N));
+
+  // verification proof: sibling hashes from the leaf up until the root
+  typedef std::array<Hash<T, Policy>, proofSize> Proof;
+
+  // Constructor: empty tree without root hash
+  FixedMerkleTree();
+
+  // Constructor: empty tree with root hash
+  FixedMerkleTree(const Hash<T, Policy>& rootHash);
+
+  //overload ostream operator (useful for debug)
+  template <typename U, size_t M, typename P>
+  friend std::ostream& operator<<(std::ostream& os, const FixedMerkleTree<U, M, P>& t);
+
+  // assign root hash of Merkle Tree
+  void setRootHash(const Hash<T, Policy>& rootHash);
+
+  // return root hash to user
+  Hash<T, Policy> getRootHash() const;
+
+  // add data block number blockID to the tree (calculate descendent hashes if possible)
+  // return range_error if not block-id not in tree
+  bool addBlock(size_t blockID, const T& block);
+
+  // same as above but block data is in array form (size is the number of bytes in block)
+  bool addBlock(size_t blockID, const unsigned char* block, size_t size);
+
+  // verify integrity of block (use sibling and descendents if hash of block isn't in the tree)
+  // if block is verified add hash to tree and calculate descendent hashes, if necessary
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash);
+
+  // verify integrity of block using a proof (sibling hashes from the leaf up until the root)
+  // if block is verified add hash to tree and incorporate sibling hashes
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Proof& proof);
+
+  // fill proof with the sibling hashes of block blockID
+  // return false if the tree does not know every sibling along the path
+  bool getProof(size_t blockID, Proof& proof) const;
+
+  // note: the following provide indices into mktree (compile-time when arguments are)
+  static constexpr size_t getParent(size_t childNode) { return (childNode - 1) / 2; } //parent node
+  static constexpr size_t getSibling(size_t childNode) { return (childNode % 2) ? childNode + 1 : childNode - 1; } //sister node
+  static constexpr size_t block2ind(size_t blockID) { return (fixedLeafCount(N) - 1) + blockID; } //index of block's hash
+
+private:
+  // Array-based implementation of Merkle tree (root node at index zero)
+  std::array<Hash<T, Policy>, treeSize> mktree;
+
+  void pad(); //set hash of padding blocks; also update hashes of descendents, if possible
+  void updateTree(size_t blockID); //calculate descendent hashes after adding block, if necessary
+};
+
+#include "fixed_merkle_tree.cpp"
+#endif  //_FIXED_MERKLE_TREE_H_
@@ -1,126 +1,529 @@
 #include "hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <mutex>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+//////////////
+// containers whose bytes can be hashed straight from their data pointer: data() returns a pointer to
+// byte-sized elements (std::string, std::vector<unsigned char>, std::array, string_view/span-like types)
+template <typename C, typename = void>
+struct ContiguousBytes : std::false_type {};
+
+template <typename C>
+struct ContiguousBytes<C, typename std::enable_if<
+    std::is_pointer<decltype(std::declval<const C&>().data())>::value &&
+    sizeof(*std::declval<const C&>().data()) == 1>::type> : std::true_type {};
+
+// non-contiguous containers of addressable bytes (std::deque, std::list): hashed by runs of adjacent bytes
+// (detected like ContiguousBytes, so types without const_iterator, e.g. span-like ones, are not segmented)
+template <typename C, typename = void>
+struct SegmentedBytes : std::false_type {};
+
+template <typename C>
+struct SegmentedBytes<C, typename std::enable_if<
+    sizeof(typename C::value_type) == 1 &&
+    std::is_reference<typename std::iterator_traits<typename C::const_iterator>::reference>::value>::type>
+    : std::true_type {};
+
+/**
+ * @brief wholeSegment Return the bytes of a contiguous container as one segment.
+ * @param data  Container.
+ * @return      Segment over the data pointer and size of the container.
+ */
+template <typename C>
+HashSegment wholeSegment(const C& data, std::true_type)
+{
+    HashSegment whole = { reinterpret_cast<const unsigned char*>(data.data()), data.size() };
+    return whole;
+}
+
+/**
+ * @brief wholeSegment Empty segment for a non-contiguous container (its bytes are
+ *                     not in one buffer).
+ * @return      Segment of size 0.
+ */
+template <typename C>
+HashSegment wholeSegment(const C&, std::false_type)
+{
+    HashSegment none = { 0, 0 };
+    return none;
+}
+
+/**
+ * @brief feedContainer Feed the bytes of a contiguous container to a stream in
+ *                      one call.
+ * @param stream    Streaming hasher.
+ * @param data      Container.
+ */
+template <typename Stream, typename C>
+void feedContainer(Stream& stream, const C& data, std::true_type, std::false_type)
+{
+    stream.update(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+}
+
+/**
+ * @brief feedContainer Feed the bytes of a segmented container to a stream, run of
+ *                      adjacent bytes by run (e.g. the buffers of a std::deque).
+ *                      Long runs are hashed in place, short ones (e.g. the nodes of
+ *                      a std::list) are gathered in a small staging buffer.
+ * @param stream    Streaming hasher.
+ * @param data      Container.
+ */
+template <typename Stream, typename C>
+void feedContainer(Stream& stream, const C& data, std::false_type, std::true_type)
+{
+    unsigned char staged[256];
+    size_t numStaged = 0;
+    const unsigned char* run = 0;
+    size_t runSize = 0;
+
+    for (typename C::const_iterator it = data.begin();; ++it)
+    {
+        const unsigned char* p = (it != data.end()) ? reinterpret_cast<const unsigned char*>(&*it) : 0;
+        if (p && p == run + runSize)
+        {
+            ++runSize;
+            continue;
+        }
+
+        if (runSize >= 64)
+        {
+            stream.update(staged, numStaged);
+            stream.update(run, runSize);
+            numStaged = 0;
+        }
+        else if (runSize > 0)
+        {
+            if (numStaged + runSize > sizeof(staged))
+            {
+                stream.update(staged, numStaged);
+                numStaged = 0;
+            }
+            std::memcpy(staged + numStaged, run, runSize);
+            numStaged += runSize;
+        }
+
+        if (!p)
+            break;
+
+        run = p;
+        runSize = 1;
+    }
+
+    stream.update(staged, numStaged);
+}
+
+/**
+ * @brief feedContainer Feed the elements of any other container to a stream, each
+ *                      one as a byte (its low 8 bits, as picosha2 does), through a
+ *                      small staging buffer.
+ * @param stream    Streaming hasher.
+ * @param data      Container.
+ */
+template <typename Stream, typename C>
+void feedContainer(Stream& stream, const C& data, std::false_type, std::false_type)
+{
+    unsigned char staged[256];
+    size_t numStaged = 0;
+
+    for (typename C::const_iterator it = data.begin(); it != data.end(); ++it)
+    {
+        staged[numStaged++] = static_cast<unsigned char>(*it);
+        if (numStaged == sizeof(staged))
+        {
+            stream.update(staged, numStaged);
+            numStaged = 0;
+        }
+    }
+
+    stream.update(staged, numStaged);
+}
+
+/**
+ * @brief isZeroBlock Tell whether a byte sequence is all zeros. Bytes are tested 64
+ *                    at a time as words OR-ed together (vectorized by the
+ *                    compiler); data that is not zero usually fails on the first
+ *                    step.
+ * @param data  Byte sequence.
+ * @param size  Number of bytes in data.
+ * @return      True if every byte is zero. False otherwise.
+ */
+inline bool isZeroBlock(const unsigned char* data, size_t size)
+{
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+        uint64_t w[8];
+        std::memcpy(w, data + i, 64);
+        if (w[0] | w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7])
+            return false;
+    }
+
+    for (; i < size; ++i)
+        if (data[i])
+            return false;
+
+    return true;
+}
 
 /**
- * @brief Hash<T>::Hash Class default constructor. Builds an empty hash.
+ * @brief feedZeros Feed a sequence of zero bytes to a stream.
+ * @param stream    Streaming hasher.
+ * @param size      Number of zero bytes.
  */
-template <typename T>
-Hash<T>::Hash()
+template <typename Stream>
+void feedZeros(Stream& stream, size_t size)
 {
+    static const unsigned char zeros[4096] = {};
+
+    for (size_t left = size; left > 0;)
+    {
+        size_t take = std::min(left, sizeof(zeros));
+        stream.update(zeros, take);
+        left -= take;
+    }
 }
 
+// block sizes whose zero block hash is cached: powers of two from 1 KiB to 16 MiB
+const size_t MIN_ZERO_BLOCK_LOG = 10;
+const size_t MAX_ZERO_BLOCK_LOG = 24;
+
 /**
- * @brief Hash<T>::Hash Class constructor. Builds a hash from a byte sequence.
+ * @brief zeroBlockSlot Slot of a block size in the zero block cache.
+ * @param size  Number of bytes in the block.
+ * @return      Slot (0 for 1 KiB up to MAX_ZERO_BLOCK_LOG - MIN_ZERO_BLOCK_LOG
+ *              for 16 MiB). -1 if the size is not a cached block size.
+ */
+inline int zeroBlockSlot(size_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0)
+        return -1;
+
+    size_t log = 0;
+    while ((size_t(1) << log) < size)
+        ++log;
+
+    return (log >= MIN_ZERO_BLOCK_LOG && log <= MAX_ZERO_BLOCK_LOG) ? int(log - MIN_ZERO_BLOCK_LOG) : -1;
+}
+
+// lookup tables of the hex codec
+struct HexTables
+{
+  char pairs[512];              // two hex digits of every byte value
+  unsigned char values[256];    // value of every hex digit char (0xff if not a hex digit)
+
+  HexTables()
+  {
+      const char digits[] = "0123456789abcdef";
+      for (size_t i = 0; i < 256; ++i)
+      {
+          pairs[2 * i] = digits[i >> 4];
+          pairs[2 * i + 1] = digits[i & 15];
+          values[i] = 0xff;
+      }
+      for (size_t i = 0; i < 16; ++i)
+          values[(unsigned char)digits[i]] = (unsigned char)i;
+      for (size_t i = 10; i < 16; ++i)
+          values[(unsigned char)('A' + i - 10)] = (unsigned char)i;
+  }
+};
+
+/**
+ * @brief hexTables Return the lookup tables of the hex codec (built once).
+ * @return  Hex codec tables.
+ */
+inline const HexTables& hexTables()
+{
+    static const HexTables tables;
+    return tables;
+}
+
+/**
+ * @brief encodeHex Write bytes in lowercase hex form, two digits per byte from a
+ *                  table.
+ * @param bytes Bytes to encode.
+ * @param size  Number of bytes.
+ * @param out   Output buffer (2 * size chars).
+ */
+inline void encodeHex(const unsigned char* bytes, size_t size, char* out)
+{
+    const char* pairs = hexTables().pairs;
+    for (size_t i = 0; i < size; ++i)
+        std::memcpy(out + 2 * i, pairs + 2 * bytes[i], 2);
+}
+
+/**
+ * @brief decodeHex Parse hex digits (either case) into bytes. Invalid digits are
+ *                  detected once at the end (no branch per char).
+ * @param hex   Hex digits (2 * size chars).
+ * @param size  Number of bytes to decode.
+ * @param out   Output buffer (size bytes).
+ * @return      True if every char is a hex digit. False otherwise.
+ */
+inline bool decodeHex(const char* hex, size_t size, unsigned char* out)
+{
+    const unsigned char* values = hexTables().values;
+    unsigned char bad = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        unsigned char hi = values[(unsigned char)hex[2 * i]];
+        unsigned char lo = values[(unsigned char)hex[2 * i + 1]];
+        bad |= hi | lo;
+        out[i] = (unsigned char)((hi << 4) | (lo & 15));
+    }
+
+    return !(bad & 0xf0);
+}
+//////////////
+
+/**
+ * @brief Hash<T, Policy>::Hash Class default constructor. Builds an empty hash.
+ */
+template <typename T, typename Policy>
+Hash<T, Policy>::Hash() : set(false)
+{
+  std::memset(h, 0, Policy::digestSize);
+}
+
+/**
+ * @brief Hash<T, Policy>::Hash Class constructor. Builds a hash from a byte sequence.
+ *                              An all-zero block of a cached block size (a power of
+ *                              two from 1 KiB to 16 MiB) takes the cached zero block
+ *                              hash.
  * @param data  Unsigned char array representing the byte sequence.
  * @param size  Number the bytes in the sequence.
  */
-template <typename T>
-Hash<T>::Hash(const unsigned char *data, size_t size)
+template <typename T, typename Policy>
+Hash<T, Policy>::Hash(const unsigned char *data, size_t size) : set(true)
 {
-  // picosha2 requires h to be preallocated
-  h = std::vector<unsigned char>(32);  
-  picosha2::hash256(data, data+size, h);
+  HashSegment whole = { data, size };
+  if (fromZeroBlock(&whole, 1))
+    return;
+
+  typename Policy::Stream stream;
+  stream.update(data, size);
+  stream.finalize(h);
 }
 
 /**
- * @brief Hash<T>::Hash Class constructor. Builds a hash from any STL sequential container.
+ * @brief Hash<T, Policy>::Hash Class constructor. Builds a hash from any STL sequential container.
+ *                              Contiguous containers of bytes are hashed straight from their
+ *                              data pointer (an all-zero block of a cached size takes the
+ *                              cached zero block hash), other containers without a full copy.
  * @param data  STL sequential container.
  */
-template <typename T>
-Hash<T>::Hash(const T& data)
+template <typename T, typename Policy>
+Hash<T, Policy>::Hash(const T& data) : set(true)
+{
+  HashSegment whole = wholeSegment(data, ContiguousBytes<T>());
+  if (fromZeroBlock(&whole, 1))
+    return;
+
+  typename Policy::Stream stream;
+  feedContainer(stream, data, ContiguousBytes<T>(),
+                std::integral_constant<bool, !ContiguousBytes<T>::value && SegmentedBytes<T>::value>());
+  stream.finalize(h);
+}
+
+/**
+ * @brief Hash<T, Policy>::Hash Class constructor. Builds the hash of the bytes fed so far
+ *                              to a stream, e.g. a piece fed chunk by chunk as it arrives.
+ * @param stream    Streaming hasher (left as is).
+ */
+template <typename T, typename Policy>
+Hash<T, Policy>::Hash(const typename Policy::Stream& stream) : set(true)
 {
-  // picosha2 requires h to be preallocated
-  h = std::vector<unsigned char>(32);
-  picosha2::hash256(data, h);
+  stream.digest(h);
 }
 
 /**
- * @brief Hash<T>::Hash Class copy constructor. Builds a hash from another
- *                      hash given.
+ * @brief Hash<T, Policy>::Hash Class constructor. Builds the hash of the concatenation of
+ *                              several buffers (e.g. a block split across network receive
+ *                              buffers or files), fed in order to the compression function
+ *                              without joining them. An all-zero block of a cached
+ *                              block size takes the cached zero block hash.
+ * @param segments  Array of segments (pointer and size), in order.
+ * @param n         Number of segments in the array.
+ */
+template <typename T, typename Policy>
+Hash<T, Policy>::Hash(const HashSegment segments[], size_t n) : set(true)
+{
+  if (fromZeroBlock(segments, n))
+    return;
+
+  typename Policy::Stream stream;
+  for (size_t i = 0; i < n; ++i)
+    stream.update(segments[i].data, segments[i].size);
+  stream.finalize(h);
+}
+
+/**
+ * @brief Hash<T, Policy>::Hash Class copy constructor. Builds a hash from another
+ *                              hash given.
  * @param x The other hash.
  */
-template<typename T>
-Hash<T>::Hash(const Hash<T>& x)
+template<typename T, typename Policy>
+Hash<T, Policy>::Hash(const Hash<T, Policy>& x) : set(x.set)
 {
-   h = x.h;
+   std::memcpy(h, x.h, Policy::digestSize);
 }
 
 /**
- * @brief Hash<T>::Hash Class private constructor. Builds a hash as the
- *                      combination of two given hashes.
+ * @brief Hash<T, Policy>::Hash Class private constructor. Builds a hash as the
+ *                              combination of two given hashes.
  * @param x First given hash.
  * @param y Second given hash.
  */
-template<typename T>
-Hash<T>::Hash(const Hash<T>& x, const Hash<T>& y)
+template<typename T, typename Policy>
+Hash<T, Policy>::Hash(const Hash<T, Policy>& x, const Hash<T, Policy>& y) : set(true)
 {
-    std::vector<unsigned char> xy;
-    xy.reserve(64);
-    xy.insert(xy.end(), x.h.begin(), x.h.end());
-    xy.insert(xy.end(), y.h.begin(), y.h.end());
-
-    h = std::vector<unsigned char>(32);
-    picosha2::hash256(xy, h);
+    typename Policy::Stream stream;
+    stream.update(x.h, Policy::digestSize);
+    stream.update(y.h, Policy::digestSize);
+    stream.finalize(h);
 }
 
 /**
- * @brief Hash<T>::~Hash Class destructor.
+ * @brief Hash<T, Policy>::~Hash Class destructor.
  */
-template<typename T>
-Hash<T>::~Hash()
+template<typename T, typename Policy>
+Hash<T, Policy>::~Hash()
 {
 }
 
 /**
- * @brief Hash<T>::setHash Assign hash (in byte form). Should be
- *                         rarely used (use constructors instead).
+ * @brief Hash<T, Policy>::setHash Assign hash (in byte form). Should be
+ *                                 rarely used (use constructors instead).
  * @param x STL vector of unsigned char representing the hash in byte form.
  */
-template<typename T>
-void Hash<T>::setHash(const std::vector<unsigned char>& x)
+template<typename T, typename Policy>
+void Hash<T, Policy>::setHash(const std::vector<unsigned char>& x)
 {
-    if (x.size() != 32)
+    if (x.size() != Policy::digestSize)
         throw std::runtime_error("Runtime Error: Invalid Hash!");
 
-    h = x;
+    std::copy(x.begin(), x.end(), h);
+    set = true;
 }
 
 /**
- * @brief Hash<T>::returnHash Return hash to user (in byte form).
+ * @brief Hash<T, Policy>::setHash Assign hash (in byte form). Should be
+ *                                 rarely used (use constructors instead).
+ * @param x     Unsigned char array representing the hash in byte form.
+ * @param size  Number of bytes in x. Must be size().
+ */
+template<typename T, typename Policy>
+void Hash<T, Policy>::setHash(const unsigned char* x, size_t size)
+{
+    if (size != Policy::digestSize)
+        throw std::runtime_error("Runtime Error: Invalid Hash!");
+
+    std::memcpy(h, x, Policy::digestSize);
+    set = true;
+}
+
+/**
+ * @brief Hash<T, Policy>::returnHash Return hash to user (in byte form).
  * @return  STL vector of unsigned char representing the hash in byte form.
  *          If the hash is empty it throws a std::runtime_error exception.
  */
-template<typename T>
-std::vector<unsigned char> Hash<T>::returnHash()
+template<typename T, typename Policy>
+std::vector<unsigned char> Hash<T, Policy>::returnHash()
 {
-    if (h.size() != 32)
+    if (!set)
         throw std::runtime_error("Runtime Error: Invalid Hash!");
 
+    return std::vector<unsigned char>(h, h+Policy::digestSize);
+}
+
+/**
+ * @brief Hash<T, Policy>::size Return the number of bytes of a digest.
+ * @return  Digest size of the policy (32 for SHA-256).
+ */
+template<typename T, typename Policy>
+size_t Hash<T, Policy>::size()
+{
+    return Policy::digestSize;
+}
+
+/**
+ * @brief Hash<T, Policy>::data Return the raw hash bytes without copying them.
+ * @return  Pointer to the size() bytes of the hash (all zeros if the hash is empty).
+ */
+template<typename T, typename Policy>
+const unsigned char* Hash<T, Policy>::data() const
+{
     return h;
 }
 
 /**
- * @brief Hash<T>::returnHashString Return hash in hex string form.
+ * @brief Hash<T, Policy>::returnHashString Return hash in hex string form.
  * @return Standar string representing the hash in hex form. If the
  *         hash is empty it throws a std::runtime_error exception.
  */
-template<typename T>
-std::string Hash<T>::returnHashString()
+template<typename T, typename Policy>
+std::string Hash<T, Policy>::returnHashString()
 {
-    if (h.size() != 32)
+    if (!set)
         throw std::runtime_error("Runtime Error: Invalid/Empty Hash!");
 
-    return picosha2::bytes_to_hex_string(h);
+    std::string hex(2 * Policy::digestSize, '0');
+    encodeHex(h, Policy::digestSize, &hex[0]);
+
+    return hex;
 }
 
 /**
- * @brief Hash<T>::isEmpty Tells us whether hash has been set or only the default (empty).
+ * @brief Hash<T, Policy>::toHex Write hash in (lowercase) hex form to a buffer,
+ *                               without allocating.
+ * @param out   Output buffer (at least 2 * size() chars; no terminator is added).
+ * @return      Number of chars written. If the hash is empty it throws a
+ *              std::runtime_error exception.
+ */
+template<typename T, typename Policy>
+size_t Hash<T, Policy>::toHex(char* out) const
+{
+    if (!set)
+        throw std::runtime_error("Runtime Error: Invalid/Empty Hash!");
+
+    encodeHex(h, Policy::digestSize, out);
+
+    return 2 * Policy::digestSize;
+}
+
+/**
+ * @brief Hash<T, Policy>::fromHex Assign hash from its hex form (e.g. an info-hash
+ *                                 in a resume file), without allocating.
+ * @param hex   Hex digits (either case).
+ * @param size  Number of chars in hex. Must be 2 * size().
+ * @return      True if assigned. False (the hash is left as is) if the size is
+ *              wrong or some char is not a hex digit.
+ */
+template<typename T, typename Policy>
+bool Hash<T, Policy>::fromHex(const char* hex, size_t size)
+{
+    unsigned char parsed[Policy::digestSize];
+    if (size != 2 * Policy::digestSize || !decodeHex(hex, Policy::digestSize, parsed))
+        return false;
+
+    std::memcpy(h, parsed, Policy::digestSize);
+    set = true;
+
+    return true;
+}
+
+/**
+ * @brief Hash<T, Policy>::isEmpty Tells us whether hash has been set or only the default (empty).
  * @return  True if hash is an empty default hash. False otherwise.
  */
-template<typename T>
-bool Hash<T>::isEmpty() const
+template<typename T, typename Policy>
+bool Hash<T, Policy>::isEmpty() const
 {
-    return (h.size() != 32);
+    return !set;
 }
 
 /**
@@ -128,84 +531,174 @@ bool Hash<T>::isEmpty() const
  * @param x First hash.
  * @param y Second hash.
  */
-template<typename T>
-void Hash<T>::swap(Hash<T>& x, Hash<T>& y)
+template<typename T, typename Policy>
+void Hash<T, Policy>::swap(Hash<T, Policy>& x, Hash<T, Policy>& y)
 {
-    std::swap(x.h, y.h);
+    std::swap_ranges(x.h, x.h+Policy::digestSize, y.h);
+    std::swap(x.set, y.set);
 }
 
 /**
- * @brief Hash<T>::operator = Class assignment operator. Set hash to be a
- *                            copy of the other given hash.
+ * @brief Hash<T, Policy>::operator = Class assignment operator. Set hash to be a
+ *                                    copy of the other given hash.
  * @param rhs   Right hand side operand. The copied hash.
  * @return      Reference to the copy hash (this).
  */
-template<typename T>
-Hash<T>& Hash<T>::operator=(Hash<T> rhs)
+template<typename T, typename Policy>
+Hash<T, Policy>& Hash<T, Policy>::operator=(Hash<T, Policy> rhs)
 {
     if (this != &rhs)
-        h = rhs.h;
+    {
+        std::memcpy(h, rhs.h, Policy::digestSize);
+        set = rhs.set;
+    }
 
     return *this;
 }
 
 /**
- * @brief Hash<T>::operator == Class comparison operator (lhs == rhs).
+ * @brief Hash<T, Policy>::operator == Class comparison operator (lhs == rhs).
  * @param rhs   The right hand side hash.
  * @return      True if the two hashes are equals. False otherwise.
  */
-template<typename T>
-bool Hash<T>::operator==(const Hash<T>& rhs) const
+template<typename T, typename Policy>
+bool Hash<T, Policy>::operator==(const Hash<T, Policy>& rhs) const
 {
-    return (h == rhs.h);
+    if (set != rhs.set)
+        return false;
+
+    return !set || (std::memcmp(h, rhs.h, Policy::digestSize) == 0);
 }
 
 /**
- * @brief Hash<T>::operator != Class comparison operator (lhs != rhs).
+ * @brief Hash<T, Policy>::operator != Class comparison operator (lhs != rhs).
  * @param rhs   The right hand side hash.
  * @return      True if the two hashes are different. False otherwise.
  */
-template<typename T>
-bool Hash<T>::operator!=(const Hash<T>& rhs) const
+template<typename T, typename Policy>
+bool Hash<T, Policy>::operator!=(const Hash<T, Policy>& rhs) const
 {
-    return (h != rhs.h);
+    return !(*this == rhs);
 }
 
 /**
- * @brief Hash<T>::operator + Class addition operator: result = hash(lhs||rhs),
- *                            where || means the concatenation of the two hashes.
+ * @brief Hash<T, Policy>::operator + Class addition operator: result = hash(lhs||rhs),
+ *                                    where || means the concatenation of the two hashes.
  * @param rhs   The right hand side hash.
  * @return      Hash of the concatenation of the left and right side hashes.
  *              Throws a std::runtime_error if any of two hashes is an empty hash.
  */
-template<typename T>
-Hash<T> Hash<T>::operator+(const Hash<T>& rhs) const
+template<typename T, typename Policy>
+Hash<T, Policy> Hash<T, Policy>::operator+(const Hash<T, Policy>& rhs) const
 {
-    if ((h.size() != 32) || (rhs.h.size() != 32))
+    if (!set || !rhs.set)
         throw std::runtime_error("Runtime Error: Invalid Hash Operand!");
 
-    std::vector<unsigned char> cat;
-    cat.reserve(64);
-    cat.insert(cat.end(), h.begin(), h.end());
-    cat.insert(cat.end(), rhs.h.begin(), rhs.h.end());
+    return Hash<T, Policy>(*this, rhs);
+}
+
+/**
+ * @brief Hash<T, Policy>::combine Hash of the concatenation of n hashes: result =
+ *                                 hash(hashes[0]||...||hashes[n-1]). For n == 2 it is
+ *                                 the same as hashes[0] + hashes[1].
+ * @param hashes    Array of hashes to combine (in order).
+ * @param n         Number of hashes in the array.
+ * @return          Hash of the concatenation. Throws a std::runtime_error if
+ *                  any of the hashes is an empty hash.
+ */
+template<typename T, typename Policy>
+Hash<T, Policy> Hash<T, Policy>::combine(const Hash<T, Policy> hashes[], size_t n)
+{
+    typename Policy::Stream stream;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!hashes[i].set)
+            throw std::runtime_error("Runtime Error: Invalid Hash Operand!");
 
-    std::vector<unsigned char> sum(32);
-    picosha2::hash256(cat, sum);
+        stream.update(hashes[i].h, Policy::digestSize);
+    }
 
-    Hash<T> hash;
-    hash.setHash(sum);
+    Hash<T, Policy> hash;
+    stream.finalize(hash.h);
+    hash.set = true;
 
     return hash;
 }
 
+/**
+ * @brief Hash<T, Policy>::zeroBlock Hash of a sequence of zero bytes. Block sizes (powers
+ *                                   of two from 1 KiB to 16 MiB) are hashed once, from
+ *                                   any thread, into a fixed table; other sizes are
+ *                                   hashed on every call.
+ * @param size  Number of zero bytes.
+ * @return      Hash of size zero bytes.
+ */
+template<typename T, typename Policy>
+Hash<T, Policy> Hash<T, Policy>::zeroBlock(size_t size)
+{
+    static std::once_flag filled[MAX_ZERO_BLOCK_LOG - MIN_ZERO_BLOCK_LOG + 1];
+    static Hash<T, Policy> cache[MAX_ZERO_BLOCK_LOG - MIN_ZERO_BLOCK_LOG + 1];
+
+    int slot = zeroBlockSlot(size);
+    if (slot < 0)
+    {
+        typename Policy::Stream stream;
+        feedZeros(stream, size);
+        return Hash<T, Policy>(stream);
+    }
+
+    std::call_once(filled[slot], [&]() {
+        typename Policy::Stream stream;
+        feedZeros(stream, size);
+        cache[slot] = Hash<T, Policy>(stream);
+    });
+
+    return cache[slot];
+}
+
+/**
+ * @brief Hash<T, Policy>::fromZeroBlock Take the cached zero block hash if the concatenation
+ *                                       of the segments is an all-zero block of a cached block
+ *                                       size (the size is checked first, so other blocks are
+ *                                       not scanned).
+ * @param segments  Array of segments (pointer and size), in order.
+ * @param n         Number of segments in the array.
+ * @return          True if the hash was set to the zero block hash. False otherwise (hash
+ *                  left as is).
+ */
+template <typename T, typename Policy>
+bool Hash<T, Policy>::fromZeroBlock(const HashSegment segments[], size_t n)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < n; ++i)
+        size += segments[i].size;
+
+    if (zeroBlockSlot(size) < 0)
+        return false;
+
+    for (size_t i = 0; i < n; ++i)
+        if (!isZeroBlock(segments[i].data, segments[i].size))
+            return false;
+
+    std::memcpy(h, zeroBlock(size).h, Policy::digestSize);
+    return true;
+}
+
 /**
  * @brief operator << Overload ostream operator.
  * @param os    Output std::ostream.
  * @param x     Hash sets to the output stream.
  * @return      Output stream.
  */
-template<typename U>
-std::ostream& operator<<(std::ostream& os, const Hash<U>& x)
+template<typename U, typename P>
+std::ostream& operator<<(std::ostream& os, const Hash<U, P>& x)
 {
-    return (os << picosha2::bytes_to_hex_string(x.h));
+    if (x.set)
+    {
+        char hex[2 * P::digestSize];
+        os.write(hex, x.toHex(hex));
+    }
+
+    return os;
 }
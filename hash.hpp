@@ -3,10 +3,21 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "picosha2.h"
+#include "hash_policy.hpp"
 
-template <typename T>
+// one buffer of a scatter/gather list (like a struct iovec): data is hashed as the concatenation of
+// the segments, in order
+struct HashSegment
+{
+  const unsigned char* data;
+  size_t size;
+};
+
+// Policy is the digest algorithm (see hash_policy.hpp)
+template <typename T, typename Policy = Sha256Policy>
 class Hash
 {
 public:
@@ -18,50 +29,87 @@ public:
   
   // Constructor: hash from any STL sequential container
   Hash(const T& data);
+
+  // Constructor: hash of the bytes fed so far to a stream (chunked input)
+  explicit Hash(const typename Policy::Stream& stream);
+
+  // Constructor: hash of the concatenation of n segments (no copy into a temporary buffer)
+  Hash(const HashSegment segments[], size_t n);
   
   // Destructor
   ~Hash();
 
   // copy constructor
-  Hash(const Hash<T> & x);
+  Hash(const Hash<T, Policy> & x);
   
   // copy assignment
-  Hash<T>& operator=(Hash <T> x);
+  Hash<T, Policy>& operator=(Hash<T, Policy> x);
 
   //for copy-swap idiom
-  void swap(Hash<T>& x, Hash<T>& y);
+  void swap(Hash<T, Policy>& x, Hash<T, Policy>& y);
 
   //overload ostream operator
-  template <typename U>
-  friend std::ostream& operator<<(std::ostream& os,const Hash<U>& list);
+  template <typename U, typename P>
+  friend std::ostream& operator<<(std::ostream& os,const Hash<U, P>& list);
 
   //comparison == (lhs == rhs)
-  bool operator==(const Hash<T> & rhs) const;
+  bool operator==(const Hash<T, Policy> & rhs) const;
 
   //comparison != (lhs != rhs)
-  bool operator!=(const Hash<T> & rhs) const;
+  bool operator!=(const Hash<T, Policy> & rhs) const;
 
   //addition operator: result = hash(lhs + rhs)
-  Hash<T> operator+(const Hash<T> & rhs) const;
+  Hash<T, Policy> operator+(const Hash<T, Policy> & rhs) const;
+
+  //combine n hashes into one: result = hash(hashes[0] + ... + hashes[n-1])
+  static Hash<T, Policy> combine(const Hash<T, Policy> hashes[], size_t n);
+
+  //hash of size zero bytes (block sizes, powers of two from 1 KiB to 16 MiB, are computed once and
+  //cached): blocks of those sizes found to be all zeros (e.g. in sparse files) take it instead of
+  //being hashed
+  static Hash<T, Policy> zeroBlock(size_t size);
 
   // assign hash (in byte form): should be rarely used (use constructors instead)
   void setHash(const std::vector<unsigned char>& x);
+
+  // same as above but hash is in array form (size is the number of bytes in x)
+  void setHash(const unsigned char* x, size_t size);
   
   //return hash to user (in byte form)
   std::vector<unsigned char> returnHash();
 
+  //number of bytes of a digest (32 for SHA-256)
+  static size_t size();
+
+  //raw hash bytes (size() bytes, all zeros for an empty hash): no copy, e.g. to serialize
+  const unsigned char* data() const;
+
   //return has to user (in hex string form)
   std::string returnHashString();
 
+  //write the hash in (lowercase) hex form to out (2 * size() chars, no terminator); return number of chars
+  //return runtime_error if the hash is empty
+  size_t toHex(char* out) const;
+
+  //parse a hash from hex form (2 * size() chars, either case); return false (hash left as is) if not valid
+  bool fromHex(const char* hex, size_t size);
+
   // tells us whether hash has been set or only the default (all zeros)
   bool isEmpty() const;
   
 private:
   // Private Constructor: used to take two Hashes and combine into one
-  Hash(const Hash<T> & x, const Hash<T> & y);
+  Hash(const Hash<T, Policy> & x, const Hash<T, Policy> & y);
+
+  // take the cached zero block hash if the concatenation of n segments is an all-zero block of a
+  // cached size; return false (hash left as is) otherwise
+  bool fromZeroBlock(const HashSegment segments[], size_t n);
   
-  // our hash: SHA256 is 32 bytes (unsigned chars) in length
-  std::vector<unsigned char> h;
+  // our hash: Policy::digestSize bytes (unsigned chars) in length (32 for SHA256)
+  // (stored inline so that arrays of hashes need no per-digest allocation)
+  unsigned char h[Policy::digestSize];
+  // false for the default (empty) hash
+  bool set;
 };
 
 #include "hash.cpp"
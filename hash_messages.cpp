@@ -0,0 +1,285 @@
+#include "hash_messages.hpp"
+#include <cstring>
+
+//////////////
+inline size_t log2Pow2(size_t x)
+{
+    size_t l = 0;
+    while ((1UL << l) < x)
+        ++l;
+
+    return l;
+}
+
+/**
+ * @brief encodeHashHeader Write the common part of the hash messages: length
+ *                         prefix, message ID, pieces root and request fields.
+ * @param p         Output buffer (at least HASH_REQUEST_SIZE bytes).
+ * @param id        Message ID.
+ * @param req       Request fields.
+ * @param numHashes Number of hashes that follow the header.
+ */
+inline void encodeHashHeader(unsigned char* p, HashMessageId id, const HashRequest& req, size_t numHashes)
+{
+    putUint32(p, (uint32_t)(HASH_REQUEST_SIZE - 4 + 32 * numHashes));
+    p[4] = (unsigned char)id;
+    std::memcpy(p + 5, req.piecesRoot, 32);
+    putUint32(p + 37, req.baseLayer);
+    putUint32(p + 41, req.index);
+    putUint32(p + 45, req.length);
+    putUint32(p + 49, req.proofLayers);
+}
+//////////////
+
+/**
+ * @brief validHashRequest Tell whether a request is well formed (BEP 52): length
+ *                         is a power of two between 2 and 512, index is a
+ *                         multiple of length and the requested hashes exist.
+ * @param req   Request.
+ * @param depth Depth of the (binary) tree the request is for.
+ * @return      True if the request is valid. False otherwise.
+ */
+inline bool validHashRequest(const HashRequest& req, size_t depth)
+{
+    if (req.length < 2 || req.length > 512 || (req.length & (req.length - 1)))
+        return false;
+
+    if (req.index % req.length)
+        return false;
+
+    size_t subtreeHeight = req.baseLayer + log2Pow2(req.length);
+    if (req.baseLayer > depth || subtreeHeight > depth)
+        return false;
+
+    //in 64 bits (no wrap); a layer of 2^32 nodes or more holds any 32-bit range
+    size_t layerLog = depth - req.baseLayer;
+    uint64_t end = (uint64_t)req.index + req.length;
+
+    return layerLog >= 32 || end <= (uint64_t(1) << layerLog);
+}
+
+/**
+ * @brief numUncleHashes Number of uncle hashes in the answer to a request: one for
+ *                       every proof layer above the subtree spanned by the
+ *                       requested hashes, up until (and excluding) the root.
+ * @param req   Request (must be valid).
+ * @param depth Depth of the (binary) tree the request is for.
+ * @return      Number of uncle hashes.
+ */
+inline size_t numUncleHashes(const HashRequest& req, size_t depth)
+{
+    size_t inner = log2Pow2(req.length);
+    size_t wanted = (req.proofLayers > inner) ? req.proofLayers - inner : 0;
+    size_t above = depth - (req.baseLayer + inner);
+
+    return (wanted < above) ? wanted : above;
+}
+
+/**
+ * @brief encodeHashRequest Append an encoded hash request message to a buffer.
+ * @param req   Request.
+ * @param out   Output buffer.
+ * @return      Number of bytes appended.
+ */
+inline size_t encodeHashRequest(const HashRequest& req, std::vector<unsigned char>& out)
+{
+    size_t start = out.size();
+    out.resize(start + HASH_REQUEST_SIZE);
+    encodeHashHeader(&out[start], HASH_REQUEST, req, 0);
+
+    return HASH_REQUEST_SIZE;
+}
+
+/**
+ * @brief encodeHashReject Append an encoded hash reject message to a buffer.
+ * @param req   Rejected request.
+ * @param out   Output buffer.
+ * @return      Number of bytes appended.
+ */
+inline size_t encodeHashReject(const HashRequest& req, std::vector<unsigned char>& out)
+{
+    size_t start = out.size();
+    out.resize(start + HASH_REQUEST_SIZE);
+    encodeHashHeader(&out[start], HASH_REJECT, req, 0);
+
+    return HASH_REQUEST_SIZE;
+}
+
+/**
+ * @brief encodeHashes Append the hashes message that answers a request to a buffer.
+ *                     The requested hashes and their uncle hashes are copied
+ *                     straight from the tree storage into the buffer.
+ * @param tree  Binary Merkle tree the request is for (SHA-256 policy).
+ * @param req   Request.
+ * @param out   Output buffer.
+ * @return      Number of bytes appended. Zero (nothing appended) if the request
+ *              is not valid or some hash is not known by the tree.
+ */
+template<typename T, typename Alloc, typename Policy>
+size_t encodeHashes(const MerkleTree<T, 2, Alloc, Policy>& tree, const HashRequest& req, std::vector<unsigned char>& out)
+{
+    static_assert(Policy::digestSize == 32, "BEP 52 hash messages carry SHA-256 digests");
+
+    size_t depth = tree.depth();
+    if (!validHashRequest(req, depth))
+        return 0;
+
+    size_t numUncles = numUncleHashes(req, depth);
+    size_t subtreeHeight = req.baseLayer + log2Pow2(req.length);
+    size_t subtreePos = req.index / req.length;
+
+    //check every hash is known before writing anything
+    for (size_t i = 0; i < req.length; ++i)
+        if (tree.getNode(req.baseLayer, req.index + i).isEmpty())
+            return 0;
+
+    for (size_t u = 0; u < numUncles; ++u)
+        if (tree.getNode(subtreeHeight + u, (subtreePos >> u) ^ 1).isEmpty())
+            return 0;
+
+    size_t start = out.size();
+    size_t bytes = HASH_REQUEST_SIZE + 32 * (req.length + numUncles);
+    out.resize(start + bytes);
+
+    unsigned char* p = &out[start];
+    encodeHashHeader(p, HASHES, req, req.length + numUncles);
+    p += HASH_REQUEST_SIZE;
+
+    for (size_t i = 0; i < req.length; ++i, p += 32)
+        std::memcpy(p, tree.getNode(req.baseLayer, req.index + i).data(), 32);
+
+    for (size_t u = 0; u < numUncles; ++u, p += 32)
+        std::memcpy(p, tree.getNode(subtreeHeight + u, (subtreePos >> u) ^ 1).data(), 32);
+
+    return bytes;
+}
+
+/**
+ * @brief decodeHashMessage Decode the hash request, hashes or hash reject message
+ *                          at the beginning of a buffer.
+ * @param buf       Input buffer.
+ * @param size      Number of bytes in buf.
+ * @param msg       Decoded message.
+ * @param consumed  Number of bytes of the message (length prefix included).
+ * @return          True if buf starts with a complete and well formed hash
+ *                  message. False otherwise (incomplete, other message ID or
+ *                  bad length).
+ */
+template<typename T, typename Policy>
+bool decodeHashMessage(const unsigned char* buf, size_t size, HashMessage<T, Policy>& msg, size_t& consumed)
+{
+    if (size < HASH_REQUEST_SIZE)
+        return false;
+
+    size_t len = getUint32(buf);
+    if (len < HASH_REQUEST_SIZE - 4 || size - 4 < len)
+        return false;
+
+    unsigned char id = buf[4];
+    size_t payload = len - (HASH_REQUEST_SIZE - 4);
+
+    if (id == HASH_REQUEST || id == HASH_REJECT)
+    {
+        if (payload != 0)
+            return false;
+    }
+    else if (id != HASHES || (payload % 32))
+        return false;
+
+    msg.id = (HashMessageId)id;
+    std::memcpy(msg.request.piecesRoot, buf + 5, 32);
+    msg.request.baseLayer = getUint32(buf + 37);
+    msg.request.index = getUint32(buf + 41);
+    msg.request.length = getUint32(buf + 45);
+    msg.request.proofLayers = getUint32(buf + 49);
+
+    msg.hashes.resize(payload / 32);
+    for (size_t i = 0; i < msg.hashes.size(); ++i)
+        msg.hashes[i].setHash(buf + HASH_REQUEST_SIZE + 32 * i, 32);
+
+    consumed = 4 + len;
+
+    return true;
+}
+
+/**
+ * @brief HashRequestQueue::add Queue a hash request. A request whose hashes and
+ *                              proof layers are all covered by a queued request
+ *                              is dropped; queued requests covered by the new one
+ *                              are dropped instead.
+ * @param req   Request.
+ * @return      True if the request is queued. False if it was already covered.
+ */
+inline bool HashRequestQueue::add(const HashRequest& req)
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        const HashRequest& q = pending[i];
+        bool sameLayer = (q.baseLayer == req.baseLayer) && !std::memcmp(q.piecesRoot, req.piecesRoot, 32);
+        bool overlap = sameLayer && (q.index < req.index + req.length) && (req.index < q.index + q.length);
+
+        //aligned power of two ranges that overlap are nested
+        if (overlap && q.length >= req.length && q.proofLayers >= req.proofLayers)
+            return false;
+
+        if (!(overlap && req.length >= q.length && req.proofLayers >= q.proofLayers))
+            pending[kept++] = q;
+    }
+
+    pending.resize(kept);
+    pending.push_back(req);
+
+    return true;
+}
+
+/**
+ * @brief HashRequestQueue::size Return the number of queued requests.
+ * @return  Number of requests.
+ */
+inline size_t HashRequestQueue::size() const
+{
+    return pending.size();
+}
+
+/**
+ * @brief HashRequestQueue::take Take every queued request leaving the queue empty.
+ * @return  Queued requests, in order.
+ */
+inline std::vector<HashRequest> HashRequestQueue::take()
+{
+    std::vector<HashRequest> requests;
+    requests.swap(pending);
+
+    return requests;
+}
+
+/**
+ * @brief serveHashRequests Answer every request queued for a peer, appending a
+ *                          hashes message (or a hash reject message if the tree
+ *                          is unknown or can not answer) for each one.
+ * @param queue     Requests of the peer (left empty).
+ * @param lookup    Callable: lookup(piecesRoot) returns a pointer to the binary
+ *                  MerkleTree with that root, or null if unknown.
+ * @param out       Output buffer.
+ * @return          Number of hashes messages appended.
+ */
+template<typename Lookup>
+size_t serveHashRequests(HashRequestQueue& queue, Lookup lookup, std::vector<unsigned char>& out)
+{
+    std::vector<HashRequest> requests = queue.take();
+    size_t answered = 0;
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        auto tree = lookup(requests[i].piecesRoot);
+
+        if (tree && encodeHashes(*tree, requests[i], out))
+            ++answered;
+        else
+            encodeHashReject(requests[i], out);
+    }
+
+    return answered;
+}
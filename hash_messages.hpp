@@ -0,0 +1,92 @@
+#ifndef _HASH_MESSAGES_H_
+#define _HASH_MESSAGES_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "byte_order.hpp"
+#include "hash.hpp"
+#include "merkle_tree.hpp"
+
+// peer wire message IDs of the BEP 52 hash messages
+enum HashMessageId
+{
+  HASH_REQUEST = 21,
+  HASHES = 22,
+  HASH_REJECT = 23
+};
+
+// hashes of the tree whose root is piecesRoot wanted by a peer
+struct HashRequest
+{
+  unsigned char piecesRoot[32];
+  uint32_t baseLayer; // height of the requested hashes (0 is the leaf layer)
+  uint32_t index; // position of the first requested hash in its layer (multiple of length)
+  uint32_t length; // number of requested hashes (power of two, 2 to 512)
+  uint32_t proofLayers; // number of layers from baseLayer up for which uncle hashes are wanted
+};
+
+// decoded hash request, hashes or hash reject message
+// hashes on the wire are SHA-256 digests: Policy must be a SHA-256 policy (e.g. Sha256Policy, OpenSslSha256Policy)
+template <typename T, typename Policy = Sha256Policy>
+struct HashMessage
+{
+  static_assert(Policy::digestSize == 32, "BEP 52 hash messages carry SHA-256 digests");
+
+  HashMessageId id;
+  HashRequest request;
+  // hashes message only: the requested hashes followed by the uncle hashes (from the bottom up)
+  std::vector<Hash<T, Policy> > hashes;
+};
+
+// size of an encoded hash request or hash reject message (length prefix included)
+const size_t HASH_REQUEST_SIZE = 4 + 1 + 48;
+
+// whether a request is well formed for a binary tree of the given depth (see BEP 52)
+bool validHashRequest(const HashRequest& req, size_t depth);
+
+// number of uncle hashes that answer a request for a binary tree of the given depth
+size_t numUncleHashes(const HashRequest& req, size_t depth);
+
+// append an encoded hash request message to out; return number of bytes appended
+size_t encodeHashRequest(const HashRequest& req, std::vector<unsigned char>& out);
+
+// append an encoded hash reject message to out; return number of bytes appended
+size_t encodeHashReject(const HashRequest& req, std::vector<unsigned char>& out);
+
+// append the hashes message answering req, copied straight from the tree storage, to out
+// return number of bytes appended (0 if the request is invalid or the tree does not know every hash)
+template <typename T, typename Alloc, typename Policy>
+size_t encodeHashes(const MerkleTree<T, 2, Alloc, Policy>& tree, const HashRequest& req, std::vector<unsigned char>& out);
+
+// decode the hash message at the beginning of buf (size bytes); consumed is the size of the message
+// return false if buf does not start with a complete and well formed hash message
+template <typename T, typename Policy>
+bool decodeHashMessage(const unsigned char* buf, size_t size, HashMessage<T, Policy>& msg, size_t& consumed);
+
+// hash requests received from one peer and not answered yet; overlapping requests are coalesced
+class HashRequestQueue
+{
+public:
+  // queue a request; return false if it is already covered by a queued request
+  // (queued requests covered by the new one are dropped)
+  bool add(const HashRequest& req);
+
+  // number of queued requests
+  size_t size() const;
+
+  // take every queued request (in order) leaving the queue empty
+  std::vector<HashRequest> take();
+
+private:
+  std::vector<HashRequest> pending;
+};
+
+// answer every request of a peer's queue, appending hashes (or hash reject) messages to out
+// lookup(piecesRoot) returns a pointer to the binary MerkleTree with that root, or null if unknown
+// return number of hashes messages (rejects not included)
+template <typename Lookup>
+size_t serveHashRequests(HashRequestQueue& queue, Lookup lookup, std::vector<unsigned char>& out);
+
+#include "hash_messages.cpp"
+#endif  //_HASH_MESSAGES_H_
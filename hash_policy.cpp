@@ -0,0 +1,105 @@
+#include "hash_policy.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef HASH_USE_OPENSSL
+/**
+ * @brief OpenSslSha256Stream::OpenSslSha256Stream Class constructor. Starts the
+ *                                                 hash of an empty message.
+ */
+inline OpenSslSha256Stream::OpenSslSha256Stream() : ctx(EVP_MD_CTX_new()), bytes(0)
+{
+    if (!ctx || !EVP_DigestInit_ex(ctx, EVP_sha256(), NULL))
+    {
+        EVP_MD_CTX_free(ctx);
+        throw std::runtime_error("Runtime Error: Crypto Library Failure!");
+    }
+}
+
+/**
+ * @brief OpenSslSha256Stream::OpenSslSha256Stream Class copy constructor. Copies
+ *                                                 the state of another stream.
+ * @param x The other stream.
+ */
+inline OpenSslSha256Stream::OpenSslSha256Stream(const OpenSslSha256Stream& x)
+    : ctx(EVP_MD_CTX_new()), bytes(x.bytes)
+{
+    if (!ctx || !EVP_MD_CTX_copy_ex(ctx, x.ctx))
+    {
+        EVP_MD_CTX_free(ctx);
+        throw std::runtime_error("Runtime Error: Crypto Library Failure!");
+    }
+}
+
+/**
+ * @brief OpenSslSha256Stream::operator = Class assignment operator (copy-swap).
+ * @param x The copied stream.
+ * @return  Reference to this stream.
+ */
+inline OpenSslSha256Stream& OpenSslSha256Stream::operator=(OpenSslSha256Stream x)
+{
+    std::swap(ctx, x.ctx);
+    std::swap(bytes, x.bytes);
+
+    return *this;
+}
+
+/**
+ * @brief OpenSslSha256Stream::~OpenSslSha256Stream Class destructor.
+ */
+inline OpenSslSha256Stream::~OpenSslSha256Stream()
+{
+    EVP_MD_CTX_free(ctx);
+}
+
+/**
+ * @brief OpenSslSha256Stream::reset Start over with an empty message.
+ */
+inline void OpenSslSha256Stream::reset()
+{
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    bytes = 0;
+}
+
+/**
+ * @brief OpenSslSha256Stream::update Feed the next bytes of the message.
+ * @param data  Next bytes of the message.
+ * @param size  Number of bytes in data.
+ */
+inline void OpenSslSha256Stream::update(const unsigned char* data, size_t size)
+{
+    EVP_DigestUpdate(ctx, data, size);
+    bytes += size;
+}
+
+/**
+ * @brief OpenSslSha256Stream::digest Digest of the bytes fed so far, finalized on a
+ *                                    copy of the context so the stream can go on.
+ * @param out   Output buffer (32 bytes).
+ */
+inline void OpenSslSha256Stream::digest(unsigned char* out) const
+{
+    OpenSslSha256Stream last(*this);
+    EVP_DigestFinal_ex(last.ctx, out, NULL);
+}
+
+/**
+ * @brief OpenSslSha256Stream::finalize Digest of the bytes fed so far, finalized on the
+ *                                      context itself (no copy): the stream must be
+ *                                      reset before more bytes are fed.
+ * @param out   Output buffer (32 bytes).
+ */
+inline void OpenSslSha256Stream::finalize(unsigned char* out)
+{
+    EVP_DigestFinal_ex(ctx, out, NULL);
+}
+
+/**
+ * @brief OpenSslSha256Stream::length Return the number of bytes fed so far.
+ * @return  Length of the message so far.
+ */
+inline uint64_t OpenSslSha256Stream::length() const
+{
+    return bytes;
+}
+#endif
@@ -0,0 +1,78 @@
+#ifndef _HASH_POLICY_H_
+#define _HASH_POLICY_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#include "sha1_stream.hpp"
+#include "sha256_stream.hpp"
+
+#ifdef HASH_USE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+// Digest algorithms for Hash<T, Policy> and MerkleTree<T, K, Alloc, Policy>: a policy gives the digest
+// size in bytes (digestSize) and a streaming hasher (Stream) with update(data, size), digest(out) const
+// (that leaves the stream as is), finalize(out) (one-shot: the stream must be reset before reuse) and length()
+
+// SHA-256 (portable, default: BitTorrent v2 Merkle trees)
+struct Sha256Policy
+{
+  static const size_t digestSize = 32;
+  typedef Sha256Stream Stream;
+};
+
+// SHA-1 (e.g. internal deduplication indexes, where a smaller digest is enough)
+struct Sha1Policy
+{
+  static const size_t digestSize = SHA1_DIGEST_SIZE;
+  typedef Sha1Stream Stream;
+};
+
+#ifdef HASH_USE_OPENSSL
+// streaming SHA-256 of the system crypto library (OpenSSL libcrypto), using its optimized code paths
+class OpenSslSha256Stream
+{
+public:
+  // Constructor: hash of the empty message
+  OpenSslSha256Stream();
+
+  // copy constructor
+  OpenSslSha256Stream(const OpenSslSha256Stream& x);
+
+  // copy assignment
+  OpenSslSha256Stream& operator=(OpenSslSha256Stream x);
+
+  // Destructor
+  ~OpenSslSha256Stream();
+
+  // start over (hash of the empty message)
+  void reset();
+
+  // feed the next size bytes of the message
+  void update(const unsigned char* data, size_t size);
+
+  // digest (32 bytes) of the bytes fed so far; the stream is left as is
+  void digest(unsigned char* out) const;
+
+  // same as digest, for one-shot use (no context copy): the stream must be reset before more bytes are fed
+  void finalize(unsigned char* out);
+
+  // number of bytes fed so far
+  uint64_t length() const;
+
+private:
+  EVP_MD_CTX* ctx;
+  uint64_t bytes;
+};
+
+// SHA-256 computed by the system crypto library (same digests as Sha256Policy)
+struct OpenSslSha256Policy
+{
+  static const size_t digestSize = 32;
+  typedef OpenSslSha256Stream Stream;
+};
+#endif
+
+#include "hash_policy.cpp"
+#endif  //_HASH_POLICY_H_
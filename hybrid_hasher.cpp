@@ -0,0 +1,114 @@
+#include "hybrid_hasher.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @brief HybridHasher<T>::HybridHasher Class constructor. Starts the hashes of the
+ *                                      first file.
+ * @param pieceSize Size of the v1 pieces in bytes.
+ * @param blockSize Size of the v2 blocks (Merkle leaves) in bytes. Throws a
+ *                  std::runtime_error if pieceSize is not a non-zero multiple
+ *                  of blockSize.
+ */
+template<typename T>
+HybridHasher<T>::HybridHasher(size_t pieceSize, size_t blockSize)
+    : pieceSize(pieceSize), blockSize(blockSize)
+{
+    if (blockSize == 0 || pieceSize == 0 || pieceSize % blockSize)
+        throw std::runtime_error("Range Error: Invalid Piece Size!");
+}
+
+/**
+ * @brief HybridHasher<T>::update Feed the next bytes of the current file to both
+ *                                hashes, one slice (up to the next block or piece
+ *                                boundary) at a time so the slice is still in
+ *                                cache for the second hash.
+ * @param data  Next bytes of the file.
+ * @param size  Number of bytes in data.
+ */
+template<typename T>
+void HybridHasher<T>::update(const unsigned char* data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t take = std::min(size, (size_t)std::min(blockSize - block.length(), pieceSize - piece.length()));
+        block.update(data, take);
+        piece.update(data, take);
+        data += take;
+        size -= take;
+
+        if (block.length() == blockSize)
+        {
+            fileBlocks.push_back(Hash<T>(block));
+            block.reset();
+        }
+
+        if (piece.length() == pieceSize)
+            endPiece();
+    }
+}
+
+/**
+ * @brief HybridHasher<T>::endFile End the current file: hash its last (short) block
+ *                                 and pad the v1 data to a piece boundary, or end
+ *                                 the last piece if it is the last file.
+ * @param blocks    Leaf hashes of the file, in order (empty for an empty file).
+ * @param last      Whether it is the last file of the torrent.
+ * @return          Number of zero bytes of padding (0 for the last file).
+ */
+template<typename T>
+size_t HybridHasher<T>::endFile(std::vector<Hash<T> >& blocks, bool last)
+{
+    if (block.length() > 0)
+    {
+        fileBlocks.push_back(Hash<T>(block));
+        block.reset();
+    }
+
+    blocks.swap(fileBlocks);
+    fileBlocks.clear();
+
+    if (piece.length() == 0)
+        return 0;
+
+    if (last)
+    {
+        endPiece();
+        return 0;
+    }
+
+    static const unsigned char zeros[4096] = {};
+    size_t padding = pieceSize - (size_t)piece.length();
+    for (size_t left = padding; left > 0;)
+    {
+        size_t take = std::min(left, sizeof(zeros));
+        piece.update(zeros, take);
+        left -= take;
+    }
+    endPiece();
+
+    return padding;
+}
+
+/**
+ * @brief HybridHasher<T>::pieces Return the v1 piece hashes so far.
+ * @return  SHA-1 digests of the pieces (SHA1_DIGEST_SIZE bytes each), in order.
+ */
+template<typename T>
+const std::vector<unsigned char>& HybridHasher<T>::pieces() const
+{
+    return pieceHashes;
+}
+
+/**
+ * @brief HybridHasher<T>::endPiece Append the SHA-1 of the current piece to the
+ *                                  piece hashes and start the next piece.
+ */
+template<typename T>
+void HybridHasher<T>::endPiece()
+{
+    size_t start = pieceHashes.size();
+    pieceHashes.resize(start + SHA1_DIGEST_SIZE);
+    piece.digest(&pieceHashes[start]);
+    piece.reset();
+}
@@ -0,0 +1,45 @@
+#ifndef _HYBRID_HASHER_H_
+#define _HYBRID_HASHER_H_
+
+#include <vector>
+
+#include "hash.hpp"
+#include "sha1_stream.hpp"
+#include "sha256_stream.hpp"
+
+// creation of a hybrid (v1 + v2) torrent in a single read of the data: every buffer is fed, while hot in
+// cache, both to the SHA-1 of the current v1 piece and to the SHA-256 of the current v2 block (a leaf of
+// the Merkle tree of the file); files are padded to a piece boundary in v1 (BEP 47 pad files)
+template <typename T>
+class HybridHasher
+{
+public:
+  // Constructor: v1 pieces of pieceSize bytes, v2 leaves of blockSize bytes
+  // return range_error if pieceSize is not a non-zero multiple of blockSize
+  HybridHasher(size_t pieceSize, size_t blockSize = 16384);
+
+  // feed the next bytes of the current file
+  void update(const unsigned char* data, size_t size);
+
+  // end the current file: blocks gets its leaf hashes (e.g. for MerkleTree::addBlock); the v1 data is
+  // padded with zeros to a piece boundary, unless it is the last file (then the last piece is ended)
+  // return number of padding bytes (size of the v1 pad file)
+  size_t endFile(std::vector<Hash<T> >& blocks, bool last = false);
+
+  // v1 piece hashes so far (SHA1_DIGEST_SIZE bytes per piece, in order)
+  const std::vector<unsigned char>& pieces() const;
+
+private:
+  size_t pieceSize;
+  size_t blockSize;
+  Sha1Stream piece;
+  Sha256Stream block;
+  std::vector<Hash<T> > fileBlocks;
+  std::vector<unsigned char> pieceHashes;
+
+  // append the hash of the current piece and start the next one
+  void endPiece();
+};
+
+#include "hybrid_hasher.cpp"
+#endif  //_HYBRID_HASHER_H_
@@ -0,0 +1,316 @@
+#include "memory_resource.hpp"
+#include <new>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+
+/**
+ * @brief MemoryResource::~MemoryResource Class destructor.
+ */
+inline MemoryResource::~MemoryResource()
+{
+}
+
+/**
+ * @brief MemoryResource::allocate Allocate memory from the resource.
+ * @param bytes Number of bytes.
+ * @param align Alignment of the memory (power of two).
+ * @return      Pointer to the memory. Throws std::bad_alloc on failure.
+ */
+inline void* MemoryResource::allocate(size_t bytes, size_t align)
+{
+    return doAllocate(bytes, align);
+}
+
+/**
+ * @brief MemoryResource::deallocate Release memory allocated from the resource.
+ * @param p     Pointer returned by allocate.
+ * @param bytes Number of bytes given to allocate.
+ * @param align Alignment given to allocate.
+ */
+inline void MemoryResource::deallocate(void* p, size_t bytes, size_t align)
+{
+    doDeallocate(p, bytes, align);
+}
+
+/**
+ * @brief NewDeleteResource::doAllocate Allocate memory with the global operator new.
+ * @param bytes Number of bytes.
+ * @param align Alignment of the memory (at most alignof(std::max_align_t)).
+ * @return      Pointer to the memory. Throws std::bad_alloc on failure.
+ */
+inline void* NewDeleteResource::doAllocate(size_t bytes, size_t align)
+{
+    if (align > alignof(std::max_align_t))
+        throw std::bad_alloc();
+
+    return ::operator new(bytes);
+}
+
+/**
+ * @brief NewDeleteResource::doDeallocate Release memory with the global operator delete.
+ * @param p     Pointer returned by allocate.
+ */
+inline void NewDeleteResource::doDeallocate(void* p, size_t, size_t)
+{
+    ::operator delete(p);
+}
+
+/**
+ * @brief defaultResource Return the resource used when none is given.
+ * @return  Pointer to a process-wide NewDeleteResource.
+ */
+inline MemoryResource* defaultResource()
+{
+    static NewDeleteResource res;
+    return &res;
+}
+
+/**
+ * @brief MonotonicArena::MonotonicArena Class constructor. Builds an empty arena.
+ * @param chunkSize Size in bytes of the first chunk.
+ */
+inline MonotonicArena::MonotonicArena(size_t chunkSize)
+    : nextChunkSize(chunkSize ? chunkSize : 1), cur(0), curLeft(0), used(0)
+{
+}
+
+/**
+ * @brief MonotonicArena::~MonotonicArena Class destructor. Releases every chunk.
+ */
+inline MonotonicArena::~MonotonicArena()
+{
+    release();
+}
+
+/**
+ * @brief MonotonicArena::release Release every chunk of the arena. Memory handed
+ *                                out before must not be used anymore.
+ */
+inline void MonotonicArena::release()
+{
+    for (size_t i = 0; i < chunks.size(); ++i)
+        ::operator delete(chunks[i]);
+
+    chunks.clear();
+    cur = 0;
+    curLeft = 0;
+    used = 0;
+}
+
+/**
+ * @brief MonotonicArena::bytesAllocated Return the bytes handed out by the arena.
+ * @return  Number of bytes allocated since the last release.
+ */
+inline size_t MonotonicArena::bytesAllocated() const
+{
+    return used;
+}
+
+/**
+ * @brief MonotonicArena::doAllocate Carve an allocation out of the current chunk,
+ *                                   getting a new (larger) chunk if it does not fit.
+ * @param bytes Number of bytes.
+ * @param align Alignment of the memory (power of two).
+ * @return      Pointer to the memory.
+ */
+inline void* MonotonicArena::doAllocate(size_t bytes, size_t align)
+{
+    size_t skip = (align - (reinterpret_cast<size_t>(cur) & (align - 1))) & (align - 1);
+
+    if (cur == 0 || skip + bytes > curLeft)
+    {
+        while (nextChunkSize < bytes + align)
+            nextChunkSize *= 2;
+
+        cur = static_cast<char*>(::operator new(nextChunkSize));
+        chunks.push_back(cur);
+        curLeft = nextChunkSize;
+        nextChunkSize *= 2;
+        skip = (align - (reinterpret_cast<size_t>(cur) & (align - 1))) & (align - 1);
+    }
+
+    void* p = cur + skip;
+    cur += skip + bytes;
+    curLeft -= skip + bytes;
+    used += bytes;
+
+    return p;
+}
+
+/**
+ * @brief MonotonicArena::doDeallocate No-op: memory is released all at once.
+ */
+inline void MonotonicArena::doDeallocate(void*, size_t, size_t)
+{
+}
+
+/**
+ * @brief HugePageResource::HugePageResource Class constructor.
+ * @param threshold Smallest allocation (in bytes) mapped on huge pages.
+ * @param upstream  Resource the smaller allocations are forwarded to.
+ */
+inline HugePageResource::HugePageResource(size_t threshold, MemoryResource* upstream)
+    : minBytes(threshold), up(upstream ? upstream : defaultResource())
+{
+}
+
+/**
+ * @brief HugePageResource::threshold Return the smallest allocation mapped on huge pages.
+ * @return  Threshold in bytes.
+ */
+inline size_t HugePageResource::threshold() const
+{
+    return minBytes;
+}
+
+/**
+ * @brief HugePageResource::upstream Return the resource small allocations are forwarded to.
+ * @return  Pointer to the upstream resource.
+ */
+inline MemoryResource* HugePageResource::upstream() const
+{
+    return up;
+}
+
+/**
+ * @brief HugePageResource::doAllocate Map an allocation on its own huge pages, or
+ *                                     forward it upstream if below the threshold.
+ * @param bytes Number of bytes (rounded up to a multiple of pageSize when mapped).
+ * @param align Alignment of the memory (at most pageSize).
+ * @return      Pointer to the memory. Throws std::bad_alloc on failure.
+ */
+inline void* HugePageResource::doAllocate(size_t bytes, size_t align)
+{
+    if (bytes < minBytes)
+        return up->allocate(bytes, align);
+
+    if (align > pageSize)
+        throw std::bad_alloc();
+
+#if defined(__unix__) || defined(__APPLE__)
+    size_t len = (bytes + pageSize - 1) / pageSize * pageSize;
+    void* p = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (p == MAP_FAILED)    //no explicit huge pages reserved: ask for transparent ones
+    {
+        p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        madvise(p, len, MADV_HUGEPAGE);
+#endif
+    }
+
+    return p;
+#else
+    return ::operator new(bytes);
+#endif
+}
+
+/**
+ * @brief HugePageResource::doDeallocate Unmap an allocation, or give it back
+ *                                       upstream if below the threshold.
+ * @param p     Pointer returned by allocate.
+ * @param bytes Number of bytes given to allocate.
+ * @param align Alignment given to allocate.
+ */
+inline void HugePageResource::doDeallocate(void* p, size_t bytes, size_t align)
+{
+    if (bytes < minBytes)
+    {
+        up->deallocate(p, bytes, align);
+        return;
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    munmap(p, (bytes + pageSize - 1) / pageSize * pageSize);
+#else
+    ::operator delete(p);
+#endif
+}
+
+/**
+ * @brief ResourceAllocator<U>::ResourceAllocator Class constructor. Builds an
+ *                                               allocator drawing from defaultResource().
+ */
+template<typename U>
+ResourceAllocator<U>::ResourceAllocator() : res(defaultResource())
+{
+}
+
+/**
+ * @brief ResourceAllocator<U>::ResourceAllocator Class constructor.
+ * @param res   Memory resource the allocator draws from.
+ */
+template<typename U>
+ResourceAllocator<U>::ResourceAllocator(MemoryResource* res) : res(res)
+{
+}
+
+/**
+ * @brief ResourceAllocator<U>::ResourceAllocator Class constructor. Builds an
+ *                                               allocator drawing from the same
+ *                                               resource as another one.
+ * @param x The other allocator.
+ */
+template<typename U>
+template<typename V>
+ResourceAllocator<U>::ResourceAllocator(const ResourceAllocator<V>& x) : res(x.resource())
+{
+}
+
+/**
+ * @brief ResourceAllocator<U>::allocate Allocate (uninitialized) memory for n objects.
+ * @param n Number of objects.
+ * @return  Pointer to the memory.
+ */
+template<typename U>
+U* ResourceAllocator<U>::allocate(size_t n)
+{
+    return static_cast<U*>(res->allocate(n * sizeof(U), alignof(U)));
+}
+
+/**
+ * @brief ResourceAllocator<U>::deallocate Release memory for n objects.
+ * @param p Pointer returned by allocate(n).
+ * @param n Number of objects.
+ */
+template<typename U>
+void ResourceAllocator<U>::deallocate(U* p, size_t n)
+{
+    res->deallocate(p, n * sizeof(U), alignof(U));
+}
+
+/**
+ * @brief ResourceAllocator<U>::resource Return the resource the allocator draws from.
+ * @return  Pointer to the memory resource.
+ */
+template<typename U>
+MemoryResource* ResourceAllocator<U>::resource() const
+{
+    return res;
+}
+
+/**
+ * @brief operator == Two allocators are equal if they draw from the same resource.
+ */
+template<typename U, typename V>
+bool operator==(const ResourceAllocator<U>& x, const ResourceAllocator<V>& y)
+{
+    return x.resource() == y.resource();
+}
+
+/**
+ * @brief operator != Two allocators are different if they draw from different resources.
+ */
+template<typename U, typename V>
+bool operator!=(const ResourceAllocator<U>& x, const ResourceAllocator<V>& y)
+{
+    return x.resource() != y.resource();
+}
@@ -0,0 +1,133 @@
+#ifndef _MEMORY_RESOURCE_H_
+#define _MEMORY_RESOURCE_H_
+
+#include <cstddef>
+#include <vector>
+
+// Source of raw memory for tree node storage (a C++11 take on std::pmr::memory_resource)
+class MemoryResource
+{
+public:
+  // Destructor
+  virtual ~MemoryResource();
+
+  // allocate bytes of memory aligned to align
+  void* allocate(size_t bytes, size_t align);
+
+  // release memory returned by allocate with the same bytes and align
+  void deallocate(void* p, size_t bytes, size_t align);
+
+private:
+  virtual void* doAllocate(size_t bytes, size_t align) = 0;
+  virtual void doDeallocate(void* p, size_t bytes, size_t align) = 0;
+};
+
+// Resource backed by the global operator new/delete (alignments up to that of
+// std::max_align_t)
+class NewDeleteResource : public MemoryResource
+{
+private:
+  void* doAllocate(size_t bytes, size_t align);
+  void doDeallocate(void* p, size_t bytes, size_t align);
+};
+
+// return the process-wide NewDeleteResource used when no resource is given
+MemoryResource* defaultResource();
+
+// Monotonic arena: carves allocations out of large chunks; deallocate is a no-op
+// and all the memory is released at once by release() or by the destructor
+class MonotonicArena : public MemoryResource
+{
+public:
+  // Constructor: arena whose first chunk is chunkSize bytes (chunks grow geometrically)
+  explicit MonotonicArena(size_t chunkSize = 64 * 1024);
+
+  // Destructor
+  ~MonotonicArena();
+
+  // release every chunk of the arena
+  void release();
+
+  // bytes handed out by the arena since the last release
+  size_t bytesAllocated() const;
+
+private:
+  MonotonicArena(const MonotonicArena&);
+  MonotonicArena& operator=(const MonotonicArena&);
+
+  void* doAllocate(size_t bytes, size_t align);
+  void doDeallocate(void* p, size_t bytes, size_t align);
+
+  std::vector<char*> chunks; // chunks allocated so far
+  size_t nextChunkSize; // size of the next chunk
+  char* cur; // free space of the current chunk
+  size_t curLeft; // bytes left in the current chunk
+  size_t used; // bytes handed out
+};
+
+// Huge page resource: allocations of at least threshold bytes are mapped on their
+// own 2 MB pages, either explicit huge pages (MAP_HUGETLB) or, when none are
+// reserved, transparent huge pages requested with madvise; smaller ones come from
+// the upstream resource so they do not waste most of a page. Falls back to
+// operator new on non-POSIX systems
+class HugePageResource : public MemoryResource
+{
+public:
+  // size of a huge page
+  static const size_t pageSize = 2 * 1024 * 1024;
+
+  // Constructor: allocations below threshold bytes go to upstream (which must outlive it)
+  explicit HugePageResource(size_t threshold = pageSize / 2, MemoryResource* upstream = defaultResource());
+
+  // smallest allocation mapped on huge pages
+  size_t threshold() const;
+
+  // return the resource small allocations are forwarded to
+  MemoryResource* upstream() const;
+
+private:
+  HugePageResource(const HugePageResource&);
+  HugePageResource& operator=(const HugePageResource&);
+
+  void* doAllocate(size_t bytes, size_t align);
+  void doDeallocate(void* p, size_t bytes, size_t align);
+
+  size_t minBytes; // smallest allocation mapped on huge pages
+  MemoryResource* up; // resource for the smaller allocations
+};
+
+// Allocator (usable as the Alloc parameter of MerkleTree) that gets its memory from a MemoryResource
+template <typename U>
+class ResourceAllocator
+{
+public:
+  typedef U value_type;
+
+  // Constructor: allocator drawing from defaultResource()
+  ResourceAllocator();
+
+  // Constructor: allocator drawing from resource res (which must outlive it)
+  ResourceAllocator(MemoryResource* res);
+
+  // Constructor: same resource as an allocator of another type
+  template <typename V>
+  ResourceAllocator(const ResourceAllocator<V>& x);
+
+  U* allocate(size_t n);
+  void deallocate(U* p, size_t n);
+
+  // return the resource the allocator draws from
+  MemoryResource* resource() const;
+
+private:
+  MemoryResource* res;
+};
+
+template <typename U, typename V>
+bool operator==(const ResourceAllocator<U>& x, const ResourceAllocator<V>& y);
+
+template <typename U, typename V>
+bool operator!=(const ResourceAllocator<U>& x, const ResourceAllocator<V>& y);
+
+#include "memory_resource.cpp"
+#endif  //_MEMORY_RESOURCE_H_
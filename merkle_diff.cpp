@@ -0,0 +1,177 @@
+#include "merkle_diff.hpp"
+#include <stdexcept>
+
+//////////////
+/**
+ * @brief addDiffLeaf Append a differing leaf to a list of ranges, extending the
+ *                    last range if the leaf follows it.
+ * @param ranges    Ascending leaf ranges.
+ * @param leaf      Differing leaf (not below the last range).
+ */
+inline void addDiffLeaf(std::vector<BlockRange>& ranges, size_t leaf)
+{
+    if (!ranges.empty() && ranges.back().last == leaf)
+        ++ranges.back().last;
+    else
+    {
+        BlockRange range = { leaf, leaf + 1 };
+        ranges.push_back(range);
+    }
+}
+
+/**
+ * @brief sameNode Tell whether two node hashes are known and equal.
+ * @param x First hash.
+ * @param y Second hash.
+ * @return  True if both hashes are known and equal. False otherwise.
+ */
+template<typename T, typename Policy>
+bool sameNode(const Hash<T, Policy>& x, const Hash<T, Policy>& y)
+{
+    return !x.isEmpty() && x == y;
+}
+//////////////
+
+/**
+ * @brief diff Find the leaf ranges that differ between two trees of the same
+ *             geometry. The trees are walked from the root down (depth first,
+ *             left to right) only into subtrees whose hashes differ.
+ * @param a First tree.
+ * @param b Second tree.
+ * @return  Differing leaf ranges, ascending and maximal. Throws a
+ *          std::runtime_error if the trees have different geometries (depth
+ *          or number of blocks).
+ */
+template<typename T, size_t K, typename A1, typename A2, typename Policy>
+std::vector<BlockRange> diff(const MerkleTree<T, K, A1, Policy>& a, const MerkleTree<T, K, A2, Policy>& b)
+{
+    if (a.depth() != b.depth() || a.getNumBlocks() != b.getNumBlocks())
+        throw std::runtime_error("Range Error: Different Tree Geometries!");
+
+    std::vector<BlockRange> ranges;
+    std::vector<std::pair<size_t, size_t> > stack(1, std::make_pair(a.depth(), (size_t)0)); //(height, index)
+
+    while (!stack.empty())
+    {
+        size_t height = stack.back().first;
+        size_t index = stack.back().second;
+        stack.pop_back();
+
+        if (sameNode(a.getNode(height, index), b.getNode(height, index)))
+            continue;
+
+        if (height == 0)
+            addDiffLeaf(ranges, index);
+        else
+            for (size_t i = K; i > 0; --i)  //leftmost child on top
+                stack.push_back(std::make_pair(height - 1, K * index + i - 1));
+    }
+
+    return ranges;
+}
+
+/**
+ * @brief RemoteDiff<T, K, Alloc, Policy>::RemoteDiff Class constructor. Starts a diff
+ *                                                    of a local tree at the root level.
+ * @param local Local tree (kept by reference).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+RemoteDiff<T, K, Alloc, Policy>::RemoteDiff(const MerkleTree<T, K, Alloc, Policy>& local)
+    : local(local), level(local.depth()), finished(false), nodes(1, 0), numCompared(0)
+{
+}
+
+/**
+ * @brief RemoteDiff<T, K, Alloc, Policy>::height Return the height of the current level.
+ * @return  Height of the level whose hashes are wanted (0 is the leaf layer).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t RemoteDiff<T, K, Alloc, Policy>::height() const
+{
+    return level;
+}
+
+/**
+ * @brief RemoteDiff<T, K, Alloc, Policy>::wanted Return the nodes of the current level
+ *                                                whose remote hashes are wanted.
+ * @return  Positions in the layer, ascending (empty once done).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+const std::vector<size_t>& RemoteDiff<T, K, Alloc, Policy>::wanted() const
+{
+    return nodes;
+}
+
+/**
+ * @brief RemoteDiff<T, K, Alloc, Policy>::advance Compare the remote hashes of the wanted
+ *                                                 nodes with the local ones and go down one
+ *                                                 level (into the children of the nodes
+ *                                                 that differ). Differing leaves are
+ *                                                 clamped to the local data blocks.
+ * @param remote    Remote hashes of the wanted nodes, in the same order. Throws
+ *                  a std::runtime_error if there is not one hash per wanted node.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+void RemoteDiff<T, K, Alloc, Policy>::advance(const std::vector<Hash<T, Policy> >& remote)
+{
+    if (finished || remote.size() != nodes.size())
+        throw std::runtime_error("Runtime Error: Wrong Number of Remote Hashes!");
+
+    numCompared += remote.size();
+
+    std::vector<size_t> next;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (sameNode(local.getNode(level, nodes[i]), remote[i]))
+            continue;
+
+        if (level == 0)
+        {
+            if (nodes[i] < local.getNumBlocks())    //padding of a remote tree of another size
+                addDiffLeaf(ranges, nodes[i]);
+        }
+        else
+            for (size_t j = 0; j < K; ++j)
+                next.push_back(K * nodes[i] + j);
+    }
+
+    nodes.swap(next);
+    if (level == 0 || nodes.empty())
+    {
+        finished = true;
+        nodes.clear();
+    }
+    else
+        --level;
+}
+
+/**
+ * @brief RemoteDiff<T, K, Alloc, Policy>::done Tell whether the diff is complete.
+ * @return  True if the leaf layer has been compared (or no node differs).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool RemoteDiff<T, K, Alloc, Policy>::done() const
+{
+    return finished;
+}
+
+/**
+ * @brief RemoteDiff<T, K, Alloc, Policy>::result Return the differing leaf ranges.
+ * @return  Leaf ranges, ascending and maximal (complete once done).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+const std::vector<BlockRange>& RemoteDiff<T, K, Alloc, Policy>::result() const
+{
+    return ranges;
+}
+
+/**
+ * @brief RemoteDiff<T, K, Alloc, Policy>::compared Return the number of remote hashes
+ *                                                  compared so far.
+ * @return  Number of hashes given to advance.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t RemoteDiff<T, K, Alloc, Policy>::compared() const
+{
+    return numCompared;
+}
@@ -0,0 +1,61 @@
+#ifndef _MERKLE_DIFF_H_
+#define _MERKLE_DIFF_H_
+
+#include <vector>
+
+#include "hash.hpp"
+#include "merkle_tree.hpp"
+
+// range of blocks [first, last)
+struct BlockRange
+{
+  size_t first;
+  size_t last;
+};
+
+// leaf ranges (ascending, maximal) that differ between two trees of the same geometry
+// only subtrees whose hashes differ are visited; unknown nodes count as different
+// return range_error if the trees have different geometries (depth or number of blocks)
+template <typename T, size_t K, typename A1, typename A2, typename Policy>
+std::vector<BlockRange> diff(const MerkleTree<T, K, A1, Policy>& a, const MerkleTree<T, K, A2, Policy>& b);
+
+// diff against a tree known only through node hashes sent by the other side, one level at a time:
+// send the wanted nodes of the current level, get back their hashes (advance), until done
+template <typename T, size_t K = 2, typename Alloc = std::allocator<Hash<T> >,
+          typename Policy = Sha256Policy>
+class RemoteDiff
+{
+public:
+  // Constructor: diff of the local tree (kept by reference) starting at the root level
+  RemoteDiff(const MerkleTree<T, K, Alloc, Policy>& local);
+
+  // height of the current level (0 is the leaf layer)
+  size_t height() const;
+
+  // nodes of the current level (positions in the layer, ascending) whose remote hashes are wanted
+  const std::vector<size_t>& wanted() const;
+
+  // give the remote hashes of the wanted nodes (in the same order) and go down one level
+  // return runtime_error if there is not one hash per wanted node
+  void advance(const std::vector<Hash<T, Policy> >& remote);
+
+  // whether the leaf layer has been compared
+  bool done() const;
+
+  // differing leaf ranges (ascending, maximal, within the local data blocks), once done
+  const std::vector<BlockRange>& result() const;
+
+  // number of remote hashes given so far
+  size_t compared() const;
+
+private:
+  const MerkleTree<T, K, Alloc, Policy>& local;
+  size_t level;
+  bool finished;
+  std::vector<size_t> nodes;
+  std::vector<BlockRange> ranges;
+  size_t numCompared;
+};
+
+#include "merkle_diff.cpp"
+#endif  //_MERKLE_DIFF_H_
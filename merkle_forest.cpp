@@ -0,0 +1,285 @@
+#include "merkle_forest.hpp"
+#include <stdexcept>
+
+/**
+ * @brief MerkleForest<T, Policy>::MerkleForest Class constructor. Builds an empty forest.
+ */
+template<typename T, typename Policy>
+MerkleForest<T, Policy>::MerkleForest()
+{
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::reserve Reserve space for a number of trees and blocks,
+ *                                         so that adding them does not grow the arena.
+ * @param numTrees  Number of trees.
+ * @param numBlocks Total number of blocks of all the trees.
+ */
+template<typename T, typename Policy>
+void MerkleForest<T, Policy>::reserve(size_t numTrees, size_t numBlocks)
+{
+    //a tree of n blocks has less than 4n nodes (2 * next power of two)
+    arena.reserve(4 * numBlocks + 2 * numTrees);
+    rootHashes.reserve(numTrees);
+    trees.reserve(numTrees);
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::addTree Add an empty tree without root hash large enough
+ *                                         to accomodate n blocks.
+ * @param n Number of data blocks of the tree.
+ * @return  ID of the new tree.
+ */
+template<typename T, typename Policy>
+size_t MerkleForest<T, Policy>::addTree(size_t n)
+{
+    TreeInfo info;
+    info.offset = arena.size();
+    info.numBlocks = n;
+    info.numPads = 2;
+    while (info.numPads < n)
+        info.numPads <<= 1;
+    info.numPads -= n;
+
+    size_t treeID = trees.size();
+    trees.push_back(info);
+    rootHashes.push_back(Hash<T, Policy>());
+    arena.resize(arena.size() + 2 * (n + info.numPads) - 2);
+
+    //set hash of padding blocks
+    static const unsigned char padHash[Policy::digestSize] = {0};
+    for (size_t id = n; id < n + info.numPads; ++id)
+    {
+        node(treeID, block2ind(treeID, id)).setHash(padHash, sizeof(padHash));
+        updateTree(treeID, id);
+    }
+
+    return treeID;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::addTree Add an empty tree with root hash large enough
+ *                                         to accomodate n blocks.
+ * @param n         Number of data blocks of the tree.
+ * @param rootHash  Hash of the root node.
+ * @return          ID of the new tree.
+ */
+template<typename T, typename Policy>
+size_t MerkleForest<T, Policy>::addTree(size_t n, const Hash<T, Policy>& rootHash)
+{
+    size_t treeID = addTree(n);
+    rootHashes[treeID] = rootHash;
+
+    return treeID;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::size Return the number of trees in the forest.
+ * @return  Number of trees.
+ */
+template<typename T, typename Policy>
+size_t MerkleForest<T, Policy>::size() const
+{
+    return trees.size();
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::numBlocks Return the number of blocks of a tree.
+ * @param treeID    ID of the tree.
+ * @return          Number of non-padding blocks of the tree.
+ */
+template<typename T, typename Policy>
+size_t MerkleForest<T, Policy>::numBlocks(size_t treeID) const
+{
+    if (treeID >= trees.size())
+        throw std::runtime_error("Range Error: Invalid Tree ID!");
+
+    return trees[treeID].numBlocks;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::clear Destroy every tree of the forest at once and
+ *                                       release the arena.
+ */
+template<typename T, typename Policy>
+void MerkleForest<T, Policy>::clear()
+{
+    std::vector<Hash<T, Policy> >().swap(arena);
+    std::vector<Hash<T, Policy> >().swap(rootHashes);
+    std::vector<TreeInfo>().swap(trees);
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::roots Return the root hashes of every tree.
+ * @return  Pointer to size() contiguous root hashes, in tree ID order.
+ */
+template<typename T, typename Policy>
+const Hash<T, Policy>* MerkleForest<T, Policy>::roots() const
+{
+    return rootHashes.data();
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::setRootHash Assign root hash of a tree.
+ * @param treeID    ID of the tree.
+ * @param rootHash  Hash set for the root node.
+ */
+template<typename T, typename Policy>
+void MerkleForest<T, Policy>::setRootHash(size_t treeID, const Hash<T, Policy>& rootHash)
+{
+    if (treeID >= trees.size())
+        throw std::runtime_error("Range Error: Invalid Tree ID!");
+
+    rootHashes[treeID] = rootHash;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::getRootHash Return the root hash of a tree.
+ * @param treeID    ID of the tree.
+ * @return          Hash in the root node of the tree. Throws a std::runtime_error
+ *                  if the tree does not exist or its root hash is empty.
+ */
+template<typename T, typename Policy>
+Hash<T, Policy> MerkleForest<T, Policy>::getRootHash(size_t treeID) const
+{
+    if ((treeID >= trees.size()) || rootHashes[treeID].isEmpty())
+        throw std::runtime_error("Runtime Error: Invalid Tree ID or Invalid/Empty Root Hash!");
+
+    return rootHashes[treeID];
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::addBlock Add data block number blockID to a tree and
+ *                                          calculate descendent hashes if possible.
+ * @param treeID    ID of the tree.
+ * @param blockID   ID for the added data block.
+ * @param block     STL sequential container representing the data block.
+ * @return          True if the data block is added successfully. Throws
+ *                  a std::runtime_error exception if no tree-id or block-id.
+ */
+template<typename T, typename Policy>
+bool MerkleForest<T, Policy>::addBlock(size_t treeID, size_t blockID, const T& block)
+{
+    if (treeID >= trees.size() || blockID >= trees[treeID].numBlocks)
+        throw std::runtime_error("Range Error: Invalid Tree ID or Block ID!");
+
+    node(treeID, block2ind(treeID, blockID)) = Hash<T, Policy>(block);
+    updateTree(treeID, blockID);
+
+    return true;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::addBlock Add data block number blockID to a tree and
+ *                                          calculate descendent hashes if possible.
+ * @param treeID    ID of the tree.
+ * @param blockID   ID for the added data block.
+ * @param block     Unsigned char array representing the data block.
+ * @param size      Number of bytes in the block.
+ * @return          True if the data block is added successfully. Throws
+ *                  a std::runtime_error exception if no tree-id or block-id.
+ */
+template<typename T, typename Policy>
+bool MerkleForest<T, Policy>::addBlock(size_t treeID, size_t blockID, const unsigned char* block, size_t size)
+{
+    if (treeID >= trees.size() || blockID >= trees[treeID].numBlocks)
+        throw std::runtime_error("Range Error: Invalid Tree ID or Block ID!");
+
+    node(treeID, block2ind(treeID, blockID)) = Hash<T, Policy>(block, size);
+    updateTree(treeID, blockID);
+
+    return true;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::verifyBlock Verify integrity of block of a tree (use
+ *                                             sibling and descendents hashes of block
+ *                                             hash). If block is verified add hash to tree.
+ * @param treeID    ID of the tree.
+ * @param blockID   ID of the block.
+ * @param blockHash Hash of the block.
+ * @return          True if block is verified. False otherwise.
+ */
+template<typename T, typename Policy>
+bool MerkleForest<T, Policy>::verifyBlock(size_t treeID, size_t blockID, const Hash<T, Policy>& blockHash)
+{
+    if (treeID >= trees.size() || blockID >= trees[treeID].numBlocks)
+        return false;
+
+    size_t ind = block2ind(treeID, blockID);
+    Hash<T, Policy> unverHash = blockHash;
+
+    while (ind > 0)
+    {
+        const Hash<T, Policy>& sibl = node(treeID, (ind % 2) ? ind + 1 : ind - 1);
+        if (sibl.isEmpty())
+            return false;
+
+        unverHash = (ind % 2) ? unverHash + sibl : sibl + unverHash;
+        ind = (ind - 1) / 2;
+
+        if (unverHash != node(treeID, ind))
+            return false;
+    }
+
+    node(treeID, block2ind(treeID, blockID)) = blockHash;
+    updateTree(treeID, blockID);
+
+    return true;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::node Return node ind of a tree (offset-based addressing).
+ * @param treeID    ID of the tree.
+ * @param ind       Index of the node in the (array-based) tree.
+ * @return          Reference to the node hash.
+ */
+template<typename T, typename Policy>
+Hash<T, Policy>& MerkleForest<T, Policy>::node(size_t treeID, size_t ind)
+{
+    return (ind == 0) ? rootHashes[treeID] : arena[trees[treeID].offset + ind - 1];
+}
+
+template<typename T, typename Policy>
+const Hash<T, Policy>& MerkleForest<T, Policy>::node(size_t treeID, size_t ind) const
+{
+    return (ind == 0) ? rootHashes[treeID] : arena[trees[treeID].offset + ind - 1];
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::block2ind Return the node index corresponding to the data
+ *                                           block's hash in a tree.
+ * @param treeID    ID of the tree.
+ * @param blockID   ID of data block.
+ * @return          Node index corresponding to hash of block blockID.
+ */
+template<typename T, typename Policy>
+size_t MerkleForest<T, Policy>::block2ind(size_t treeID, size_t blockID) const
+{
+    return (trees[treeID].numBlocks + trees[treeID].numPads - 1) + blockID;
+}
+
+/**
+ * @brief MerkleForest<T, Policy>::updateTree Calculate descendent hashes of a tree after
+ *                                            adding block, if possible.
+ * @param treeID    ID of the tree.
+ * @param blockID   ID of added data block.
+ */
+template<typename T, typename Policy>
+void MerkleForest<T, Policy>::updateTree(size_t treeID, size_t blockID)
+{
+    size_t ind = block2ind(treeID, blockID);
+
+    while (ind > 0)
+    {
+        size_t lftChild = (ind % 2) ? ind : ind - 1;
+        const Hash<T, Policy>& h1 = node(treeID, lftChild);
+        const Hash<T, Policy>& h2 = node(treeID, lftChild + 1);
+
+        if (h1.isEmpty() || h2.isEmpty())
+            break;
+
+        ind = (ind - 1) / 2;
+        node(treeID, ind) = h1 + h2;
+    }
+}
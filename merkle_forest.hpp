@@ -0,0 +1,80 @@
+#ifndef _MERKLE_FOREST_H_
+#define _MERKLE_FOREST_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "hash.hpp"
+
+// Collection of many (small) binary Merkle trees, e.g. one per file of a
+// multi-file torrent. Nodes of every tree are allocated from a single arena
+// and addressed by offset; root hashes are kept contiguous in a separate array
+template <typename T, typename Policy = Sha256Policy>
+class MerkleForest
+{
+public:
+  // Constructor: empty forest
+  MerkleForest();
+
+  // reserve space for numTrees trees with a total of numBlocks blocks (avoid arena growth)
+  void reserve(size_t numTrees, size_t numBlocks);
+
+  // add an empty tree without root hash large enough to accomodate n blocks; return its tree ID
+  size_t addTree(size_t n);
+
+  // add an empty tree with root hash large enough to accomodate n blocks; return its tree ID
+  size_t addTree(size_t n, const Hash<T, Policy>& rootHash);
+
+  // number of trees in the forest
+  size_t size() const;
+
+  // number of blocks of tree treeID
+  size_t numBlocks(size_t treeID) const;
+
+  // destroy every tree of the forest at once
+  void clear();
+
+  // root hashes of every tree, contiguous and in tree ID order (size() hashes)
+  const Hash<T, Policy>* roots() const;
+
+  // assign root hash of tree treeID
+  void setRootHash(size_t treeID, const Hash<T, Policy>& rootHash);
+
+  // return root hash of tree treeID
+  Hash<T, Policy> getRootHash(size_t treeID) const;
+
+  // add data block number blockID to tree treeID (calculate descendent hashes if possible)
+  bool addBlock(size_t treeID, size_t blockID, const T& block);
+
+  // same as above but block data is in array form (size is the number of bytes in block)
+  bool addBlock(size_t treeID, size_t blockID, const unsigned char* block, size_t size);
+
+  // verify integrity of block of tree treeID (use sibling and descendents of the tree)
+  // if block is verified add hash to tree and calculate descendent hashes, if necessary
+  bool verifyBlock(size_t treeID, size_t blockID, const Hash<T, Policy>& blockHash);
+
+private:
+  // geometry of a tree and offset of its nodes in the arena
+  struct TreeInfo
+  {
+    size_t offset; // index in arena of the tree's node 1 (node 0, the root, lives in rootHashes)
+    size_t numBlocks; // number of non-padding blocks in the tree
+    size_t numPads; // number of padding blocks in the tree
+  };
+
+  // arena: non-root nodes of every tree (array-based trees, root excluded)
+  std::vector<Hash<T, Policy> > arena;
+  // root node of every tree
+  std::vector<Hash<T, Policy> > rootHashes;
+  // per tree geometry
+  std::vector<TreeInfo> trees;
+
+  Hash<T, Policy>& node(size_t treeID, size_t ind); //node ind of tree treeID
+  const Hash<T, Policy>& node(size_t treeID, size_t ind) const;
+  size_t block2ind(size_t treeID, size_t blockID) const; //convert blockID to index of block's hash
+  void updateTree(size_t treeID, size_t blockID); //calculate descendent hashes after adding block, if necessary
+};
+
+#include "merkle_forest.cpp"
+#endif  //_MERKLE_FOREST_H_
@@ -1,115 +1,179 @@
 #include "merkle_tree.hpp"
+#include <algorithm>
+#include <map>
+#include <set>
 #include <stdexcept>
+#include <vector>
 
 //////////////
 #define ROOT 0
 #define POW2(exp) (1UL << exp)
 #define MAX(x,y) (x > y) ? x : y
 
-size_t minGrPow2(size_t n)
-
+inline size_t minGrPow(size_t n, size_t base)
 {
     size_t pow = 1UL;
     while (pow < n)
-        pow = (pow << 1);
+        pow = pow * base;
+
+    return pow;
+}
+
+inline size_t intPow(size_t base, size_t exp)
+{
+    size_t pow = 1UL;
+    while (exp-- > 0)
+        pow = pow * base;
 
     return pow;
 }
+
+/**
+ * @brief nextTreeId Return a new tree identifier (from any thread).
+ * @return  Identifier never returned before in the process.
+ */
+inline size_t nextTreeId()
+{
+    static std::atomic<size_t> counter(0);
+
+    return ++counter;
+}
+
+template<typename H>
+bool allEqual(const H hashes[], size_t n)
+{
+    for (size_t i = 1; i < n; ++i)
+        if (hashes[i] != hashes[0])
+            return false;
+
+    return true;
+}
+
+//parent of K siblings; siblings that are all the same hash (runs of zero blocks, padding) have
+//the same parent all over a level, so it is combined once per height
+template<typename H>
+H combineSiblings(const H children[], size_t K, H& uniformChild, H& uniformParent)
+{
+    if (!allEqual(children, K))
+        return H::combine(children, K);
+
+    if (children[0] != uniformChild)
+    {
+        uniformChild = children[0];
+        uniformParent = H::combine(children, K);
+    }
+
+    return uniformParent;
+}
 //////////////
 
 /**
- * @brief MerkleTree<T>::MerkleTree Class default constructor. Builds
- *                                  an empty Merkle Tree.
+ * @brief MerkleTree<T, K, Alloc, Policy>::MerkleTree Class default constructor. Builds
+ *                                                    an empty Merkle Tree.
  */
-template<typename T>
-MerkleTree<T>::MerkleTree() : MerkleTree(0)
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleTree<T, K, Alloc, Policy>::MerkleTree() : MerkleTree(0)
 {
 }
 
 /**
- * @brief MerkleTree<T>::MerkleTree Class constructor. Builds an empty tree without
- *                                  root hash large enough to accomodate n blocks.
+ * @brief MerkleTree<T, K, Alloc, Policy>::MerkleTree Class constructor. Builds an empty tree without
+ *                                                    root hash large enough to accomodate n blocks.
  * @param n Number of data blocks in the build tree.
  */
-template<typename T>
-MerkleTree<T>::MerkleTree(size_t n)
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleTree<T, K, Alloc, Policy>::MerkleTree(size_t n, const Alloc& alloc) : alloc(alloc)
 {
     numBlocks = n;
-    size_t minLeafNum = (n > 2) ? n : 2;
-    numPads = minGrPow2(minLeafNum) - n;
-    treeSize = 2*(numBlocks + numPads) - 1;
-    mktree = new Hash<T>[ treeSize ];
+    size_t minLeafNum = (n > K) ? n : K;
+    numPads = minGrPow(minLeafNum, K) - n;
+    treeSize = (K * (numBlocks + numPads) - 1) / (K - 1);
+    mktree = newNodes(treeSize);
+    version = 0;
+    treeId = nextTreeId();
+    resolving = false;
     pad();
 }
 
 /**
- * @brief MerkleTree<T>::MerkleTree Class constructor. Builds an empty tree with
- *                                  root hash large enough to accomodate n blocks.
+ * @brief MerkleTree<T, K, Alloc, Policy>::MerkleTree Class constructor. Builds an empty tree with
+ *                                                    root hash large enough to accomodate n blocks.
  * @param n         Number of data blocks in the build tree.
  * @param rootHash  Hash of the root node.
  */
-template<typename T>
-MerkleTree<T>::MerkleTree(size_t n, const Hash<T>& rootHash)
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleTree<T, K, Alloc, Policy>::MerkleTree(size_t n, const Hash<T, Policy>& rootHash, const Alloc& alloc) : alloc(alloc)
 {
     numBlocks = n;
-    size_t minLeafNum = (n > 2) ? n : 2;
-    numPads = minGrPow2(minLeafNum) - n;
-    treeSize = 2 * (numBlocks + numPads) - 1;
-    mktree = new Hash<T>[ treeSize ];
+    size_t minLeafNum = (n > K) ? n : K;
+    numPads = minGrPow(minLeafNum, K) - n;
+    treeSize = (K * (numBlocks + numPads) - 1) / (K - 1);
+    mktree = newNodes(treeSize);
     mktree[ROOT] = rootHash;
+    version = 0;
+    treeId = nextTreeId();
+    resolving = false;
     pad();
 }
 
 /**
- * @brief MerkleTree<T>::MerkleTree Class copy constructor. Builds a Merkle Tree
- *                                  from another given tree
+ * @brief MerkleTree<T, K, Alloc, Policy>::MerkleTree Class copy constructor. Builds a Merkle Tree
+ *                                                    from another given tree. Pending blocks and
+ *                                                    the pending callback are not copied (each
+ *                                                    pending block is reported by its own tree).
  * @param x The copied Merkle Tree.
  */
-template<typename T>
-MerkleTree<T>::MerkleTree(const MerkleTree<T>& oth)
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleTree<T, K, Alloc, Policy>::MerkleTree(const MerkleTree<T, K, Alloc, Policy>& oth)
+    : alloc(NodeTraits::select_on_container_copy_construction(oth.alloc))
 {
     //copy other tree data
-    mktree = new Hash<T>[ oth.treeSize ];
-    for (int i = 0; i < oth.treeSize; ++i)
+    mktree = newNodes(oth.treeSize);
+    for (size_t i = 0; i < oth.treeSize; ++i)
         mktree[i] = oth.mktree[i];
 
     treeSize = oth.treeSize;
     numBlocks = oth.numBlocks;
     numPads = oth.numPads;
+    version = oth.version;
+    treeId = nextTreeId();
+    resolving = false;
 }
 
 /**
- * @brief MerkleTree<T>::~MerkleTree Class destructor. Release the memory allocated
- *                                   to the tree.
+ * @brief MerkleTree<T, K, Alloc, Policy>::~MerkleTree Class destructor. Release the memory allocated
+ *                                                     to the tree.
  */
-template<typename T>
-MerkleTree<T>::~MerkleTree()
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleTree<T, K, Alloc, Policy>::~MerkleTree()
 {
-    delete [] mktree;
+    deleteNodes(mktree, treeSize);
 }
 
 /**
- * @brief MerkleTree<T>::setRootHash Assign root hash of tree. It throws
- *                                   a std::runtime_error exception if the
- *                                   given hash is empty.
+ * @brief MerkleTree<T, K, Alloc, Policy>::setRootHash Assign root hash of tree. It throws
+ *                                                     a std::runtime_error exception if the
+ *                                                     given hash is empty.
  * @param rootHash Hash set for the root node.
  */
-template<typename T>
-void MerkleTree<T>::setRootHash(const Hash<T>& rootHash)
+template<typename T, size_t K, typename Alloc, typename Policy>
+void MerkleTree<T, K, Alloc, Policy>::setRootHash(const Hash<T, Policy>& rootHash)
 {
     if (numBlocks == 0)
         throw std::runtime_error("Runtime Error: Null Merkle Tree or Invalid/Empty Root Hash!");
 
     mktree[ROOT] = rootHash;
+    ++version;
+    resolvePending(ROOT);
 }
 
 /**
- * @brief MerkleTree<T>::getRootHash Return the root hash of Merkle tree.
+ * @brief MerkleTree<T, K, Alloc, Policy>::getRootHash Return the root hash of Merkle tree.
  * @return  Hash in the root node of Merkle tree. Throws a std::runtime_error
  *          if the root hash is empty.
  */
-template<typename T>
-Hash<T> MerkleTree<T>::getRootHash()
+template<typename T, size_t K, typename Alloc, typename Policy>
+Hash<T, Policy> MerkleTree<T, K, Alloc, Policy>::getRootHash()
 {
     if ((numBlocks == 0) || mktree[ROOT].isEmpty())
         throw std::runtime_error("Runtime Error: Null Merkle Tree or Invalid/Empty Root Hash!");
@@ -118,241 +182,1181 @@ Hash<T> MerkleTree<T>::getRootHash()
 }
 
 /**
- * @brief MerkleTree<T>::addBlock Add data block number blockID to the tree
- *                                and calculate descendent hashes if possible.
+ * @brief MerkleTree<T, K, Alloc, Policy>::addBlock Add data block number blockID to the tree
+ *                                                  and calculate descendent hashes if possible.
  * @param blockID   ID for the added data block.
  * @param block     STL sequential container representing the data block.
  * @return          True if the data block is added successfully. Throws
  *                  a std::runtime_error exception if no block-id in the tree.
  */
-template<typename T>
-bool MerkleTree<T>::addBlock(size_t blockID, const T& block)
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::addBlock(size_t blockID, const T& block)
 {
     if (blockID < 0 || blockID >= numBlocks)
         throw std::runtime_error("Range Error: Invalid Block ID!");
 
     bool success = true;
-    mktree[block2ind(blockID)] = Hash<T>(block);
-    updateTree(blockID);
+    mktree[block2ind(blockID)] = Hash<T, Policy>(block);
+    pending.erase(blockID);
+    ++version;
+    resolvePending(updateTree(blockID));
 
     return success;
 }
 
 /**
- * @brief MerkleTree<T>::addBlock Add data block number blockID to the tree
- *                                and calculate descendent hashes if possible.
+ * @brief MerkleTree<T, K, Alloc, Policy>::addBlock Add data block number blockID to the tree
+ *                                                  and calculate descendent hashes if possible.
  * @param blockID   ID for the added data block.
  * @param block     Unsigned char array representing the data block.
  * @return          True if the data block is added successfully. Throws
  *                  a std::runtime_error exception if no block-id in the tree.
  */
-template<typename T>
-bool MerkleTree<T>::addBlock(size_t blockID, const unsigned char* block, size_t size)
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::addBlock(size_t blockID, const unsigned char* block, size_t size)
 {
     if (blockID < 0 || blockID >= numBlocks)
         throw std::runtime_error("Range Error: Invalid Block ID!");
 
     bool success = true;
-    mktree[block2ind(blockID)] = Hash<T>(block, size);
-    updateTree(blockID);
+    mktree[block2ind(blockID)] = Hash<T, Policy>(block, size);
+    pending.erase(blockID);
+    ++version;
+    resolvePending(updateTree(blockID));
 
     return success;
 }
 
 /**
- * @brief MerkleTree<T>::verifyBlock Verify integrity of block (use sibling and
- *                                   descendents hashes of block hash). If block
- *                                   is verified add hash to tree.
+ * @brief MerkleTree<T, K, Alloc, Policy>::addBlock Add data block number blockID to the tree
+ *                                                  and calculate descendent hashes if possible.
+ * @param blockID   ID for the added data block.
+ * @param segments  Array of segments (pointer and size) whose concatenation is the
+ *                  data block.
+ * @param n         Number of segments in the array.
+ * @return          True if the data block is added successfully. Throws
+ *                  a std::runtime_error exception if no block-id in the tree.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::addBlock(size_t blockID, const HashSegment segments[], size_t n)
+{
+    if (blockID >= numBlocks)
+        throw std::runtime_error("Range Error: Invalid Block ID!");
+
+    bool success = true;
+    mktree[block2ind(blockID)] = Hash<T, Policy>(segments, n);
+    pending.erase(blockID);
+    ++version;
+    resolvePending(updateTree(blockID));
+
+    return success;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::addBlock Add the hash of data block number blockID to
+ *                                                  the tree and calculate descendent hashes if
+ *                                                  possible.
+ * @param blockID   ID for the added data block.
+ * @param blockHash Hash of the data block (e.g. computed as the data arrived).
+ * @return          True if the block hash is added successfully. Throws a
+ *                  std::runtime_error exception if no block-id in the tree or
+ *                  if the hash is empty.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::addBlock(size_t blockID, const Hash<T, Policy>& blockHash)
+{
+    if (blockID >= numBlocks)
+        throw std::runtime_error("Range Error: Invalid Block ID!");
+
+    if (blockHash.isEmpty())
+        throw std::runtime_error("Runtime Error: Invalid Hash!");
+
+    bool success = true;
+    mktree[block2ind(blockID)] = blockHash;
+    pending.erase(blockID);
+    ++version;
+    resolvePending(updateTree(blockID));
+
+    return success;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::verifyBlock Verify integrity of block (use sibling and
+ *                                                     descendents hashes of block hash). If block
+ *                                                     is verified add hash to tree.
  * @param blockID   ID of the block.
  * @param blockHash Hash of the block.
  * @return          True if block is verified. False otherwise.
  */
-template<typename T>
-bool MerkleTree<T>::verifyBlock(size_t blockID, const Hash<T>& blockHash)
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash)
 {
-    bool verifFails;
+    VerifyResult result;
+    return verifyBlock(blockID, blockHash, result);
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::verifyBlock Verify integrity of block (use sibling and
+ *                                                     descendents hashes of block hash) and report
+ *                                                     why it fails. If block is verified add hash
+ *                                                     to tree.
+ * @param blockID   ID of the block.
+ * @param blockHash Hash of the block.
+ * @param result    Outcome: the first stored node that disagrees (or is missing)
+ *                  along the block's path, and its height.
+ * @return          True if block is verified. False otherwise.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, VerifyResult& result)
+{
+    result = VerifyResult();
+
     if (blockID < 0 || blockID >= numBlocks)
-        verifFails = true;
-    else
-        verifFails = false;
+        return result.fail(VerifyResult::BAD_BLOCK_ID);
 
     size_t unverNode = block2ind(blockID);
     size_t node = unverNode;
-    Hash<T> unverHash = blockHash;
+    Hash<T, Policy> unverHash = blockHash;
+
+    if (blockHash.isEmpty())
+        return result.fail(VerifyResult::EMPTY_HASH, 0);
 
-    while (!verifFails && (node > ROOT))
+    if (!mktree[node].isEmpty() && mktree[node] != blockHash)
+        return result.fail(VerifyResult::BLOCK_MISMATCH, 0, VerifyResult::npos, node);
+
+    for (size_t level = 0; node > ROOT; ++level)
     {
-        size_t sibl = getSibling(node);
-        Hash<T> h1;
-        Hash<T> h2;
-        if (node < sibl)    //cur. node is left child
-        {
-            h1 = unverHash;
-            h2 = mktree[sibl];
-        }
-        else                //cur. node is right child
+        Hash<T, Policy> children[K];
+        for (size_t i = 0; i < K; ++i)
         {
-            h1 = mktree[sibl];
-            h2 = unverHash;
+            size_t sibl = getSibling(node, i);
+            children[i] = (sibl == node) ? unverHash : mktree[sibl];
+
+            if (children[i].isEmpty())
+                return result.fail(VerifyResult::INCOMPLETE, level, VerifyResult::npos, sibl);
         }
 
-        if (!h1.isEmpty() && !h2.isEmpty())
-        {
-            unverHash = (h1 + h2);
-            node = getParent(node);
+        unverHash = Hash<T, Policy>::combine(children, K);
+        node = getParent(node);
 
-            if (unverHash != mktree[node])
-                verifFails = true;
-        }
-        else { verifFails = true; }
-    }
+        if (mktree[node].isEmpty())
+            return result.fail(VerifyResult::INCOMPLETE, level + 1, VerifyResult::npos, node);
 
-    bool verified = !verifFails;
-    if (verified)
-    {
-        mktree[unverNode] = blockHash;
-        updateTree(blockID);
+        if (unverHash != mktree[node])
+            return result.fail(VerifyResult::NODE_MISMATCH, level + 1, VerifyResult::npos, node);
     }
 
-    return verified;
+    mktree[unverNode] = blockHash;
+    pending.erase(blockID);
+    ++version;
+    resolvePending(updateTree(blockID));
+
+    return true;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::verifyBlock Verify integrity of block using attached list
+ *                                                     of sibling and descendent hashes. If block is
+ *                                                     verified add hash to tree and incorporate
+ *                                                     sibling/descendent hashes.
+ * @param blockID   ID of the block to verify.
+ * @param blockHash Hash of the block to verify.
+ * @param hashList  Contains (in order) hashes for block's siblings (K-1 per
+ *                  level, in node order) and all descendents' siblings up
+ *                  until root node.
+ * @param size      Number of hashes in in hashList
+ * @return          True if block is verified. False otherwise.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Hash<T, Policy> hashList[], size_t size)
+{
+    VerifyResult result;
+    return verifyBlock(blockID, blockHash, hashList, size, result);
 }
 
 /**
- * @brief MerkleTree<T>::verifyBlock Verify integrity of block using attached list
- *                                   of sibling and descendent hashes. If block is
- *                                   verified add hash to tree and incorporate
- *                                   sibling/descendent hashes.
+ * @brief MerkleTree<T, K, Alloc, Policy>::verifyBlock Verify integrity of block using attached list
+ *                                                     of sibling and descendent hashes and report
+ *                                                     why it fails. The block hash, every proof
+ *                                                     entry and every computed node are checked
+ *                                                     against the nodes the tree already knows,
+ *                                                     so the first wrong hash is pinpointed. If
+ *                                                     block is verified add hash to tree and
+ *                                                     incorporate sibling/descendent hashes.
  * @param blockID   ID of the block to verify.
  * @param blockHash Hash of the block to verify.
- * @param hashList  Contains (in order) hashes for block's sibling and all
- *                  descendents' hashes up until root node.
+ * @param hashList  Contains (in order) hashes for block's siblings (K-1 per
+ *                  level, in node order) and all descendents' siblings up
+ *                  until root node.
  * @param size      Number of hashes in in hashList
+ * @param result    Outcome: the first level at which a hash diverged, the proof
+ *                  entry and the stored node involved.
  * @return          True if block is verified. False otherwise.
  */
-template<typename T>
-bool MerkleTree<T>::verifyBlock(size_t blockID, const Hash<T>& blockHash, const Hash<T> hashList[], size_t size)
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Hash<T, Policy> hashList[], size_t size,
+                                          VerifyResult& result)
 {
-    bool verifFails;
-    if (blockID < 0 || blockID >= numBlocks || (size != std::log2(numBlocks + numPads)))
-        verifFails = true;
-    else
-        verifFails = false;
+    result = VerifyResult();
 
-    Hash<T> unverHash = blockHash;
+    if (blockID < 0 || blockID >= numBlocks)
+        return result.fail(VerifyResult::BAD_BLOCK_ID);
+
+    if (size != proofSize())
+        return result.fail(VerifyResult::BAD_PROOF_SIZE);
+
+    Hash<T, Policy> unverHash = blockHash;
     size_t node = block2ind(blockID);
 
-    for (int i = 0; !verifFails && i < size; ++i)
+    if (blockHash.isEmpty())
+        return result.fail(VerifyResult::EMPTY_HASH, 0);
+
+    if (!mktree[node].isEmpty() && mktree[node] != blockHash)
+        return result.fail(VerifyResult::BLOCK_MISMATCH, 0, VerifyResult::npos, node);
+
+    for (size_t i = 0, level = 0; i < size; i += K - 1, ++level)
     {
-        if (!hashList[i].isEmpty())
-            if (node % 2)   //node is left child
-                unverHash = unverHash + hashList[i];
-            else            //node is right child
-                unverHash = hashList[i] + unverHash;
-        else
-            verifFails = true;
+        Hash<T, Policy> children[K];
+        size_t pos = childOrder(node);
+
+        for (size_t j = 0, k = 0; j < K; ++j)
+        {
+            if (j == pos)
+            {
+                children[j] = unverHash;
+                continue;
+            }
+
+            size_t sibl = getSibling(node, j);
+            children[j] = hashList[i + k];
+
+            if (children[j].isEmpty())
+                return result.fail(VerifyResult::EMPTY_HASH, level, i + k);
+
+            if (!mktree[sibl].isEmpty() && mktree[sibl] != children[j])
+                return result.fail(VerifyResult::PROOF_MISMATCH, level, i + k, sibl);
+
+            ++k;
+        }
 
+        unverHash = Hash<T, Policy>::combine(children, K);
         node = getParent(node);
+
+        if (!mktree[node].isEmpty() && mktree[node] != unverHash)
+            return result.fail(VerifyResult::NODE_MISMATCH, level + 1, VerifyResult::npos, node);
     }
 
-    bool verified;
-    if (!verifFails && mktree[ROOT] == unverHash) //blockID authenticity verified
+    if (mktree[ROOT].isEmpty())
+        return result.fail(VerifyResult::INCOMPLETE, depth(), VerifyResult::npos, ROOT);
+
+    //blockID authenticity verified: insert hashes into the tree
+    mktree[node = block2ind(blockID)] = blockHash;
+
+    for (size_t i = 0; i < size; i += K - 1)
     {
-        verified = true;
+        for (size_t j = 0, k = 0; j < K; ++j)
+            if (getSibling(node, j) != node)
+                mktree[getSibling(node, j)] = hashList[i + k++];
+
+        node = getParent(node);
+    }
 
-        //insert hashes into the tree
-        mktree[node = block2ind(blockID)] = blockHash;
+    //update tree, if necessary
+    updateTree(blockID);
+    pending.erase(blockID);
+    ++version;
+    resolvePending(ROOT);
+
+    return true;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::proofSize Return the number of hashes in a verification
+ *                                                   proof of any block of the tree.
+ * @return  (K-1) sibling hashes for each level below the root.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::proofSize() const
+{
+    return (K - 1) * depth();
+}
 
-        for (int i = 0; i < size; ++i)
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::getProof Fill hashList with the sibling hashes of every
+ *                                                  node in the path from block blockID up to the
+ *                                                  root (the format expected by verifyBlock).
+ * @param blockID   ID of the block.
+ * @param hashList  Output array for the proof hashes.
+ * @param size      Number of hashes that fit in hashList. Must be proofSize().
+ * @return          True if the proof is complete. False if the block does not
+ *                  exist or some sibling hash is not known by the tree.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::getProof(size_t blockID, Hash<T, Policy> hashList[], size_t size) const
+{
+    if (blockID >= numBlocks || size != proofSize())
+        return false;
+
+    size_t node = block2ind(blockID);
+    size_t k = 0;
+
+    while (node > ROOT)
+    {
+        for (size_t j = 0; j < K; ++j)
         {
-            mktree[getSibling(node)] = hashList[i];
-            node = getParent(node);
+            size_t sibl = getSibling(node, j);
+            if (sibl == node)
+                continue;
+
+            if (mktree[sibl].isEmpty())
+                return false;
+
+            hashList[k++] = mktree[sibl];
         }
 
-        //update tree, if necessary
-        updateTree(blockID);
+        node = getParent(node);
     }
-    else { verified = false; }
 
-    return verified;
+    return true;
 }
 
 /**
- * @brief MerkleTree<T>::getLeftChild Return the left child of parent node.
- * @param parentNode    Parent node index.
- * @return              Index of left child node.
+ * @brief MerkleTree<T, K, Alloc, Policy>::layerSize Return the number of nodes in a layer
+ *                                                  of the tree.
+ * @param height    Height of the layer (0 is the leaf layer, depth the root).
+ * @return          Number of nodes in the layer (padding included). Zero if
+ *                  there is no such layer.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::layerSize(size_t height) const
+{
+    if (height > depth())
+        return 0;
+
+    size_t width = numBlocks + numPads;
+    for (size_t h = 0; h < height; ++h)
+        width /= K;
+
+    return width;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::getLayer Copy a whole layer of the tree (nodes
+ *                                                 of a layer are contiguous in mktree).
+ * @param height    Height of the layer (0 is the leaf layer, depth the root).
+ * @param layer     Output array for layerSize(height) hashes (empty hashes
+ *                  for nodes the tree does not know).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+void MerkleTree<T, K, Alloc, Policy>::getLayer(size_t height, Hash<T, Policy> layer[]) const
+{
+    if (height > depth())
+        throw std::runtime_error("Range Error: Invalid Layer Height!");
+
+    const Hash<T, Policy>* first = mktree + layerStart(height);
+    std::copy(first, first + layerSize(height), layer);
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::setLayer Install a whole layer of the tree. The
+ *                                                 nodes above it are computed in a single
+ *                                                 bottom-up pass and the result is checked
+ *                                                 against the root hash (if the tree has no
+ *                                                 root hash the layer is accepted as is).
+ *                                                 Aligned subtrees of identical leaves (e.g.
+ *                                                 zero blocks) are combined once per height.
+ *                                                 Known nodes below a layer node that changes
+ *                                                 are dropped (they do not match it anymore),
+ *                                                 but for the padding.
+ * @param height    Height of the layer (0 is the leaf layer, depth the root).
+ * @param layer     First size hashes of the layer.
+ * @param size      Number of hashes in layer (at most layerSize(height)); the
+ *                  remaining nodes (padding) must be already known by the tree.
+ * @return          True if the layer is verified and installed. False otherwise
+ *                  (the tree is not modified).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::setLayer(size_t height, const Hash<T, Policy> layer[], size_t size)
+{
+    size_t width = layerSize(height);
+    if (numBlocks == 0 || width == 0 || size > width)
+        return false;
+
+    const Hash<T, Policy>* pads = mktree + layerStart(height);
+    for (size_t i = 0; i < width; ++i)
+        if (((i < size) ? layer[i] : pads[i]).isEmpty())
+            return false;
+
+    //every level above the layer, from the root down to the layer's parents (the layer itself
+    //is read from layer[] and the padding already in mktree)
+    std::vector<Hash<T, Policy> > nodes(layerStart(height));
+    Hash<T, Policy> root = (size > 0) ? layer[0] : pads[0];
+
+    if (height < depth())
+    {
+        Hash<T, Policy> uniformChild, uniformParent;
+        Hash<T, Policy> children[K];
+
+        Hash<T, Policy>* parents = &nodes[layerStart(height + 1)];
+        for (size_t i = 0; i < width; i += K)
+        {
+            const Hash<T, Policy>* siblings = children;
+            if (i + K <= size)
+                siblings = layer + i;
+            else
+                for (size_t k = 0; k < K; ++k)
+                    children[k] = (i + k < size) ? layer[i + k] : pads[i + k];
+
+            parents[i / K] = combineSiblings(siblings, K, uniformChild, uniformParent);
+        }
+
+        Hash<T, Policy>* level = parents;
+        width /= K;
+        for (size_t h = height + 1; h < depth(); ++h, width /= K)
+        {
+            parents = &nodes[layerStart(h + 1)];
+            for (size_t i = 0; i < width; i += K)
+                parents[i / K] = combineSiblings(level + i, K, uniformChild, uniformParent);
+
+            level = parents;
+        }
+
+        root = nodes[ROOT];
+    }
+
+    if (!mktree[ROOT].isEmpty() && root != mktree[ROOT])
+        return false;
+
+    //verified: drop the known nodes under the nodes that change (but the padding, which is
+    //fixed), then install the layer
+    Hash<T, Policy>* first = mktree + layerStart(height);
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (first[i] == layer[i])
+            continue;
+
+        for (size_t h = height, span = 1; h-- > 0;)
+        {
+            span *= K;
+            size_t leaves = intPow(K, h);
+            size_t data = (numBlocks + leaves - 1) / leaves;
+            size_t begin = i * span, end = std::min((i + 1) * span, data);
+            if (begin < end)
+                std::fill(mktree + layerStart(h) + begin, mktree + layerStart(h) + end, Hash<T, Policy>());
+        }
+    }
+
+    if (layer != first)     //not filled in place (fillLeaves)
+        std::copy(layer, layer + size, first);
+    std::copy(nodes.begin(), nodes.end(), mktree);
+    ++version;
+    resolvePending(ROOT);
+
+    return true;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::fillLeaves Hash the leaf layer straight into the
+ *                                                   tree, then install it as setLayer does
+ *                                                   (without a copy of the layer). Leaves
+ *                                                   known beforehand are saved and restored
+ *                                                   if the layer is not installed.
+ * @param fill  Called as fill(leaves, getNumBlocks()) to write every data leaf;
+ *              returns false on failure.
+ * @return      True if the leaf layer is verified and installed. False otherwise
+ *              (the tree is not modified).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::fillLeaves(const std::function<bool(Hash<T, Policy>[], size_t)>& fill)
+{
+    if (numBlocks == 0)
+        return false;
+
+    Hash<T, Policy>* leaves = mktree + block2ind(0);
+    std::vector<std::pair<size_t, Hash<T, Policy> > > known;
+    for (size_t i = 0; i < numBlocks; ++i)
+        if (!leaves[i].isEmpty())
+            known.push_back(std::make_pair(i, leaves[i]));
+
+    if (fill(leaves, numBlocks) && setLayer(0, leaves, numBlocks))
+        return true;
+
+    std::fill(leaves, leaves + numBlocks, Hash<T, Policy>());
+    for (size_t i = 0; i < known.size(); ++i)
+        leaves[known[i].first] = known[i].second;
+
+    return false;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::getNode Return a node of the tree (no copy).
+ * @param height    Height of the node's layer (0 is the leaf layer, depth the root).
+ * @param index     Position of the node in its layer.
+ * @return          Reference to the node hash (empty if not known). Throws a
+ *                  std::runtime_error if there is no such node.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+const Hash<T, Policy>& MerkleTree<T, K, Alloc, Policy>::getNode(size_t height, size_t index) const
+{
+    if (index >= layerSize(height))
+        throw std::runtime_error("Range Error: Invalid Node!");
+
+    return mktree[layerStart(height) + index];
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::getNode Return a node of the tree (no copy).
+ * @param node  Node number in the array layout of the tree (root is node 0,
+ *              children of node p are nodes K*p+1 to K*p+K).
+ * @return      Reference to the node hash (empty if not known). Throws a
+ *              std::runtime_error if there is no such node.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+const Hash<T, Policy>& MerkleTree<T, K, Alloc, Policy>::getNode(size_t node) const
+{
+    if (node >= treeSize)
+        throw std::runtime_error("Range Error: Invalid Node!");
+
+    return mktree[node];
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::missingProofNodes Return the nodes whose hashes the
+ *                                                           tree needs to verify a set of blocks.
+ *                                                           The paths of the blocks are walked
+ *                                                           bottom up (deepest node first) until
+ *                                                           a known ancestor; siblings on the way
+ *                                                           that are neither known nor computed
+ *                                                           from other blocks of the set are needed.
+ * @param blockIDs  IDs of the blocks to verify.
+ * @return          Needed node numbers (array layout), in ascending order. Throws
+ *                  a std::runtime_error exception if no block-id in the tree.
  */
-template<typename T>
-size_t MerkleTree<T>::getLeftChild(size_t parentNode)
+template<typename T, size_t K, typename Alloc, typename Policy>
+std::vector<size_t> MerkleTree<T, K, Alloc, Policy>::missingProofNodes(const std::vector<size_t>& blockIDs) const
 {
-    return (2*parentNode + 1);
+    std::set<size_t> computed;    //nodes whose hash follows from the blocks
+    for (size_t i = 0; i < blockIDs.size(); ++i)
+    {
+        if (blockIDs[i] >= numBlocks)
+            throw std::runtime_error("Range Error: Invalid Block ID!");
+
+        computed.insert(block2ind(blockIDs[i]));
+    }
+
+    std::vector<size_t> needed;
+    while (!computed.empty())
+    {
+        size_t node = *computed.rbegin();   //deepest node: its siblings were not processed yet
+        computed.erase(node);
+
+        if (node == ROOT || !mktree[node].isEmpty())  //checked against the tree
+            continue;
+
+        for (size_t i = 0; i < K; ++i)
+        {
+            size_t sibl = getSibling(node, i);
+            if (sibl != node && !computed.erase(sibl) && mktree[sibl].isEmpty())
+                needed.push_back(sibl);
+        }
+
+        computed.insert(getParent(node));
+    }
+
+    std::sort(needed.begin(), needed.end());
+
+    return needed;
 }
 
 /**
- * @brief MerkleTree<T>::getRightChild Return the right child of parent node.
+ * @brief MerkleTree<T, K, Alloc, Policy>::verifyBlocks Verify a set of blocks at once using
+ *                                                      the hashes of some nodes of the tree.
+ *                                                      Hashes are combined bottom up until a
+ *                                                      known node, which must match. If every
+ *                                                      block is verified the block, node and
+ *                                                      computed hashes are added to the tree.
+ * @param blockIDs      IDs of the blocks to verify.
+ * @param blockHashes   Hashes of the blocks to verify.
+ * @param nodes         Node numbers (array layout) of the given node hashes.
+ * @param nodeHashes    Hashes of nodes (e.g. those of missingProofNodes).
+ * @return              True if every block is verified. False otherwise (the tree
+ *                      is not modified).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::verifyBlocks(const std::vector<size_t>& blockIDs, const std::vector<Hash<T, Policy> >& blockHashes,
+                                           const std::vector<size_t>& nodes, const std::vector<Hash<T, Policy> >& nodeHashes)
+{
+    if (blockIDs.size() != blockHashes.size() || nodes.size() != nodeHashes.size())
+        return false;
+
+    std::map<size_t, Hash<T, Policy> > unverified;
+    for (size_t i = 0; i < blockIDs.size(); ++i)
+    {
+        if (blockIDs[i] >= numBlocks || blockHashes[i].isEmpty())
+            return false;
+
+        unverified[block2ind(blockIDs[i])] = blockHashes[i];
+    }
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (nodes[i] >= treeSize || nodeHashes[i].isEmpty())
+            return false;
+
+        unverified[nodes[i]] = nodeHashes[i];
+    }
+
+    std::vector<std::pair<size_t, Hash<T, Policy> > > verified;
+    while (!unverified.empty())
+    {
+        typename std::map<size_t, Hash<T, Policy> >::iterator it = --unverified.end();   //deepest node
+        size_t node = it->first;
+        Hash<T, Policy> unverHash = it->second;
+        unverified.erase(it);
+        verified.push_back(std::make_pair(node, unverHash));
+
+        if (!mktree[node].isEmpty() || node == ROOT)  //reached a known node
+        {
+            if (unverHash != mktree[node])
+                return false;
+
+            continue;
+        }
+
+        Hash<T, Policy> children[K];
+        for (size_t i = 0; i < K; ++i)
+        {
+            size_t sibl = getSibling(node, i);
+            typename std::map<size_t, Hash<T, Policy> >::iterator s = unverified.find(sibl);
+
+            if (sibl == node)
+                children[i] = unverHash;
+            else if (s != unverified.end())
+            {
+                children[i] = s->second;
+                verified.push_back(*s);
+                unverified.erase(s);
+            }
+            else
+                children[i] = mktree[sibl];
+
+            if (children[i].isEmpty())
+                return false;
+        }
+
+        Hash<T, Policy> parentHash = Hash<T, Policy>::combine(children, K);
+        it = unverified.find(getParent(node));
+        if (it != unverified.end() && it->second != parentHash)
+            return false;
+
+        unverified[getParent(node)] = parentHash;
+    }
+
+    //insert hashes into the tree
+    for (size_t i = 0; i < verified.size(); ++i)
+        mktree[verified[i].first] = verified[i].second;
+
+    for (size_t i = 0; i < blockIDs.size(); ++i)
+    {
+        updateTree(blockIDs[i]);
+        pending.erase(blockIDs[i]);
+    }
+    ++version;
+    resolvePending(ROOT);
+
+    return true;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::getChild Return the i-th child of parent node.
  * @param parentNode    Parent node index.
- * @return              Index of right child node.
+ * @param i             Position of the child (0 is the leftmost, K-1 the rightmost).
+ * @return              Index of the child node.
  */
-template<typename T>
-size_t MerkleTree<T>::getRightChild(size_t parentNode)
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::getChild(size_t parentNode, size_t i) const
 {
-    return (2*parentNode + 2);
+    return (K*parentNode + 1 + i);
 }
 
 /**
- * @brief MerkleTree<T>::getParent Return the parent node of a given node.
+ * @brief MerkleTree<T, K, Alloc, Policy>::getParent Return the parent node of a given node.
  * @param childNode Child node index
- * @return          Index of the parent node. Negative value if root node.
+ * @return          Index of the parent node. Not valid for the root node.
  */
-template<typename T>
-size_t MerkleTree<T>::getParent(size_t childNode)
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::getParent(size_t childNode) const
 {
-   return (childNode - 1) / 2;
+   return (childNode - 1) / K;
 }
 
 /**
- * @brief MerkleTree<T>::getSibling Return the sibling node of a given node.
+ * @brief MerkleTree<T, K, Alloc, Policy>::getSibling Return the i-th child of the parent of a
+ *                                                    given node (for i == childOrder(node) it
+ *                                                    is the node itself).
  * @param childNode Give node index.
- * @return          Index of the sibling node. Negative if root node.
+ * @param i         Position of the sibling.
+ * @return          Index of the sibling node. Not valid for the root node.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::getSibling(size_t childNode, size_t i) const
+{
+    return childNode - childOrder(childNode) + i;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::getAunt Return the i-th child of the parent's parent
+ *                                                 of a given node.
+ * @param childNode Given node index.
+ * @param i         Position of the aunt.
+ * @return          Index of aunt node. Not valid for the root node and its children.
  */
-template<typename T>
-size_t MerkleTree<T>::getSibling(size_t childNode)
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::getAunt(size_t childNode, size_t i) const
 {
-    return (childNode % 2) ? childNode + 1 : childNode - 1;
+    return getSibling(getParent(childNode), i);
 }
 
 /**
- * @brief MerkleTree<T>::getAunt Return the parent's sibling of a given node.
+ * @brief MerkleTree<T, K, Alloc, Policy>::childOrder Return the position of a node among the
+ *                                                    children of its parent.
  * @param childNode Given node index.
- * @return          Index of parent's sibling node. Negative if it not exists.
+ * @return          Position in [0, K). Not valid for the root node.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::childOrder(size_t childNode) const
+{
+    return (childNode - 1) % K;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::get_allocator Return the allocator of the node storage.
+ * @return  Copy of the allocator.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+Alloc MerkleTree<T, K, Alloc, Policy>::get_allocator() const
+{
+    return Alloc(alloc);
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::newNodes Allocate storage for n nodes with the
+ *                                                 tree allocator and build them empty.
+ * @param n Number of nodes.
+ * @return  Pointer to the array of nodes.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+Hash<T, Policy>* MerkleTree<T, K, Alloc, Policy>::newNodes(size_t n)
+{
+    Hash<T, Policy>* nodes = NodeTraits::allocate(alloc, n);
+    for (size_t i = 0; i < n; ++i)
+        NodeTraits::construct(alloc, nodes + i);
+
+    return nodes;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::deleteNodes Destroy n nodes and release their
+ *                                                    storage to the tree allocator.
+ * @param nodes Pointer returned by newNodes(n).
+ * @param n     Number of nodes.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+void MerkleTree<T, K, Alloc, Policy>::deleteNodes(Hash<T, Policy>* nodes, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        NodeTraits::destroy(alloc, nodes + i);
+
+    NodeTraits::deallocate(alloc, nodes, n);
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::merge Import every node another tree of the same
+ *                                              torrent knows and this one does not. Node
+ *                                              groups where imported and local hashes meet
+ *                                              (siblings from both trees, or a parent from
+ *                                              the other tree than its children) are
+ *                                              cross-checked, and missing ancestors are
+ *                                              computed, in a single bottom up sweep over
+ *                                              a scratch copy of the tree.
+ * @param other Tree with the same geometry and root hash (the nodes it knows
+ *              are trusted to be consistent with its root).
+ * @return      True if the trees are merged. False (the tree is not modified)
+ *              if the geometries or root hashes differ or the trees contradict
+ *              each other.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+template<typename A2>
+bool MerkleTree<T, K, Alloc, Policy>::merge(const MerkleTree<T, K, A2, Policy>& other)
+{
+    if (numBlocks == 0 || other.depth() != depth() || other.layerSize(0) != layerSize(0))
+        return false;
+
+    if (mktree[ROOT].isEmpty() || mktree[ROOT] != other.getNode(ROOT))
+        return false;
+
+    enum { LOCAL, IMPORTED, COMPUTED, UNKNOWN };
+    std::vector<Hash<T, Policy> > nodes(mktree, mktree + treeSize);
+    std::vector<unsigned char> origin(treeSize, LOCAL);
+    bool imported = false;
+
+    for (size_t i = 0; i < treeSize; ++i)
+    {
+        const Hash<T, Policy>& theirs = other.getNode(i);
+
+        if (nodes[i].isEmpty())
+        {
+            origin[i] = theirs.isEmpty() ? UNKNOWN : IMPORTED;
+            if (!theirs.isEmpty())
+            {
+                nodes[i] = theirs;
+                imported = true;
+            }
+        }
+        else if (!theirs.isEmpty() && theirs != nodes[i])
+            return false;
+    }
+
+    if (!imported)
+        return true;
+
+    for (size_t parent = getParent(treeSize - 1) + 1; parent-- > 0; )
+    {
+        size_t first = getChild(parent, 0);
+        bool complete = true, mixed = false;
+
+        for (size_t i = 0; i < K; ++i)
+        {
+            complete = complete && (origin[first + i] != UNKNOWN);
+            mixed = mixed || (origin[first + i] != origin[first]) || (origin[first + i] == COMPUTED);
+        }
+
+        if (!complete)
+            continue;
+
+        if (origin[parent] == UNKNOWN)
+        {
+            nodes[parent] = Hash<T, Policy>::combine(&nodes[first], K);
+            origin[parent] = COMPUTED;
+        }
+        else if ((mixed || origin[parent] != origin[first]) && Hash<T, Policy>::combine(&nodes[first], K) != nodes[parent])
+            return false;
+    }
+
+    std::copy(nodes.begin(), nodes.end(), mktree);
+    ++version;
+    resolvePending(ROOT);
+
+    return true;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::extractSubtree Copy the subtree under a node into
+ *                                                       a tree of its own (padding and every
+ *                                                       node known included) along with the
+ *                                                       uncle hashes from the node up to the
+ *                                                       root.
+ * @param height    Height of the subtree root (at least 1).
+ * @param index     Position of the subtree root in its layer.
+ * @return          The subtree. Throws a std::runtime_error if there is no
+ *                  such node.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleSubtree<T, K, Alloc, Policy> MerkleTree<T, K, Alloc, Policy>::extractSubtree(size_t height, size_t index) const
+{
+    if (height == 0 || index >= layerSize(height))
+        throw std::runtime_error("Range Error: Invalid Subtree!");
+
+    MerkleSubtree<T, K, Alloc, Policy> subtree(height, index, get_allocator());
+
+    //layer by layer from the subtree root down
+    for (size_t h = height + 1, width = 1; h-- > 0; width *= K)
+        std::copy(mktree + layerStart(h) + index * width, mktree + layerStart(h) + (index + 1) * width,
+                  subtree.tree.mktree + subtree.tree.layerStart(h));
+
+    for (size_t node = layerStart(height) + index; node > ROOT; node = getParent(node))
+        for (size_t i = 0; i < K; ++i)
+            if (getSibling(node, i) != node)
+                subtree.uncles.push_back(mktree[getSibling(node, i)]);
+
+    return subtree;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::emptySubtree Build the subtree under a node of a
+ *                                                     tree of n blocks without the whole
+ *                                                     tree: no hash is known but those of
+ *                                                     the padding blocks (and the nodes
+ *                                                     above them).
+ * @param n         Number of data blocks of the whole tree.
+ * @param height    Height of the subtree root (at least 1).
+ * @param index     Position of the subtree root in its layer.
+ * @param alloc     Allocator of the subtree nodes.
+ * @return          The subtree. Throws a std::runtime_error if there is no
+ *                  such node.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleSubtree<T, K, Alloc, Policy> MerkleTree<T, K, Alloc, Policy>::emptySubtree(size_t n, size_t height, size_t index, const Alloc& alloc)
+{
+    size_t leaves = minGrPow((n > K) ? n : K, K);
+    size_t width = intPow(K, height);
+
+    if (height == 0 || width > leaves || index >= leaves / width)
+        throw std::runtime_error("Range Error: Invalid Subtree!");
+
+    MerkleSubtree<T, K, Alloc, Policy> subtree(height, index, alloc);
+    MerkleTree<T, K, Alloc, Policy>& tree = subtree.tree;
+    std::vector<unsigned char> padHash(Policy::digestSize, 0);
+
+    for (size_t id = (n > subtree.firstBlock()) ? n - subtree.firstBlock() : 0; id < width; ++id)
+    {
+        tree.mktree[tree.block2ind(id)].setHash(padHash);
+        tree.updateTree(id);
+    }
+
+    return subtree;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::importSubtree Graft back a subtree. Its root must
+ *                                                      match the node it stands for or, if
+ *                                                      that node is not known, reduce (with
+ *                                                      the known siblings or the subtree's
+ *                                                      uncles) to the first known ancestor.
+ *                                                      Every node the subtree knows is then
+ *                                                      imported along with the uncles and
+ *                                                      the ancestors computed on the way.
+ * @param subtree   Subtree (e.g. from extractSubtree, completed by another
+ *                  process); the nodes it knows are trusted to be consistent
+ *                  with its root.
+ * @return          True if the subtree is imported. False (the tree is not
+ *                  modified) if it does not match the tree.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+template<typename A2>
+bool MerkleTree<T, K, Alloc, Policy>::importSubtree(const MerkleSubtree<T, K, A2, Policy>& subtree)
+{
+    size_t height = subtree.height;
+    size_t index = subtree.index;
+
+    if (height == 0 || index >= layerSize(height) || subtree.tree.depth() != height)
+        return false;
+
+    std::vector<std::pair<size_t, Hash<T, Policy> > > installs;
+
+    //path from the subtree root up to a known node
+    size_t node = layerStart(height) + index;
+    Hash<T, Policy> unverHash = subtree.tree.getNode(height, 0);
+    size_t uncle = 0;
+
+    while (!unverHash.isEmpty() && mktree[node].isEmpty() && node > ROOT)
+    {
+        installs.push_back(std::make_pair(node, unverHash));
+
+        Hash<T, Policy> children[K];
+        for (size_t i = 0; i < K; ++i)
+        {
+            size_t sibl = getSibling(node, i);
+            if (sibl == node)
+            {
+                children[i] = unverHash;
+                continue;
+            }
+
+            Hash<T, Policy> theirs = (uncle < subtree.uncles.size()) ? subtree.uncles[uncle] : Hash<T, Policy>();
+            ++uncle;
+
+            if (!mktree[sibl].isEmpty() && !theirs.isEmpty() && mktree[sibl] != theirs)
+                return false;
+
+            children[i] = mktree[sibl].isEmpty() ? theirs : mktree[sibl];
+            if (mktree[sibl].isEmpty())
+                installs.push_back(std::make_pair(sibl, theirs));
+        }
+
+        for (size_t i = 0; i < K; ++i)
+            if (children[i].isEmpty())
+                return false;
+
+        unverHash = Hash<T, Policy>::combine(children, K);
+        node = getParent(node);
+    }
+
+    if (unverHash.isEmpty())
+        return false;
+
+    if (!mktree[node].isEmpty() && mktree[node] != unverHash)
+        return false;
+
+    if (mktree[node].isEmpty()) //unknown root: accepted as is
+        installs.push_back(std::make_pair(node, unverHash));
+
+    //nodes of the subtree, layer by layer from its root down
+    for (size_t h = height + 1, width = 1; h-- > 0; width *= K)
+    {
+        for (size_t i = 0; i < width; ++i)
+        {
+            const Hash<T, Policy>& theirs = subtree.tree.getNode(h, i);
+            size_t ind = layerStart(h) + index * width + i;
+
+            if (theirs.isEmpty())
+                continue;
+
+            if (!mktree[ind].isEmpty() && mktree[ind] != theirs)
+                return false;
+
+            installs.push_back(std::make_pair(ind, theirs));
+        }
+    }
+
+    for (size_t i = 0; i < installs.size(); ++i)
+        if (!installs[i].second.isEmpty())
+            mktree[installs[i].first] = installs[i].second;
+
+    ++version;
+    resolvePending(ROOT);
+
+    return true;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::getNumBlocks Return the number of data blocks.
+ * @return  Number of blocks the tree was built for (padding blocks excluded).
  */
-template<typename T>
-size_t MerkleTree<T>::getAunt(size_t childNode)
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::getNumBlocks() const
 {
-    return getSibling(getParent(childNode));
+    return numBlocks;
 }
 
 /**
- * @brief MerkleTree<T>::block2ind Return the Merkle Tree node index
- *                                 corresponding to the data block's hash.
+ * @brief MerkleTree<T, K, Alloc, Policy>::depth Return the number of levels below the root.
+ * @return  log_K of the number of leaves (blocks plus padding blocks).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::depth() const
+{
+    size_t levels = 0;
+    for (size_t leaves = numBlocks + numPads; leaves > 1; leaves /= K)
+        ++levels;
+
+    return levels;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::generation Return the number of modifications of
+ *                                                    the tree nodes (block added or verified,
+ *                                                    layer installed, root hash assigned).
+ * @return  Counter that changes whenever any node of the tree changes.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::generation() const
+{
+    return version;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::id Return the identifier of the tree.
+ * @return  Identifier unique among the trees of the process (never reused, unlike
+ *          the tree address).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::id() const
+{
+    return treeId;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::addPending Keep a block pending until it can be checked
+ *                                                   against known nodes (alone or combined with
+ *                                                   other pending blocks), then add it to the
+ *                                                   tree and report it through the pending
+ *                                                   callback.
+ * @param blockID   ID of the block.
+ * @param blockHash Hash of the block.
+ * @return          True if the block is verified right away (the callback is
+ *                  called as well). False if it is pending or rejected. Throws
+ *                  a std::runtime_error exception if no block-id in the tree.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleTree<T, K, Alloc, Policy>::addPending(size_t blockID, const Hash<T, Policy>& blockHash)
+{
+    if (blockID >= numBlocks)
+        throw std::runtime_error("Range Error: Invalid Block ID!");
+
+    size_t node = block2ind(blockID);
+    pending[blockID] = blockHash;
+
+    //nothing to do until every sibling of the block is known or pending
+    for (size_t i = 0; i < K; ++i)
+    {
+        size_t sibl = getSibling(node, i);
+        if (sibl != node && mktree[sibl].isEmpty() && !pending.count(sibl - block2ind(0)))
+            return false;
+    }
+
+    resolvePending(node);
+
+    return !pending.count(blockID) && mktree[node] == blockHash;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::setPendingCallback Set the function called for every
+ *                                                           pending block once its path is known.
+ * @param callback  Called as callback(blockID, verified); verified is false if
+ *                  the block hash does not match (the block is dropped).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+void MerkleTree<T, K, Alloc, Policy>::setPendingCallback(const std::function<void(size_t, bool)>& callback)
+{
+    onPending = callback;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::pendingSize Return the number of pending blocks.
+ * @return  Number of blocks waiting for their path to be known.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::pendingSize() const
+{
+    return pending.size();
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::layerStart Return the index of the first node
+ *                                                   of a layer.
+ * @param height    Height of the layer (0 is the leaf layer, depth the root).
+ * @return          Index in mktree of the leftmost node of the layer.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::layerStart(size_t height) const
+{
+    //nodes above a layer of width w: (w - 1) / (K - 1)
+    return (layerSize(height) - 1) / (K - 1);
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::block2ind Return the Merkle Tree node index
+ *                                                   corresponding to the data block's hash.
  * @param blockID   ID of data block.
  * @return          Merkle Tree node index corresponding to hash of block blockID.
  */
-template<typename T>
-size_t MerkleTree<T>::block2ind(size_t blockID)
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::block2ind(size_t blockID) const
 {
-    return (numBlocks + numPads - 1) + blockID;
+    return (treeSize - (numBlocks + numPads)) + blockID;
 }
 
 /**
- * @brief MerkleTree<T>::pad Set hash of padding blocks; also update hashes of
- *                           descendents, if possible
+ * @brief MerkleTree<T, K, Alloc, Policy>::pad Set hash of padding blocks; also update hashes of
+ *                                             descendents, if possible
  */
-template<typename T>
-void MerkleTree<T>::pad()
+template<typename T, size_t K, typename Alloc, typename Policy>
+void MerkleTree<T, K, Alloc, Policy>::pad()
 {
-    std::vector<unsigned char> padHash(32, 0);
+    std::vector<unsigned char> padHash(Policy::digestSize, 0);
 
-    for (int id = numBlocks; id < (numBlocks + numPads); ++id)
+    for (size_t id = numBlocks; id < (numBlocks + numPads); ++id)
     {
         mktree[block2ind(id)].setHash(padHash);
         updateTree(id);
@@ -360,43 +1364,189 @@ void MerkleTree<T>::pad()
 }
 
 /**
- * @brief MerkleTree<T>::updateTree Calculate descendent hashes after adding block,
- *                                  if possible.
+ * @brief MerkleTree<T, K, Alloc, Policy>::updateTree Calculate descendent hashes after adding block,
+ *                                                    if possible.
  * @param blockID   ID of added data block.
+ * @return          Highest node whose hash was set (the block's leaf if none).
  */
-template<typename T>
-void MerkleTree<T>::updateTree(size_t blockID)
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleTree<T, K, Alloc, Policy>::updateTree(size_t blockID)
 {
     bool missing = false;
-    int node = block2ind(blockID);
+    size_t node = block2ind(blockID);
 
     while (!missing && (node > ROOT))
     {
-        size_t child1 = node;
-        size_t child2 = getSibling(node);
+        size_t first = getSibling(node, 0);
+
+        for (size_t i = 0; i < K; ++i)
+            if (mktree[first + i].isEmpty())    //if a hash is missing...
+                missing = true;                 //stop update
+
+        if (!missing)                                                   //else...
+            mktree[node = getParent(node)] = Hash<T, Policy>::combine(mktree + first, K); //->update parent node hash
+    }
+
+    return node;
+}
+
+/**
+ * @brief MerkleTree<T, K, Alloc, Policy>::resolvePending Verify the pending blocks whose
+ *                                                        verification may involve a newly
+ *                                                        installed node: those under its
+ *                                                        lowest known ancestor. Hashes of
+ *                                                        pending blocks are combined bottom
+ *                                                        up (pending siblings together) until
+ *                                                        a known node; blocks reaching a
+ *                                                        matching node are verified and their
+ *                                                        hashes installed, those reaching a
+ *                                                        different one are dropped. Nodes
+ *                                                        installed meanwhile (e.g. by the
+ *                                                        callback) are processed in turn.
+ * @param node  Highest newly installed node (ROOT stands for the whole tree).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+void MerkleTree<T, K, Alloc, Policy>::resolvePending(size_t node)
+{
+    if (pending.empty())
+        return;
+
+    dirtyNodes.push_back(node);
+    if (resolving)  //called back from below
+        return;
+
+    resolving = true;
+    while (!dirtyNodes.empty() && !pending.empty())
+    {
+        size_t top = (dirtyNodes.back() == ROOT) ? ROOT : getParent(dirtyNodes.back());
+        dirtyNodes.pop_back();
+
+        while (top != ROOT && mktree[top].isEmpty())
+            top = getParent(top);
+
+        //pending blocks under top
+        size_t leaves = block2ind(0);
+        size_t first = top;
+        size_t last = top;
+        while (first < leaves)
+        {
+            first = getChild(first, 0);
+            last = getChild(last, K - 1);
+        }
+
+        std::map<size_t, Hash<T, Policy> > computed;    //hashes not combined yet (deepest node last)
+        std::map<size_t, Hash<T, Policy> > values;      //every computed hash
+        std::map<size_t, std::vector<size_t> > below;   //computed nodes each computed hash depends on
+        typename std::map<size_t, Hash<T, Policy> >::iterator it;
+
+        std::vector<size_t> verified, rejected;
+        bool installed = false;
+
+        for (it = pending.lower_bound(first - leaves); it != pending.upper_bound(last - leaves); ++it)
+        {
+            size_t leaf = block2ind(it->first);
+
+            if (!mktree[leaf].isEmpty())    //e.g. installed from a proof
+                (it->second == mktree[leaf] ? verified : rejected).push_back(it->first);
+            else
+            {
+                computed[leaf] = values[leaf] = it->second;
+                below[leaf].push_back(leaf);
+            }
+        }
 
-        size_t lftChild = std::min(child1, child2);
-        size_t rgtChild = std::max(child1, child2);
+        while (!computed.empty())
+        {
+            it = --computed.end();
+            size_t unverNode = it->first;
+            Hash<T, Policy> unverHash = it->second;
+            std::vector<size_t> group;
+            group.swap(below[unverNode]);
+            computed.erase(it);
+
+            if (!mktree[unverNode].isEmpty())   //reached a known node
+            {
+                bool match = (unverHash == mktree[unverNode]);
+                for (size_t i = 0; i < group.size(); ++i)
+                {
+                    if (match && group[i] != unverNode)
+                    {
+                        mktree[group[i]] = values[group[i]];
+                        installed = true;
+                    }
+
+                    if (group[i] >= leaves)
+                        (match ? verified : rejected).push_back(group[i] - leaves);
+                }
+
+                continue;
+            }
+
+            if (unverNode == ROOT)
+                continue;
+
+            Hash<T, Policy> children[K];
+            bool complete = true;
+            for (size_t i = 0; i < K; ++i)
+            {
+                size_t sibl = getSibling(unverNode, i);
+
+                if (sibl == unverNode)
+                    children[i] = unverHash;
+                else if ((it = computed.find(sibl)) != computed.end())
+                {
+                    children[i] = it->second;
+                    group.insert(group.end(), below[sibl].begin(), below[sibl].end());
+                    computed.erase(it);
+                }
+                else if ((children[i] = mktree[sibl]).isEmpty())
+                    complete = false;   //the blocks stay pending
+            }
 
-        Hash<T> h1 = mktree[lftChild];
-        Hash<T> h2 = mktree[rgtChild];
+            if (complete)
+            {
+                size_t parent = getParent(unverNode);
+                computed[parent] = values[parent] = Hash<T, Policy>::combine(children, K);
+                group.push_back(parent);
+                below[parent].swap(group);
+            }
+        }
+
+        std::sort(verified.begin(), verified.end());
+        std::sort(rejected.begin(), rejected.end());
+
+        for (size_t i = 0; i < verified.size(); ++i)
+            pending.erase(verified[i]);
+
+        for (size_t i = 0; i < rejected.size(); ++i)
+            pending.erase(rejected[i]);
+
+        if (installed)
+            ++version;
+
+        if (onPending)
+        {
+            for (size_t i = 0; i < verified.size(); ++i)
+                onPending(verified[i], true);
 
-        if (h1.isEmpty() || h2.isEmpty())   //if a hash is missing...
-            missing = true;                 //stop update
-        else                                            //else...
-            mktree[node = getParent(node)] = h1 + h2;   //->update parent node hash
+            for (size_t i = 0; i < rejected.size(); ++i)
+                onPending(rejected[i], false);
+        }
     }
+
+    dirtyNodes.clear();
+    resolving = false;
 }
 
 /**
- * @brief MerkleTree<T>::swap Swap the value of two Merkle Trees.
+ * @brief MerkleTree<T, K, Alloc, Policy>::swap Swap the value of two Merkle Trees.
  * @param x First Merkle Tree.
  * @param y Second Merkle Tree.
  */
-template<typename T>
-void MerkleTree<T>::swap(MerkleTree<T>& x, MerkleTree<T>& y)
+template<typename T, size_t K, typename Alloc, typename Policy>
+void MerkleTree<T, K, Alloc, Policy>::swap(MerkleTree<T, K, Alloc, Policy>& x, MerkleTree<T, K, Alloc, Policy>& y)
 {
-    Hash<T>* treePtr;
+    Hash<T, Policy>* treePtr;
     size_t aux;
 
     treePtr  = x.mktree;
@@ -413,38 +1563,112 @@ void MerkleTree<T>::swap(MerkleTree<T>& x, MerkleTree<T>& y)
 
     aux = x.treeSize;
     x.treeSize = y.treeSize;
-    y.treeSize = x.treeSize;
+    y.treeSize = aux;
+
+    aux = x.version;
+    x.version = y.version;
+    y.version = aux;
+
+    aux = x.treeId;
+    x.treeId = y.treeId;
+    y.treeId = aux;
+
+    x.pending.swap(y.pending);
+    x.onPending.swap(y.onPending);
+
+    std::swap(x.alloc, y.alloc);
 }
 
 /**
- * @brief MerkleTree<T>::operator = Class asignment operator. Set the tree to be a
- *                                  copy of the right hand side merkle tree.
+ * @brief MerkleTree<T, K, Alloc, Policy>::operator = Class asignment operator. Set the tree to be a
+ *                                                    copy of the right hand side merkle tree.
+ *                                                    Pending blocks are dropped (they were to be
+ *                                                    verified against the old nodes); the pending
+ *                                                    callback of this tree is kept.
  * @param rhs   Right hand side operand. The copied tree.
  * @return      Reference to the copy tree (this).
  */
-template<typename T>
-MerkleTree<T>& MerkleTree<T>::operator=(MerkleTree<T> rhs)
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleTree<T, K, Alloc, Policy>& MerkleTree<T, K, Alloc, Policy>::operator=(MerkleTree<T, K, Alloc, Policy> rhs)
 {
     if (this != &rhs)   //it is no self-assignment
     {
-        if (treeSize < rhs.treeSize)    //there is not enough space at dest.
+        if (treeSize != rhs.treeSize)   //the storage has not the right size
         {
-            delete [] mktree;                       //free up the old space
-            mktree = new Hash<T> [rhs.treeSize];    //allocate new space
+            deleteNodes(mktree, treeSize);          //free up the old space
+            mktree = newNodes(rhs.treeSize);        //allocate new space
         }
 
         //copy right hand side data
-        for (int i = 0; i < rhs.treeSize; ++i)
+        for (size_t i = 0; i < rhs.treeSize; ++i)
             mktree[i] = rhs.mktree[i];
 
         treeSize = rhs.treeSize;
         numBlocks = rhs.numBlocks;
         numPads = rhs.numPads;
+        pending.clear();
+        ++version;
     }
 
     return *this;
 }
 
+/**
+ * @brief MerkleSubtree<T, K, Alloc, Policy>::MerkleSubtree Class constructor. Builds a subtree
+ *                                                          without any hash.
+ * @param height    Height of the subtree root in the whole tree.
+ * @param index     Position of the subtree root in its layer.
+ * @param alloc     Allocator of the subtree nodes.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+MerkleSubtree<T, K, Alloc, Policy>::MerkleSubtree(size_t height, size_t index, const Alloc& alloc)
+    : height(height), index(index), tree(intPow(K, height), alloc)
+{
+}
+
+/**
+ * @brief MerkleSubtree<T, K, Alloc, Policy>::firstBlock Return the ID in the whole tree of
+ *                                                      the first block of the subtree.
+ * @return  index * K^height.
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+size_t MerkleSubtree<T, K, Alloc, Policy>::firstBlock() const
+{
+    return index * tree.layerSize(0);
+}
+
+/**
+ * @brief MerkleSubtree<T, K, Alloc, Policy>::checkRoot Tell whether the subtree root hash and
+ *                                                      the uncle hashes reduce to the root hash
+ *                                                      of the whole tree.
+ * @param rootHash  Root hash of the whole tree.
+ * @return          True if they do. False otherwise (or if a hash is missing).
+ */
+template<typename T, size_t K, typename Alloc, typename Policy>
+bool MerkleSubtree<T, K, Alloc, Policy>::checkRoot(const Hash<T, Policy>& rootHash) const
+{
+    if (uncles.size() % (K - 1))
+        return false;
+
+    Hash<T, Policy> unverHash = tree.getNode(height, 0);
+    size_t pos = index;
+
+    for (size_t i = 0; i < uncles.size(); i += K - 1, pos /= K)
+    {
+        Hash<T, Policy> children[K];
+        for (size_t j = 0, k = 0; j < K; ++j)
+            children[j] = (j == pos % K) ? unverHash : uncles[i + k++];
+
+        for (size_t j = 0; j < K; ++j)
+            if (children[j].isEmpty())
+                return false;
+
+        unverHash = Hash<T, Policy>::combine(children, K);
+    }
+
+    return pos == 0 && !rootHash.isEmpty() && unverHash == rootHash;
+}
+
 /**
  * @brief operator << Overload ostream operator. Writes the Merkle Tree to an
  *                    output stream.
@@ -452,10 +1676,10 @@ MerkleTree<T>& MerkleTree<T>::operator=(MerkleTree<T> rhs)
  * @param t     Merkle Tree writed to the stream
  * @return      std::stream after the tree has been writed out.
  */
-template<typename U>
-std::ostream& operator<<(std::ostream& os, const MerkleTree<U>& t)
+template<typename U, size_t L, typename A, typename P>
+std::ostream& operator<<(std::ostream& os, const MerkleTree<U, L, A, P>& t)
 {
-    for (int i = 0; i < t.treeSize; ++i)
+    for (size_t i = 0; i < t.treeSize; ++i)
         os << i << ":" << t.mktree[i] << std::endl;
 
     return os;
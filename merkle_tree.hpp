@@ -3,44 +3,97 @@
 
 #include <iostream>
 #include <string>
+#include <atomic>
 #include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include "hash.hpp"
 
-template <typename T>
+// outcome of a block verification (see MerkleTree::verifyBlock)
+struct VerifyResult
+{
+  enum Status
+  {
+    VERIFIED,
+    BAD_BLOCK_ID, // no such block in the tree
+    BAD_PROOF_SIZE, // the proof has not proofSize() hashes
+    EMPTY_HASH, // the block hash or proof entry proofEntry is empty
+    BLOCK_MISMATCH, // the block hash differs from the (verified) one the tree stores
+    PROOF_MISMATCH, // proof entry proofEntry differs from the (verified) sibling node the tree stores
+    NODE_MISMATCH, // the hash computed at height level differs from the stored node: the block or
+                   // a proof entry below level (not known to the tree) is wrong
+    INCOMPLETE // node is not known by the tree (a sibling or ancestor, or the root hash)
+  };
+
+  static const size_t npos = (size_t)-1;
+
+  Status status;
+  size_t level; // height at which the hashes diverged (0 is the leaf layer; npos if not applicable)
+  size_t proofEntry; // index in the proof of the wrong entry (npos if not applicable)
+  size_t node; // stored node (array layout) that disagreed or is missing (npos if not applicable)
+
+  VerifyResult() : status(VERIFIED), level(npos), proofEntry(npos), node(npos) {}
+
+  // record a failure; return false (the verification result)
+  bool fail(Status s, size_t lv = npos, size_t entry = npos, size_t n = npos)
+  {
+    status = s;
+    level = lv;
+    proofEntry = entry;
+    node = n;
+    return false;
+  }
+};
+
+template <typename T, size_t K, typename Alloc, typename Policy>
+struct MerkleSubtree;
+
+// K is the arity of the tree (number of children per internal node): 2, 4, 8 or 16
+// Alloc is the allocator of the node storage (rebound to Hash<T, Policy>)
+// Policy is the digest algorithm of the node hashes (see hash_policy.hpp)
+template <typename T, size_t K = 2, typename Alloc = std::allocator<Hash<T> >,
+          typename Policy = Sha256Policy>
 class MerkleTree
 {
+  static_assert((K >= 2) && ((K & (K - 1)) == 0), "MerkleTree arity must be a power of two");
+
 public:
   // Constructor: default...shouldn't ever be called directly by user
   MerkleTree();
-  
+
   // Constructor: empty tree without root hash large enough to accomodate n blocks
-  MerkleTree(size_t n);
-  
+  MerkleTree(size_t n, const Alloc& alloc = Alloc());
+
   // Constructor: empty tree with root hash large enough to accomodate n blocks
-  MerkleTree(size_t n, const Hash<T>& rootHash);
-  
+  MerkleTree(size_t n, const Hash<T, Policy>& rootHash, const Alloc& alloc = Alloc());
+
   // Destructor
   ~MerkleTree();
 
-  // copy constructor
-  MerkleTree(const MerkleTree<T>& x);
-  
-  // copy assignment
-  MerkleTree<T>& operator=(MerkleTree<T> x);
+  // copy constructor: copies the nodes only (the copy has no pending blocks and no pending callback)
+  MerkleTree(const MerkleTree<T, K, Alloc, Policy>& x);
+
+  // copy assignment: copies the nodes only (pending blocks are dropped, the pending callback is kept)
+  MerkleTree<T, K, Alloc, Policy>& operator=(MerkleTree<T, K, Alloc, Policy> x);
 
   //for copy-swap idiom
-  void swap(MerkleTree<T>& x, MerkleTree<T>& y);
+  void swap(MerkleTree<T, K, Alloc, Policy>& x, MerkleTree<T, K, Alloc, Policy>& y);
 
   //overload ostream operator (useful for debug)
-  template <typename U>
-  friend std::ostream& operator<<(std::ostream& os,const MerkleTree<U>& t);
+  template <typename U, size_t L, typename A, typename P>
+  friend std::ostream& operator<<(std::ostream& os,const MerkleTree<U, L, A, P>& t);
+
+  // return the allocator of the node storage
+  Alloc get_allocator() const;
 
   // assign root hash of Merkle Tree
-  void setRootHash(const Hash<T>& rootHash);
-  
+  void setRootHash(const Hash<T, Policy>& rootHash);
+
   // return root hash to user
-  Hash<T> getRootHash();
+  Hash<T, Policy> getRootHash();
 
   // add data block number blockID to the tree (calculate descendent hashes if possible)
   // return range_error if not block-id not in tree
@@ -49,37 +102,185 @@ public:
   // same as above but block data is in array form (size is the number of bytes in block)
   bool addBlock(size_t blockID, const unsigned char* block, size_t size);
 
+  // same as above but block data is split in n segments (hashed in order, without joining them)
+  bool addBlock(size_t blockID, const HashSegment segments[], size_t n);
+
+  // same as above but the hash of the block is given (e.g. by a PieceHasher, as the data arrived)
+  // return runtime_error if the hash is empty
+  bool addBlock(size_t blockID, const Hash<T, Policy>& blockHash);
+
   // verify integrity of block (use sibling and descendents if hash of block isn't in the tree)
   // if block is verified add hash to tree and calculate descendent hashes, if necessary
-  bool verifyBlock(size_t blockID, const Hash<T>& blockHash);
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash);
+
+  // same as above, reporting in result why the verification fails
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, VerifyResult& result);
 
   // verify integrity of block using attached list of sibling and descendent hashes (if hash of block isn't in the tree)
   // if block is verified add hash to tree and incorporate sibling/descendent hashes, if necessary
-  // hashList contains (in order) hashes for block's sibling and all descendents' hashes up until root node (size is
-  // number of hashes in hashList; i.e., number of hashes in in hashList)
-  bool verifyBlock(size_t blockID, const Hash<T>& blockHash, const Hash<T> hashList[], size_t size);
-    
+  // hashList contains (in order) hashes for block's siblings (K-1 per level, in node order) and all descendents'
+  // siblings up until root node (size is number of hashes in hashList; i.e., (K-1) * depth of the tree)
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Hash<T, Policy> hashList[], size_t size);
+
+  // same as above, reporting in result why the verification fails (the first wrong hash: the block,
+  // a proof entry or, if neither can be told, the height at which the computed hash diverged)
+  bool verifyBlock(size_t blockID, const Hash<T, Policy>& blockHash, const Hash<T, Policy> hashList[], size_t size,
+                   VerifyResult& result);
+
+  // number of hashes in a verification proof (hashList) for any block of the tree
+  size_t proofSize() const;
+
+  // fill hashList with the proof of block blockID in the format expected by verifyBlock
+  // return false if the tree does not know every sibling along the path
+  bool getProof(size_t blockID, Hash<T, Policy> hashList[], size_t size) const;
+
+  // number of hashes in the layer at the given height (0 is the leaf layer; padding included)
+  size_t layerSize(size_t height) const;
+
+  // copy the whole layer at the given height into layer (layerSize(height) hashes)
+  // return range_error if there is no such layer
+  void getLayer(size_t height, Hash<T, Policy> layer[]) const;
+
+  // install the layer at the given height (e.g. a BEP 52 piece layer) if it reduces to the root hash
+  // (accepted as is if the tree has no root hash yet) and compute every node above it
+  // layer holds the first size hashes of the layer; the rest (padding) must be known by the tree
+  // known nodes below a layer node that changes are dropped
+  bool setLayer(size_t height, const Hash<T, Policy> layer[], size_t size);
+
+  // hash the leaf layer in place with fill(leaves, getNumBlocks()) (e.g. straight from a file) and install it
+  // as setLayer(0, ...) does; if fill returns false or the root does not match, the leaves are restored
+  bool fillLeaves(const std::function<bool(Hash<T, Policy>[], size_t)>& fill);
+
+  // node index of the layer at the given height (no copy; empty hash if the tree does not know it)
+  // return range_error if there is no such node
+  const Hash<T, Policy>& getNode(size_t height, size_t index) const;
+
+  // node number node of the tree (array layout: root is node 0, children of node p are K*p+1 to K*p+K)
+  // return range_error if there is no such node
+  const Hash<T, Policy>& getNode(size_t node) const;
+
+  // nodes (array layout, ascending) whose hashes the tree still needs to verify blocks blockIDs:
+  // siblings along the blocks' paths up to their lowest known ancestors that are neither known
+  // nor computable from the blocks themselves (deduplicated across blocks)
+  // return range_error if not block-id not in tree
+  std::vector<size_t> missingProofNodes(const std::vector<size_t>& blockIDs) const;
+
+  // verify blocks blockIDs at once using the hashes of nodes (e.g. those given by missingProofNodes)
+  // if every block is verified add the blocks and node hashes to the tree and calculate descendent hashes
+  bool verifyBlocks(const std::vector<size_t>& blockIDs, const std::vector<Hash<T, Policy> >& blockHashes,
+                    const std::vector<size_t>& nodes, const std::vector<Hash<T, Policy> >& nodeHashes);
+
+  // keep block blockID (hash blockHash) pending until it can be verified against known nodes (together
+  // with other pending blocks, e.g. its siblings), then add it to the tree and report it through the
+  // pending callback; return true if verified right away
+  bool addPending(size_t blockID, const Hash<T, Policy>& blockHash);
+
+  // callback(blockID, verified) is called for every pending block once it can be checked
+  // (verified is false if it does not match, alone or with the pending blocks combined with it; it is dropped)
+  void setPendingCallback(const std::function<void(size_t, bool)>& callback);
+
+  // number of blocks waiting for their path to be known
+  size_t pendingSize() const;
+
+  // import every node that other (same geometry and root hash) knows and this tree does not; where nodes of
+  // both trees meet the hashes are cross-checked, then missing ancestors are computed once
+  // the other tree is trusted to hold only nodes consistent with its root (as verifyBlock keeps them)
+  // return false (this tree is not modified) if the trees differ in geometry or root or contradict each other
+  template <typename A2>
+  bool merge(const MerkleTree<T, K, A2, Policy>& other);
+
+  // copy the subtree under node index of the layer at height (at least 1) into a tree of its own, with the
+  // uncle hashes from that node up to the root (e.g. to verify a shard of the blocks in another process)
+  // return range_error if there is no such node
+  MerkleSubtree<T, K, Alloc, Policy> extractSubtree(size_t height, size_t index) const;
+
+  // subtree (without any hash but padding) under node index of the layer at height of a tree of n blocks
+  // (e.g. for a worker building its share of a tree without the whole tree)
+  // return range_error if there is no such node
+  static MerkleSubtree<T, K, Alloc, Policy> emptySubtree(size_t n, size_t height, size_t index, const Alloc& alloc = Alloc());
+
+  // graft back a subtree (e.g. completed by another process) if its root matches the node of this tree it
+  // stands for (checked through the uncle hashes if that node is not known); every node it knows is imported
+  // return false (this tree is not modified) if the subtree does not match this tree
+  template <typename A2>
+  bool importSubtree(const MerkleSubtree<T, K, A2, Policy>& subtree);
+
+  // number of levels below the root (height of the root)
+  size_t depth() const;
+
+  // number of data blocks (without padding)
+  size_t getNumBlocks() const;
+
+  // counter bumped whenever a node of the tree changes (lets caches of tree data detect stale entries)
+  size_t generation() const;
+
+  // identifier unique to this tree among every tree built by the process (copies get their own; it follows
+  // the nodes on swap): caches of tree data key on it instead of the tree address, which may be reused
+  size_t id() const;
+
 private:
+  typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Hash<T, Policy> > NodeAlloc;
+  typedef std::allocator_traits<NodeAlloc> NodeTraits;
+
+  // allocator of the node storage
+  NodeAlloc alloc;
   // Array-based implementation of Merkle tree (root node at index zero)
-  // Pointer to an array of Hash<T> objects
-  Hash<T> * mktree;
+  // Pointer to an array of Hash<T, Policy> objects
+  Hash<T, Policy> * mktree;
   // number of nodes (including root) in the tree
   size_t treeSize;
+  // number of modifications of the tree nodes
+  size_t version;
+  // unique identifier of the tree (see id())
+  size_t treeId;
+
+  // unverified blocks (by blockID) waiting for their path to be known
+  std::map<size_t, Hash<T, Policy> > pending;
+  // called for every pending block once its path is known
+  std::function<void(size_t, bool)> onPending;
+  // nodes installed while pending blocks are being resolved (to be processed next)
+  std::vector<size_t> dirtyNodes;
+  bool resolving;
 
   // note: the following provide indices into mktree (i.e., absolute index of node and not with respect to blockID)
-  size_t getLeftChild(size_t parentNode); //left child of parent node
-  size_t getRightChild(size_t parentNode); //right child of parent node
-  size_t getParent(size_t childNode); //parent node
-  size_t getSibling(size_t childNode); //sister node
-  size_t getAunt(size_t childNode);  //parent's sibling
+  size_t getChild(size_t parentNode, size_t i) const; //i-th child of parent node (0 <= i < K)
+  size_t getParent(size_t childNode) const; //parent node
+  size_t getSibling(size_t childNode, size_t i) const; //i-th child of node's parent (may be the node itself)
+  size_t getAunt(size_t childNode, size_t i) const;  //i-th child of parent's parent
+  size_t childOrder(size_t childNode) const; //position of node among its siblings
 
   // NOTE: the following are recommended but not required
   size_t numBlocks; // number of non-padding blocks in the tree
   size_t numPads; // number of padding blocks in the tree
 
-  size_t block2ind(size_t blockID); //convert blockID to index of block's hash in mktree
+  Hash<T, Policy>* newNodes(size_t n); //allocate and construct n (empty) nodes
+  void deleteNodes(Hash<T, Policy>* nodes, size_t n); //destroy and deallocate n nodes
+  size_t layerStart(size_t height) const; //index of first node of the layer at height
+  size_t block2ind(size_t blockID) const; //convert blockID to index of block's hash in mktree
   void pad(); //set hash of padding blocks; also update hashes of descendents, if possible
-  void updateTree(size_t blockID); //calculate descendent hashes after adding block, if necessary
+  size_t updateTree(size_t blockID); //calculate descendent hashes after adding block, if necessary; return highest updated node
+  void resolvePending(size_t node); //verify pending blocks whose verification may involve node
+};
+
+// self-contained slice of a tree (see MerkleTree::extractSubtree): the subtree under node index of the layer
+// at height, as a tree of its own, and the uncle hashes from that node up to the root of the whole tree
+template <typename T, size_t K = 2, typename Alloc = std::allocator<Hash<T> >,
+          typename Policy = Sha256Policy>
+struct MerkleSubtree
+{
+  size_t height; // height of the subtree root in the whole tree
+  size_t index; // position of the subtree root in its layer
+  MerkleTree<T, K, Alloc, Policy> tree; // block i of the subtree is block firstBlock() + i of the whole tree
+  std::vector<Hash<T, Policy> > uncles; // (K-1) per level, in node order, from the subtree root up
+
+  // Constructor: subtree (without any hash) under node index of the layer at height
+  MerkleSubtree(size_t height, size_t index, const Alloc& alloc = Alloc());
+
+  // ID in the whole tree of the first block of the subtree
+  size_t firstBlock() const;
+
+  // whether the subtree root hash and the uncle hashes reduce to rootHash (the root of the whole tree)
+  bool checkRoot(const Hash<T, Policy>& rootHash) const;
 };
 
 #include "merkle_tree.cpp"
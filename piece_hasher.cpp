@@ -0,0 +1,157 @@
+#include "piece_hasher.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+/**
+ * @brief PieceHasher<T, Policy>::PieceHasher Class constructor. Starts the hash of a piece
+ *                                            with no block received.
+ * @param pieceSize Size of the piece in bytes.
+ * @param blockSize Size of the blocks in bytes (the last block of the piece may
+ *                  be shorter). Throws a std::runtime_error if zero.
+ */
+template<typename T, typename Policy>
+PieceHasher<T, Policy>::PieceHasher(size_t pieceSize, size_t blockSize)
+    : pieceSize(pieceSize), blockSize(blockSize), bufferedBytes(0)
+{
+    if (blockSize == 0)
+        throw std::runtime_error("Range Error: Invalid Block Size!");
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::add Take a block of the piece. The next expected block is
+ *                                    hashed at once, followed by the buffered blocks it
+ *                                    makes contiguous; a block further ahead is buffered.
+ * @param offset    Offset of the block in the piece (a multiple of the block size).
+ * @param data      Block data.
+ * @param size      Number of bytes in data (the block size, or what is left of
+ *                  the piece for the last block).
+ * @return          True if the block is taken. False if it does not fit the piece
+ *                  or was already received.
+ */
+template<typename T, typename Policy>
+bool PieceHasher<T, Policy>::add(size_t offset, const unsigned char* data, size_t size)
+{
+    if (offset % blockSize || offset >= pieceSize || size != std::min(blockSize, pieceSize - offset))
+        return false;
+
+    size_t next = hashed();
+    if (offset < next || ahead.count(offset))
+        return false;
+
+    if (offset > next)
+    {
+        ahead[offset].assign(data, data + size);
+        bufferedBytes += size;
+        return true;
+    }
+
+    stream.update(data, size);
+
+    //drain the buffered blocks that now follow the hashed prefix
+    std::map<size_t, std::vector<unsigned char> >::iterator it;
+    while (!ahead.empty() && (it = ahead.begin())->first == hashed())
+    {
+        stream.update(it->second.data(), it->second.size());
+        bufferedBytes -= it->second.size();
+        ahead.erase(it);
+    }
+
+    return true;
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::complete Tell whether every block has been received.
+ * @return  True if the piece hash is known. False otherwise.
+ */
+template<typename T, typename Policy>
+bool PieceHasher<T, Policy>::complete() const
+{
+    return hashed() == pieceSize;
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::hash Return the hash of the piece (only the final padding
+ *                                     is left to compress).
+ * @return  Hash of the piece. Throws a std::runtime_error if some block is missing.
+ */
+template<typename T, typename Policy>
+Hash<T, Policy> PieceHasher<T, Policy>::hash() const
+{
+    if (!complete())
+        throw std::runtime_error("Runtime Error: Incomplete Piece!");
+
+    return Hash<T, Policy>(stream);
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::hashed Return the number of bytes hashed so far.
+ * @return  Size of the in-order prefix of the piece received so far.
+ */
+template<typename T, typename Policy>
+size_t PieceHasher<T, Policy>::hashed() const
+{
+    return (size_t)stream.length();
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::buffered Return the number of bytes buffered.
+ * @return  Bytes of the blocks received ahead of the hashed prefix.
+ */
+template<typename T, typename Policy>
+size_t PieceHasher<T, Policy>::buffered() const
+{
+    return bufferedBytes;
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::reset Start over (e.g. after a failed verification), keeping
+ *                                      the piece and block sizes.
+ */
+template<typename T, typename Policy>
+void PieceHasher<T, Policy>::reset()
+{
+    stream.reset();
+    ahead.clear();
+    bufferedBytes = 0;
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::saveState Checkpoint the hashed prefix of the piece, e.g.
+ *                                          to store it with resume data. Blocks buffered
+ *                                          out of order are not part of it.
+ * @param out   Output buffer (at least SHA256_STATE_MAX_SIZE bytes).
+ * @return      Number of bytes written.
+ */
+template<typename T, typename Policy>
+size_t PieceHasher<T, Policy>::saveState(unsigned char* out) const
+{
+    return stream.saveState(out);
+}
+
+/**
+ * @brief PieceHasher<T, Policy>::loadState Resume from a checkpoint: the blocks before
+ *                                          hashed() need not be read or hashed again.
+ *                                          Buffered blocks are dropped.
+ * @param in    Checkpoint (see saveState).
+ * @param size  Number of bytes in in.
+ * @return      True if resumed. False (the hasher is left as is) if the checkpoint
+ *              is not well formed or its prefix does not end on a block boundary
+ *              of the piece.
+ */
+template<typename T, typename Policy>
+bool PieceHasher<T, Policy>::loadState(const unsigned char* in, size_t size)
+{
+    typename Policy::Stream resumed;
+    if (!resumed.loadState(in, size))
+        return false;
+
+    uint64_t prefix = resumed.length();
+    if (prefix > pieceSize || (prefix % blockSize && prefix != pieceSize))
+        return false;
+
+    stream = resumed;
+    ahead.clear();
+    bufferedBytes = 0;
+
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef _PIECE_HASHER_H_
+#define _PIECE_HASHER_H_
+
+#include <map>
+#include <vector>
+
+#include "hash.hpp"
+#include "hash_policy.hpp"
+
+// incremental hash of one piece being downloaded in blocks (16 KiB by default): blocks that arrive in
+// order are hashed at once, only those ahead of the next expected offset are buffered, so the leaf hash
+// is ready (for MerkleTree::addBlock or verifyBlock) as soon as the last block lands
+template <typename T, typename Policy = Sha256Policy>
+class PieceHasher
+{
+public:
+  // Constructor: piece of pieceSize bytes split in blocks of blockSize bytes (the last one may be shorter)
+  PieceHasher(size_t pieceSize, size_t blockSize = 16384);
+
+  // take the block at offset (a multiple of the block size); return false if it does not fit the piece
+  // (bad offset or size) or was already received
+  bool add(size_t offset, const unsigned char* data, size_t size);
+
+  // whether every block has been received
+  bool complete() const;
+
+  // hash of the piece
+  // return runtime_error if not complete
+  Hash<T, Policy> hash() const;
+
+  // number of bytes hashed so far (the in-order prefix of the piece)
+  size_t hashed() const;
+
+  // number of bytes buffered (blocks received out of order)
+  size_t buffered() const;
+
+  // start over (same piece geometry)
+  void reset();
+
+  // checkpoint of the hashed prefix (buffered blocks are not included) to out (at least
+  // SHA256_STATE_MAX_SIZE bytes); return number of bytes written
+  // checkpoints need a stream with saveState/loadState (Sha256Policy)
+  size_t saveState(unsigned char* out) const;
+
+  // resume from a checkpoint (blocks are then expected from hashed() on); return false (hasher left as
+  // is) if it is not well formed or does not end on a block boundary of the piece
+  bool loadState(const unsigned char* in, size_t size);
+
+private:
+  size_t pieceSize;
+  size_t blockSize;
+  typename Policy::Stream stream;
+  std::map<size_t, std::vector<unsigned char> > ahead; // out of order blocks by offset
+  size_t bufferedBytes;
+};
+
+#include "piece_hasher.cpp"
+#endif  //_PIECE_HASHER_H_
@@ -0,0 +1,238 @@
+#include "proof_cache.hpp"
+#include <cstring>
+
+/**
+ * @brief ProofCache::ProofCache Class constructor. Builds an empty cache.
+ * @param capacity  Maximum number of bytes of cached messages.
+ * @param numShards Number of independently locked shards.
+ */
+inline ProofCache::ProofCache(size_t capacity, size_t numShards)
+    : shards(new Shard[numShards ? numShards : 1]), numShards(numShards ? numShards : 1),
+      hitCount(0), missCount(0)
+{
+    shardCapacity = capacity / this->numShards;
+    for (size_t i = 0; i < this->numShards; ++i)
+        shards[i].bytes = 0;
+}
+
+/**
+ * @brief ProofCache::encodeHashes Append the hashes message answering a request
+ *                                 to a buffer. A fresh cached message is copied
+ *                                 as is; otherwise the message is built from the
+ *                                 tree and cached.
+ * @param tree  Binary Merkle tree the request is for.
+ * @param req   Request.
+ * @param out   Output buffer.
+ * @return      Number of bytes appended. Zero (nothing appended) if the request
+ *              is not valid or some hash is not known by the tree.
+ */
+template<typename T, typename Alloc, typename Policy>
+size_t ProofCache::encodeHashes(const MerkleTree<T, 2, Alloc, Policy>& tree, const HashRequest& req,
+                                std::vector<unsigned char>& out)
+{
+    Key key;
+    key.tree = tree.id();
+    key.req = req;
+
+    size_t start = out.size();
+    size_t generation = tree.generation();
+    if (lookup(key, generation, out))
+    {
+        ++hitCount;
+        return out.size() - start;
+    }
+
+    ++missCount;
+    size_t bytes = ::encodeHashes(tree, req, out);
+    if (bytes)
+        insert(key, generation, &out[start], bytes);
+
+    return bytes;
+}
+
+/**
+ * @brief ProofCache::clear Drop every cached message.
+ */
+inline void ProofCache::clear()
+{
+    for (size_t i = 0; i < numShards; ++i)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        shards[i].entries.clear();
+        shards[i].index.clear();
+        shards[i].bytes = 0;
+    }
+}
+
+/**
+ * @brief ProofCache::size Return the number of bytes of cached messages.
+ * @return  Bytes of cached messages, in every shard.
+ */
+inline size_t ProofCache::size() const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < numShards; ++i)
+    {
+        std::lock_guard<std::mutex> guard(shards[i].lock);
+        bytes += shards[i].bytes;
+    }
+
+    return bytes;
+}
+
+/**
+ * @brief ProofCache::hits Return the number of requests answered from the cache.
+ * @return  Number of cache hits.
+ */
+inline size_t ProofCache::hits() const
+{
+    return hitCount;
+}
+
+/**
+ * @brief ProofCache::misses Return the number of requests the cache could not
+ *                           answer (no entry or stale entry).
+ * @return  Number of cache misses.
+ */
+inline size_t ProofCache::misses() const
+{
+    return missCount;
+}
+
+/**
+ * @brief ProofCache::Key::operator == Tell whether two keys are the same tree and request.
+ * @param x Other key.
+ * @return  True if both keys are equal. False otherwise.
+ */
+inline bool ProofCache::Key::operator==(const Key& x) const
+{
+    return tree == x.tree && req.baseLayer == x.req.baseLayer && req.index == x.req.index &&
+           req.length == x.req.length && req.proofLayers == x.req.proofLayers &&
+           !std::memcmp(req.piecesRoot, x.req.piecesRoot, 32);
+}
+
+/**
+ * @brief ProofCache::KeyHash::operator () Hash of a key (FNV-1a of the tree id, the
+ *                                         request fields and the pieces root prefix).
+ * @param key   Key.
+ * @return      Hash value.
+ */
+inline size_t ProofCache::KeyHash::operator()(const Key& key) const
+{
+    const size_t words[] = { key.tree, key.req.baseLayer, key.req.index, key.req.length,
+                             key.req.proofLayers };
+
+    size_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+        h = (h ^ words[i]) * 1099511628211ULL;
+
+    for (size_t i = 0; i < 8; ++i)
+        h = (h ^ key.req.piecesRoot[i]) * 1099511628211ULL;
+
+    return h;
+}
+
+/**
+ * @brief ProofCache::lookup Copy the message of a fresh entry to a buffer. A stale
+ *                           entry (older tree generation) is dropped.
+ * @param key           Tree and request.
+ * @param generation    Current generation of the tree.
+ * @param out           Output buffer.
+ * @return              True if a fresh entry was found. False otherwise.
+ */
+inline bool ProofCache::lookup(const Key& key, size_t generation, std::vector<unsigned char>& out)
+{
+    Shard& shard = shards[KeyHash()(key) % numShards];
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end())
+        return false;
+
+    std::list<Entry>::iterator entry = it->second;
+    if (entry->generation != generation)
+    {
+        shard.bytes -= entry->message.size();
+        shard.index.erase(it);
+        shard.entries.erase(entry);
+        return false;
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    out.insert(out.end(), entry->message.begin(), entry->message.end());
+
+    return true;
+}
+
+/**
+ * @brief ProofCache::insert Cache a message, evicting the least recently used
+ *                           entries of its shard until it fits. Messages larger
+ *                           than a shard are not cached.
+ * @param key           Tree and request.
+ * @param generation    Generation of the tree the message was built from.
+ * @param message       Encoded hashes message.
+ * @param size          Number of bytes of message.
+ */
+inline void ProofCache::insert(const Key& key, size_t generation, const unsigned char* message, size_t size)
+{
+    if (size > shardCapacity)
+        return;
+
+    Shard& shard = shards[KeyHash()(key) % numShards];
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())    //another thread cached it meanwhile
+    {
+        shard.bytes -= it->second->message.size();
+        shard.entries.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    while (shard.bytes + size > shardCapacity)
+    {
+        shard.bytes -= shard.entries.back().message.size();
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.generation = generation;
+    entry.message.assign(message, message + size);
+
+    shard.entries.push_front(entry);
+    shard.index[key] = shard.entries.begin();
+    shard.bytes += size;
+}
+
+/**
+ * @brief serveHashRequests Answer every request queued for a peer through a proof
+ *                          cache, appending a hashes message (or a hash reject
+ *                          message) for each one.
+ * @param queue     Requests of the peer (left empty).
+ * @param lookup    Callable: lookup(piecesRoot) returns a pointer to the binary
+ *                  MerkleTree with that root, or null if unknown.
+ * @param out       Output buffer.
+ * @param cache     Cache of hashes messages.
+ * @return          Number of hashes messages appended.
+ */
+template<typename Lookup>
+size_t serveHashRequests(HashRequestQueue& queue, Lookup lookup, std::vector<unsigned char>& out,
+                         ProofCache& cache)
+{
+    std::vector<HashRequest> requests = queue.take();
+    size_t answered = 0;
+
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        auto tree = lookup(requests[i].piecesRoot);
+
+        if (tree && cache.encodeHashes(*tree, requests[i], out))
+            ++answered;
+        else
+            encodeHashReject(requests[i], out);
+    }
+
+    return answered;
+}
@@ -0,0 +1,87 @@
+#ifndef _PROOF_CACHE_H_
+#define _PROOF_CACHE_H_
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "hash_messages.hpp"
+
+// bounded cache of encoded hashes messages (requested hashes plus uncle hashes) for hot pieces
+// entries are keyed by (tree id, request) and tagged with the tree generation they were built from,
+// so any change of the tree makes them stale; the cache is split in shards with a lock each
+// so that threads serving different requests rarely contend
+class ProofCache
+{
+public:
+  // Constructor: cache of at most capacity bytes of messages split in numShards shards
+  ProofCache(size_t capacity, size_t numShards = 16);
+
+  // append the hashes message answering req to out: copied from the cache if there is a fresh
+  // entry, otherwise built from the tree (see encodeHashes) and cached
+  // return number of bytes appended (0 if the tree can not answer; nothing is cached)
+  template <typename T, typename Alloc, typename Policy>
+  size_t encodeHashes(const MerkleTree<T, 2, Alloc, Policy>& tree, const HashRequest& req, std::vector<unsigned char>& out);
+
+  // drop every entry
+  void clear();
+
+  // number of bytes of cached messages
+  size_t size() const;
+
+  // number of requests answered from the cache
+  size_t hits() const;
+
+  // number of requests the cache could not answer
+  size_t misses() const;
+
+private:
+  struct Key
+  {
+    size_t tree; // MerkleTree::id (never reused, unlike the tree address)
+    HashRequest req;
+
+    bool operator==(const Key& x) const;
+  };
+
+  struct KeyHash
+  {
+    size_t operator()(const Key& key) const;
+  };
+
+  struct Entry
+  {
+    Key key;
+    size_t generation; // generation of the tree the message was built from
+    std::vector<unsigned char> message;
+  };
+
+  // LRU list of entries (most recent first) and its index
+  struct Shard
+  {
+    std::mutex lock;
+    std::list<Entry> entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+    size_t bytes;
+  };
+
+  std::unique_ptr<Shard[]> shards;
+  size_t numShards;
+  size_t shardCapacity; // bytes per shard
+  std::atomic<size_t> hitCount;
+  std::atomic<size_t> missCount;
+
+  bool lookup(const Key& key, size_t generation, std::vector<unsigned char>& out); //copy fresh entry to out
+  void insert(const Key& key, size_t generation, const unsigned char* message, size_t size); //cache message
+};
+
+// same as serveHashRequests (see hash_messages.hpp), answering through a proof cache
+template <typename Lookup>
+size_t serveHashRequests(HashRequestQueue& queue, Lookup lookup, std::vector<unsigned char>& out,
+                         ProofCache& cache);
+
+#include "proof_cache.cpp"
+#endif  //_PROOF_CACHE_H_
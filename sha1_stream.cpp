@@ -0,0 +1,171 @@
+#include "sha1_stream.hpp"
+#include <cstring>
+
+//////////////
+inline uint32_t rotl32(uint32_t x, unsigned n)
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+/**
+ * @brief sha1Block SHA-1 compression function: fold one 64-byte block into the state.
+ * @param h Hash state (H0..H4).
+ * @param p Block (64 bytes).
+ */
+inline void sha1Block(uint32_t* h, const unsigned char* p)
+{
+    uint32_t w[80];
+    for (size_t i = 0; i < 16; ++i)
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+               ((uint32_t)p[4 * i + 2] << 8) | (uint32_t)p[4 * i + 3];
+    for (size_t i = 16; i < 80; ++i)
+        w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (size_t i = 0; i < 80; ++i)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+
+        uint32_t temp = rotl32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl32(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+//////////////
+
+/**
+ * @brief Sha1Stream::Sha1Stream Class constructor. Starts the hash of an empty message.
+ */
+inline Sha1Stream::Sha1Stream()
+{
+    reset();
+}
+
+/**
+ * @brief Sha1Stream::reset Start over with an empty message.
+ */
+inline void Sha1Stream::reset()
+{
+    state[0] = 0x67452301;
+    state[1] = 0xefcdab89;
+    state[2] = 0x98badcfe;
+    state[3] = 0x10325476;
+    state[4] = 0xc3d2e1f0;
+    used = 0;
+    bytes = 0;
+}
+
+/**
+ * @brief Sha1Stream::update Feed the next bytes of the message. A partial block
+ *                           left by previous calls is filled first; then every
+ *                           whole block is compressed in place from data and the
+ *                           tail (less than a block) is staged.
+ * @param data  Next bytes of the message.
+ * @param size  Number of bytes in data.
+ */
+inline void Sha1Stream::update(const unsigned char* data, size_t size)
+{
+    bytes += size;
+
+    if (used > 0)
+    {
+        size_t take = (size < 64 - used) ? size : 64 - used;
+        std::memcpy(block + used, data, take);
+        used += take;
+        data += take;
+        size -= take;
+
+        if (used < 64)
+            return;
+
+        sha1Block(state, block);
+        used = 0;
+    }
+
+    for (; size >= 64; data += 64, size -= 64)
+        sha1Block(state, data);
+
+    std::memcpy(block, data, size);
+    used = size;
+}
+
+/**
+ * @brief Sha1Stream::digest Digest of the bytes fed so far. Padding is applied to a
+ *                           copy of the state, so the stream can go on.
+ * @param out   Output buffer (SHA1_DIGEST_SIZE bytes).
+ */
+inline void Sha1Stream::digest(unsigned char* out) const
+{
+    uint32_t h[5];
+    unsigned char last[128];
+    std::memcpy(h, state, sizeof(h));
+    std::memcpy(last, block, used);
+
+    //0x80, zeros and the 64-bit big endian bit length, in one or two blocks
+    size_t padded = (used < 56) ? 64 : 128;
+    last[used] = 0x80;
+    std::memset(last + used + 1, 0, padded - used - 1);
+
+    uint64_t bits = bytes << 3;
+    for (size_t i = 0; i < 8; ++i)
+        last[padded - 1 - i] = (unsigned char)(bits >> (8 * i));
+
+    for (size_t i = 0; i < padded; i += 64)
+        sha1Block(h, last + i);
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        out[4 * i] = (unsigned char)(h[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h[i];
+    }
+}
+
+/**
+ * @brief Sha1Stream::finalize Digest of the bytes fed so far, for one-shot use (the
+ *                             state is small: digest pads a copy at no extra cost).
+ * @param out   Output buffer (SHA1_DIGEST_SIZE bytes).
+ */
+inline void Sha1Stream::finalize(unsigned char* out)
+{
+    digest(out);
+}
+
+/**
+ * @brief Sha1Stream::length Return the number of bytes fed so far.
+ * @return  Length of the message so far.
+ */
+inline uint64_t Sha1Stream::length() const
+{
+    return bytes;
+}
@@ -0,0 +1,41 @@
+#ifndef _SHA1_STREAM_H_
+#define _SHA1_STREAM_H_
+
+#include <cstdint>
+#include <cstddef>
+
+// size of a SHA-1 digest in bytes
+const size_t SHA1_DIGEST_SIZE = 20;
+
+// streaming SHA-1 (v1 piece hashes of BitTorrent), same interface as Sha256Stream: whole blocks are
+// compressed straight from the caller's buffer, only a partial block is staged
+class Sha1Stream
+{
+public:
+  // Constructor: hash of the empty message
+  Sha1Stream();
+
+  // start over (hash of the empty message)
+  void reset();
+
+  // feed the next size bytes of the message
+  void update(const unsigned char* data, size_t size);
+
+  // digest (SHA1_DIGEST_SIZE bytes) of the bytes fed so far; the stream is left as is
+  void digest(unsigned char* out) const;
+
+  // same as digest, for one-shot use: the stream must be reset before more bytes are fed
+  void finalize(unsigned char* out);
+
+  // number of bytes fed so far
+  uint64_t length() const;
+
+private:
+  uint32_t state[5];
+  unsigned char block[64]; // partial block (the first used bytes)
+  size_t used;
+  uint64_t bytes;
+};
+
+#include "sha1_stream.cpp"
+#endif  //_SHA1_STREAM_H_
@@ -0,0 +1,163 @@
+#include "sha256_stream.hpp"
+#include <cstring>
+
+/**
+ * @brief Sha256Stream::Sha256Stream Class constructor. Starts the hash of an empty
+ *                                   message.
+ */
+inline Sha256Stream::Sha256Stream()
+{
+    reset();
+}
+
+/**
+ * @brief Sha256Stream::reset Start over with an empty message.
+ */
+inline void Sha256Stream::reset()
+{
+    std::memcpy(state, picosha2::detail::initial_message_digest, sizeof(state));
+    used = 0;
+    bytes = 0;
+}
+
+/**
+ * @brief Sha256Stream::update Feed the next bytes of the message. A partial block
+ *                             left by previous calls is filled first; then every
+ *                             whole block is compressed in place from data and the
+ *                             tail (less than a block) is staged.
+ * @param data  Next bytes of the message.
+ * @param size  Number of bytes in data.
+ */
+inline void Sha256Stream::update(const unsigned char* data, size_t size)
+{
+    bytes += size;
+
+    if (used > 0)
+    {
+        size_t take = (size < 64 - used) ? size : 64 - used;
+        std::memcpy(block + used, data, take);
+        used += take;
+        data += take;
+        size -= take;
+
+        if (used < 64)
+            return;
+
+        picosha2::detail::hash256_block(state, block, block + 64);
+        used = 0;
+    }
+
+    for (; size >= 64; data += 64, size -= 64)
+        picosha2::detail::hash256_block(state, data, data + 64);
+
+    std::memcpy(block, data, size);
+    used = size;
+}
+
+/**
+ * @brief Sha256Stream::digest Digest of the bytes fed so far. Padding is applied to
+ *                             a copy of the state, so the stream can go on.
+ * @param out   Output buffer (32 bytes).
+ */
+inline void Sha256Stream::digest(unsigned char* out) const
+{
+    picosha2::word_t h[8];
+    unsigned char last[128];
+    std::memcpy(h, state, sizeof(h));
+    std::memcpy(last, block, used);
+
+    //0x80, zeros and the 64-bit big endian bit length, in one or two blocks
+    size_t padded = (used < 56) ? 64 : 128;
+    last[used] = 0x80;
+    std::memset(last + used + 1, 0, padded - used - 1);
+
+    uint64_t bits = bytes << 3;
+    for (size_t i = 0; i < 8; ++i)
+        last[padded - 1 - i] = (unsigned char)(bits >> (8 * i));
+
+    for (size_t i = 0; i < padded; i += 64)
+        picosha2::detail::hash256_block(h, last + i, last + i + 64);
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        out[4 * i] = (unsigned char)(h[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(h[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(h[i] >> 8);
+        out[4 * i + 3] = (unsigned char)h[i];
+    }
+}
+
+/**
+ * @brief Sha256Stream::finalize Digest of the bytes fed so far, for one-shot use (the
+ *                               state is small: digest pads a copy at no extra cost).
+ * @param out   Output buffer (32 bytes).
+ */
+inline void Sha256Stream::finalize(unsigned char* out)
+{
+    digest(out);
+}
+
+/**
+ * @brief Sha256Stream::length Return the number of bytes fed so far.
+ * @return  Length of the message so far.
+ */
+inline uint64_t Sha256Stream::length() const
+{
+    return bytes;
+}
+
+/**
+ * @brief Sha256Stream::saveState Serialize the state of the stream: byte count (64
+ *                                bits big endian), H0..H7 (32 bits big endian) and
+ *                                the partial block (byte count modulo 64 bytes).
+ * @param out   Output buffer (at least SHA256_STATE_MAX_SIZE bytes).
+ * @return      Number of bytes written.
+ */
+inline size_t Sha256Stream::saveState(unsigned char* out) const
+{
+    for (size_t i = 0; i < 8; ++i)
+        out[i] = (unsigned char)(bytes >> (56 - 8 * i));
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        out[8 + 4 * i] = (unsigned char)(state[i] >> 24);
+        out[8 + 4 * i + 1] = (unsigned char)(state[i] >> 16);
+        out[8 + 4 * i + 2] = (unsigned char)(state[i] >> 8);
+        out[8 + 4 * i + 3] = (unsigned char)state[i];
+    }
+
+    std::memcpy(out + 40, block, used);
+
+    return 40 + used;
+}
+
+/**
+ * @brief Sha256Stream::loadState Replace the state of the stream by a serialized
+ *                                one (see saveState), to go on hashing from there.
+ * @param in    Serialized state.
+ * @param size  Number of bytes in in.
+ * @return      True if loaded. False (the stream is left as is) if the size does
+ *              not match the byte count of the state.
+ */
+inline bool Sha256Stream::loadState(const unsigned char* in, size_t size)
+{
+    if (size < 40)
+        return false;
+
+    uint64_t count = 0;
+    for (size_t i = 0; i < 8; ++i)
+        count = (count << 8) | in[i];
+
+    if (size != 40 + count % 64)
+        return false;
+
+    for (size_t i = 0; i < 8; ++i)
+        state[i] = ((picosha2::word_t)in[8 + 4 * i] << 24) | ((picosha2::word_t)in[8 + 4 * i + 1] << 16) |
+                   ((picosha2::word_t)in[8 + 4 * i + 2] << 8) | (picosha2::word_t)in[8 + 4 * i + 3];
+
+    bytes = count;
+    used = size - 40;
+    std::memcpy(block, in + 40, used);
+
+    return true;
+}
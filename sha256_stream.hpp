@@ -0,0 +1,50 @@
+#ifndef _SHA256_STREAM_H_
+#define _SHA256_STREAM_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#include "picosha2.h"
+
+// largest serialized stream state: byte count, H0..H7 and a partial block of up to 63 bytes
+const size_t SHA256_STATE_MAX_SIZE = 8 + 32 + 63;
+
+// streaming SHA-256 with a fixed 64-byte staging block: whole blocks are compressed straight from the
+// caller's buffer, only the bytes of a partial block are staged (no allocation, no growing buffer)
+class Sha256Stream
+{
+public:
+  // Constructor: hash of the empty message
+  Sha256Stream();
+
+  // start over (hash of the empty message)
+  void reset();
+
+  // feed the next size bytes of the message
+  void update(const unsigned char* data, size_t size);
+
+  // digest (32 bytes) of the bytes fed so far; the stream is left as is, so more bytes can follow
+  void digest(unsigned char* out) const;
+
+  // same as digest, for one-shot use: the stream must be reset before more bytes are fed
+  void finalize(unsigned char* out);
+
+  // number of bytes fed so far
+  uint64_t length() const;
+
+  // serialize the state (a checkpoint, e.g. stored with resume data) to out (at least
+  // SHA256_STATE_MAX_SIZE bytes); return number of bytes written
+  size_t saveState(unsigned char* out) const;
+
+  // go on from a serialized state (size bytes); return false (stream left as is) if it is not well formed
+  bool loadState(const unsigned char* in, size_t size);
+
+private:
+  picosha2::word_t state[8];
+  unsigned char block[64]; // partial block (the first used bytes)
+  size_t used;
+  uint64_t bytes;
+};
+
+#include "sha256_stream.cpp"
+#endif  //_SHA256_STREAM_H_
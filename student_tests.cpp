@@ -1,15 +1,35 @@
 #define CATCH_CONFIG_MAIN
 #define CATCH_CONFIG_COLOUR_NONE
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 
 #include "catch.hpp"
 #include "hash.hpp"
 #include "merkle_tree.hpp"
+#include "fixed_merkle_tree.hpp"
+#include "merkle_forest.hpp"
+#include "memory_resource.hpp"
+#include "budgeted_merkle_tree.hpp"
+#include "hash_messages.hpp"
+#include "proof_cache.hpp"
+#include "merkle_diff.hpp"
+#include "distributed_creation.hpp"
+#include "piece_hasher.hpp"
+#include "hybrid_hasher.hpp"
+#include "file_hasher.hpp"
 
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <array>
+#include <deque>
+#include <list>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 TEST_CASE( "Hash<std::string>", "[Hash<T>]" )
 {
@@ -298,3 +318,1807 @@ TEST_CASE( "Merkle Tree Verify Block (2)", "[MerkleTree<T>]" )
     REQUIRE(t.verifyBlock(2, blockHash, hashList, 2) == false);
     REQUIRE(t.verifyBlock(0, Hash<std::string>(str + "H"), hashList, 2) == false);
 }
+
+TEST_CASE( "Merkle Tree Arity", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K> with K = 4 (addBlock, root hash)");
+
+    std::string str = "The quick brown fox jumps over the lazy dog";
+    std::vector<unsigned char> rawPadVec(32, 0);
+    Hash<std::string> padHash;
+    padHash.setHash(rawPadVec);
+
+    Hash<std::string> blockHash(str);
+    Hash<std::string> children[4] = { blockHash, blockHash, blockHash, padHash };
+
+    MerkleTree<std::string, 4> t(3);
+    t.addBlock(0, str);
+    t.addBlock(1, str);
+    t.addBlock(2, str);
+
+    REQUIRE(t.getRootHash() == Hash<std::string>::combine(children, 4));
+    REQUIRE(t.proofSize() == 3);
+
+    //a binary node combines as operator +
+    REQUIRE(Hash<std::string>::combine(children, 2) == (blockHash + blockHash));
+}
+
+TEST_CASE( "Merkle Tree Arity Proofs", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::getProof and verifyBlock with proofs for K = 2, 8, 16");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 37; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string, 2> t2(blocks.size());
+    MerkleTree<std::string, 8> t8(blocks.size());
+    MerkleTree<std::string, 16> t16(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        t2.addBlock(i, blocks[i]);
+        t8.addBlock(i, blocks[i]);
+        t16.addBlock(i, blocks[i]);
+    }
+
+    REQUIRE(t2.proofSize() == 6);
+    REQUIRE(t8.proofSize() == 14);
+    REQUIRE(t16.proofSize() == 30);
+
+    MerkleTree<std::string, 8> empty8(blocks.size(), t8.getRootHash());
+    std::vector<Hash<std::string> > proof(t8.proofSize());
+
+    for (size_t i = 0; i < blocks.size(); i += 5)
+    {
+        REQUIRE(t8.getProof(i, proof.data(), proof.size()));
+        REQUIRE(empty8.verifyBlock(i, Hash<std::string>(blocks[i]), proof.data(), proof.size()));
+        REQUIRE(empty8.verifyBlock(i, Hash<std::string>(blocks[i] + "X"), proof.data(), proof.size()) == false);
+    }
+
+    //verified hashes (and their siblings) are inserted: blocks can now be verified without proof
+    REQUIRE(empty8.verifyBlock(6, Hash<std::string>(blocks[6])));
+    REQUIRE(empty8.verifyBlock(6, Hash<std::string>(blocks[5])) == false);
+
+    MerkleTree<std::string, 16> empty16(blocks.size(), t16.getRootHash());
+    std::vector<Hash<std::string> > proof16(t16.proofSize());
+
+    REQUIRE(t16.getProof(36, proof16.data(), proof16.size()));
+    REQUIRE(empty16.verifyBlock(36, Hash<std::string>(blocks[36]), proof16.data(), proof16.size()));
+    REQUIRE(empty16.verifyBlock(35, Hash<std::string>(blocks[35]), proof16.data(), proof16.size()) == false);
+}
+
+TEST_CASE( "Fixed Merkle Tree", "[FixedMerkleTree<T, N>]" )
+{
+    INFO("Hint: testing FixedMerkleTree<T, N> geometry, addBlock and root hash");
+
+    static_assert(FixedMerkleTree<std::string, 3>::numPads == 1, "3 blocks need 1 pad");
+    static_assert(FixedMerkleTree<std::string, 3>::treeSize == 7, "3 blocks need 7 nodes");
+    static_assert(FixedMerkleTree<std::string, 3>::proofSize == 2, "3 blocks need 2 proof hashes");
+    static_assert(FixedMerkleTree<std::string, 1>::treeSize == 3, "a tree has at least 2 leaves");
+    static_assert(FixedMerkleTree<std::string, 37>::block2ind(0) == 63, "first leaf of a 64 leaves tree");
+    static_assert(sizeof(FixedMerkleTree<std::string, 8>) == 15 * sizeof(Hash<std::string>), "nodes are stored inline");
+
+    std::string str = "The quick brown fox jumps over the lazy dog";
+
+    FixedMerkleTree<std::string, 3> t;
+    t.addBlock(0, str);
+    t.addBlock(1, str);
+    t.addBlock(2, str);
+
+    REQUIRE(t.getRootHash().returnHashString() == std::string("545cf39de35c920380aed7a679c88ff265fde7dd5dd09f207131ae3fc28e247b"));
+    REQUIRE_THROWS(t.addBlock(3, str));
+}
+
+TEST_CASE( "Fixed Merkle Tree Proofs", "[FixedMerkleTree<T, N>]" )
+{
+    INFO("Hint: testing FixedMerkleTree<T, N>::getProof and verifyBlock in an array of trees");
+
+    MerkleTree<std::string> dyn(11);
+    FixedMerkleTree<std::string, 11> seeder;
+    for (size_t i = 0; i < 11; ++i)
+    {
+        dyn.addBlock(i, "block #" + std::to_string(i));
+        seeder.addBlock(i, "block #" + std::to_string(i));
+    }
+
+    REQUIRE(seeder.getRootHash() == dyn.getRootHash());
+
+    std::array<FixedMerkleTree<std::string, 11>, 4> clients;
+    for (size_t i = 0; i < clients.size(); ++i)
+        clients[i].setRootHash(seeder.getRootHash());
+
+    FixedMerkleTree<std::string, 11>::Proof proof;
+    for (size_t i = 0; i < 11; ++i)
+    {
+        REQUIRE(seeder.getProof(i, proof));
+        REQUIRE(clients[i % 4].verifyBlock(i, Hash<std::string>("block #" + std::to_string(i)), proof));
+        REQUIRE(clients[(i + 1) % 4].verifyBlock(i, Hash<std::string>(std::string("bad")), proof) == false);
+    }
+
+    //siblings of verified blocks are known
+    REQUIRE(clients[1].verifyBlock(0, Hash<std::string>(std::string("block #0"))));
+}
+
+TEST_CASE( "Merkle Forest", "[MerkleForest<T>]" )
+{
+    INFO("Hint: testing MerkleForest<T>::addTree, addBlock, roots and clear");
+
+    MerkleForest<std::string> forest;
+    forest.reserve(50, 50 * 51 / 2);
+
+    std::vector<Hash<std::string> > expected;
+    for (size_t n = 1; n <= 50; ++n)
+    {
+        MerkleTree<std::string> t(n);
+        size_t id = forest.addTree(n);
+        REQUIRE(id == n - 1);
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::string block = std::to_string(n) + ":" + std::to_string(i);
+            t.addBlock(i, block);
+            forest.addBlock(id, i, block);
+        }
+        expected.push_back(t.getRootHash());
+    }
+
+    REQUIRE(forest.size() == 50);
+    for (size_t id = 0; id < forest.size(); ++id)
+    {
+        REQUIRE(forest.roots()[id] == expected[id]);
+        REQUIRE(forest.getRootHash(id) == expected[id]);
+    }
+
+    REQUIRE(forest.verifyBlock(9, 3, Hash<std::string>(std::string("10:3"))));
+    REQUIRE(forest.verifyBlock(9, 3, Hash<std::string>(std::string("10:4"))) == false);
+    REQUIRE_THROWS(forest.addBlock(0, 1, std::string("1:1")));
+
+    forest.clear();
+    REQUIRE(forest.size() == 0);
+    REQUIRE_THROWS(forest.getRootHash(0));
+}
+
+TEST_CASE( "Merkle Tree Allocators", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K, Alloc> with MonotonicArena and HugePageResource");
+
+    typedef MerkleTree<std::string, 2, ResourceAllocator<Hash<std::string> > > ArenaTree;
+
+    std::string str = "The quick brown fox jumps over the lazy dog";
+
+    MonotonicArena arena(256);
+    {
+        ArenaTree t1(3, ResourceAllocator<Hash<std::string> >(&arena));
+        t1.addBlock(0, str);
+        t1.addBlock(1, str);
+        t1.addBlock(2, str);
+
+        REQUIRE(t1.getRootHash().returnHashString() == std::string("545cf39de35c920380aed7a679c88ff265fde7dd5dd09f207131ae3fc28e247b"));
+        REQUIRE(arena.bytesAllocated() == 7 * sizeof(Hash<std::string>));
+
+        ArenaTree t2(t1);   //copies draw from the same arena
+        REQUIRE(t2.get_allocator().resource() == &arena);
+        REQUIRE(t2.getRootHash() == t1.getRootHash());
+        REQUIRE(arena.bytesAllocated() == 14 * sizeof(Hash<std::string>));
+    }
+    arena.release();
+    REQUIRE(arena.bytesAllocated() == 0);
+
+    HugePageResource huge;
+    MerkleTree<std::string, 4, ResourceAllocator<Hash<std::string> > > t3(3, ResourceAllocator<Hash<std::string> >(&huge));
+    MerkleTree<std::string, 4> t4(3);
+    for (size_t i = 0; i < 3; ++i)
+    {
+        t3.addBlock(i, str);
+        t4.addBlock(i, str);
+    }
+
+    REQUIRE(t3.getRootHash() == t4.getRootHash());
+    REQUIRE(t3.verifyBlock(1, Hash<std::string>(str)));
+
+    //small allocations go upstream instead of taking a whole huge page
+    MonotonicArena small;
+    HugePageResource mixed(HugePageResource::pageSize, &small);
+    void* p = mixed.allocate(64, 8);
+    REQUIRE(small.bytesAllocated() == 64);
+    mixed.deallocate(p, 64, 8);
+    p = mixed.allocate(HugePageResource::pageSize, 8);
+    REQUIRE(small.bytesAllocated() == 64);
+    mixed.deallocate(p, HugePageResource::pageSize, 8);
+    REQUIRE(huge.upstream() == defaultResource());
+
+    //default-constructed allocators draw from the default resource
+    MerkleTree<std::string, 4, ResourceAllocator<Hash<std::string> > > t5(3);
+    REQUIRE(t5.get_allocator().resource() == defaultResource());
+    for (size_t i = 0; i < 3; ++i)
+        t5.addBlock(i, str);
+    REQUIRE(t5.getRootHash() == t4.getRootHash());
+}
+
+TEST_CASE( "Budgeted Merkle Tree", "[BudgetedMerkleTree<T>]" )
+{
+    INFO("Hint: testing BudgetedMerkleTree<T> resident levels, addBlock, getProof and memoryUsage");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 1000; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> full(blocks.size());
+    //1024 leaves, 10 levels: keep 2 top levels, the leaves and ~1/3 of the middle nodes
+    BudgetedMerkleTree<std::string> budgeted(blocks.size(), 1700 * sizeof(Hash<std::string>), 2, 64);
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        full.addBlock(i, blocks[i]);
+        budgeted.addBlock(i, blocks[i]);
+    }
+
+    REQUIRE(budgeted.getRootHash() == full.getRootHash());
+    REQUIRE(budgeted.isResident(0));
+    REQUIRE(budgeted.isResident(1));
+    REQUIRE(budgeted.isResident(10));
+    REQUIRE(!budgeted.isResident(9));
+    REQUIRE(budgeted.memoryUsage() < 2047 * sizeof(Hash<std::string>));
+
+    std::vector<Hash<std::string> > proof1(full.proofSize());
+    std::vector<Hash<std::string> > proof2(budgeted.proofSize());
+    REQUIRE(proof1.size() == proof2.size());
+    for (size_t i = 0; i < blocks.size(); i += 97)
+    {
+        REQUIRE(full.getProof(i, proof1.data(), proof1.size()));
+        REQUIRE(budgeted.getProof(i, proof2.data(), proof2.size()));
+        REQUIRE(proof1 == proof2);
+    }
+
+    REQUIRE(budgeted.verifyBlock(500, Hash<std::string>(blocks[500])));
+    REQUIRE(budgeted.verifyBlock(500, Hash<std::string>(blocks[501])) == false);
+
+    //a client with only the root verifies blocks with proofs
+    BudgetedMerkleTree<std::string> client(blocks.size(), full.getRootHash(), 0, 1, 256);
+    REQUIRE(client.memoryUsage() < 1100 * sizeof(Hash<std::string>));
+
+    for (size_t i = 0; i < blocks.size(); i += 97)
+    {
+        REQUIRE(full.getProof(i, proof1.data(), proof1.size()));
+        REQUIRE(client.verifyBlock(i, Hash<std::string>(blocks[i]), proof1.data(), proof1.size()));
+        REQUIRE(client.verifyBlock(i, Hash<std::string>(blocks[i + 1]), proof1.data(), proof1.size()) == false);
+    }
+
+    //the proof of a verified block was kept (pinned for evicted levels)
+    REQUIRE(client.verifyBlock(1, Hash<std::string>(blocks[1])));
+    REQUIRE(client.verifyBlock(2, Hash<std::string>(blocks[2])) == false);
+
+    //pinned proof siblings survive without any cache and count in the memory usage
+    BudgetedMerkleTree<std::string> uncached(blocks.size(), full.getRootHash(), 0, 1, 0);
+    size_t before = uncached.memoryUsage();
+    for (size_t i = 0; i < blocks.size(); i += 97)
+    {
+        REQUIRE(full.getProof(i, proof1.data(), proof1.size()));
+        REQUIRE(uncached.verifyBlock(i, Hash<std::string>(blocks[i]), proof1.data(), proof1.size()));
+    }
+    REQUIRE(uncached.memoryUsage() > before);
+    REQUIRE(uncached.verifyBlock(1, Hash<std::string>(blocks[1])));
+    REQUIRE(uncached.verifyBlock(96, Hash<std::string>(blocks[96])));
+    REQUIRE(uncached.verifyBlock(195, Hash<std::string>(blocks[196])) == false);
+}
+
+TEST_CASE( "Merkle Tree Layers", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::getLayer and setLayer");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 37; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+
+    REQUIRE(seeder.layerSize(0) == 64);
+    REQUIRE(seeder.layerSize(2) == 16);
+    REQUIRE(seeder.layerSize(6) == 1);
+    REQUIRE(seeder.layerSize(7) == 0);
+    REQUIRE_THROWS(seeder.getLayer(7, NULL));
+
+    //piece layer of 4 blocks per piece: 10 pieces carry data
+    std::vector<Hash<std::string> > pieces(seeder.layerSize(2));
+    seeder.getLayer(2, pieces.data());
+
+    MerkleTree<std::string> client(blocks.size(), seeder.getRootHash());
+    std::vector<Hash<std::string> > bad(pieces.begin(), pieces.begin() + 10);
+    bad[3] = Hash<std::string>(std::string("bad piece"));
+    REQUIRE(client.setLayer(2, bad.data(), bad.size()) == false);
+
+    std::vector<Hash<std::string> > got(client.layerSize(2));
+    client.getLayer(2, got.data());
+    REQUIRE(got[0].isEmpty());
+
+    REQUIRE(client.setLayer(2, pieces.data(), 10));
+    client.getLayer(2, got.data());
+    REQUIRE(got == pieces);
+
+    //a tree without root hash accepts any layer and computes the root hash
+    std::vector<Hash<std::string> > leaves;
+    for (size_t i = 0; i < blocks.size(); ++i)
+        leaves.push_back(Hash<std::string>(blocks[i]));
+
+    MerkleTree<std::string, 4> seeder4(blocks.size());
+    MerkleTree<std::string, 4> creator4(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder4.addBlock(i, blocks[i]);
+
+    REQUIRE(creator4.setLayer(0, leaves.data(), leaves.size()));
+    REQUIRE(creator4.getRootHash() == seeder4.getRootHash());
+
+    //known nodes that do not match the installed layer are dropped, matching ones are kept
+    MerkleTree<std::string> creator(blocks.size());
+    creator.addBlock(0, std::string("stale block"));
+    creator.addBlock(36, blocks[36]);
+    REQUIRE(creator.setLayer(2, pieces.data(), 9));
+    REQUIRE(creator.getRootHash() == seeder.getRootHash());
+    REQUIRE(creator.getNode(0, 0).isEmpty());
+    REQUIRE(creator.getNode(0, 36) == leaves[36]);
+}
+
+TEST_CASE( "Hash Messages", "[HashMessages]" )
+{
+    INFO("Hint: testing hash request, hashes and hash reject messages");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 50; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+    REQUIRE(seeder.depth() == 6);
+
+    HashRequest req;
+    std::memcpy(req.piecesRoot, seeder.getRootHash().data(), 32);
+    req.baseLayer = 1;
+    req.index = 4;
+    req.length = 4;
+    req.proofLayers = 5;
+
+    //request round trip
+    std::vector<unsigned char> out;
+    REQUIRE(encodeHashRequest(req, out) == HASH_REQUEST_SIZE);
+    REQUIRE(out[3] == 49);
+    REQUIRE(out[4] == HASH_REQUEST);
+
+    HashMessage<std::string> msg;
+    size_t consumed = 0;
+    REQUIRE(decodeHashMessage(out.data(), out.size() - 1, msg, consumed) == false);
+    REQUIRE(decodeHashMessage(out.data(), out.size(), msg, consumed));
+    REQUIRE(consumed == out.size());
+    REQUIRE(msg.id == HASH_REQUEST);
+    REQUIRE(msg.request.index == 4);
+    REQUIRE(msg.request.proofLayers == 5);
+    REQUIRE(msg.hashes.empty());
+
+    //hashes: 4 hashes of layer 1 and the uncles of their subtree up to the root (3 of them)
+    REQUIRE(numUncleHashes(req, seeder.depth()) == 3);
+    out.clear();
+    REQUIRE(encodeHashes(seeder, req, out) == HASH_REQUEST_SIZE + 7 * 32);
+    REQUIRE(decodeHashMessage(out.data(), out.size(), msg, consumed));
+    REQUIRE(msg.id == HASHES);
+    REQUIRE(msg.hashes.size() == 7);
+
+    std::vector<Hash<std::string> > layer(seeder.layerSize(1));
+    seeder.getLayer(1, layer.data());
+    for (size_t i = 0; i < 4; ++i)
+        REQUIRE(msg.hashes[i] == layer[4 + i]);
+
+    //subtree 1 of layer 3 is a right child, its ancestors are left children
+    Hash<std::string> node = (msg.hashes[0] + msg.hashes[1]) + (msg.hashes[2] + msg.hashes[3]);
+    node = msg.hashes[4] + node;
+    node = node + msg.hashes[5];
+    node = node + msg.hashes[6];
+    REQUIRE(node == seeder.getRootHash());
+
+    //fewer proof layers than the subtree height: no uncles
+    req.proofLayers = 1;
+    out.clear();
+    REQUIRE(encodeHashes(seeder, req, out) == HASH_REQUEST_SIZE + 4 * 32);
+
+    //invalid requests are not answered
+    req.index = 2;
+    REQUIRE(encodeHashes(seeder, req, out) == 0);
+    req.index = 32;
+    REQUIRE(encodeHashes(seeder, req, out) == 0);
+    req.index = 0;
+    req.length = 3;
+    REQUIRE(encodeHashes(seeder, req, out) == 0);
+
+    //ranges checked without 32-bit wrap or oversized shifts (peer-controlled fields)
+    HashRequest wide = req;
+    wide.baseLayer = 0;
+    wide.index = 0xfffffe00;
+    wide.length = 512;
+    REQUIRE(validHashRequest(wide, 31) == false);  //index + length wraps to 0 in 32 bits
+    REQUIRE(validHashRequest(wide, 32));
+    REQUIRE(validHashRequest(wide, 40));
+    wide.index = 0;
+    REQUIRE(validHashRequest(wide, 64));
+    wide.baseLayer = 100;
+    REQUIRE(validHashRequest(wide, 200));
+    REQUIRE(validHashRequest(wide, 99) == false);
+
+    //a client that knows only the root can not answer
+    MerkleTree<std::string> client(blocks.size(), seeder.getRootHash());
+    req.length = 4;
+    REQUIRE(encodeHashes(client, req, out) == 0);
+
+    //overlapping requests of a peer are coalesced
+    HashRequestQueue queue;
+    req.index = 4;
+    req.proofLayers = 2;
+    REQUIRE(queue.add(req));
+    REQUIRE(queue.add(req) == false);
+    req.index = 0;
+    req.length = 8;
+    REQUIRE(queue.add(req));
+    REQUIRE(queue.size() == 1);
+    req.length = 2;
+    req.proofLayers = 6;
+    REQUIRE(queue.add(req));
+    req.baseLayer = 0;
+    REQUIRE(queue.add(req));
+    REQUIRE(queue.size() == 3);
+
+    //unknown trees are rejected
+    req.piecesRoot[0] ^= 1;
+    REQUIRE(queue.add(req));
+
+    out.clear();
+    REQUIRE(serveHashRequests(queue, [&](const unsigned char* root) {
+        return std::memcmp(root, seeder.getRootHash().data(), 32) ? NULL : &seeder;
+    }, out) == 3);
+    REQUIRE(queue.size() == 0);
+
+    size_t offset = 0;
+    std::vector<int> ids;
+    while (decodeHashMessage(out.data() + offset, out.size() - offset, msg, consumed))
+    {
+        ids.push_back(msg.id);
+        offset += consumed;
+    }
+    REQUIRE(offset == out.size());
+    REQUIRE(ids == std::vector<int>({HASHES, HASHES, HASHES, HASH_REJECT}));
+}
+
+TEST_CASE( "Proof Cache", "[ProofCache]" )
+{
+    INFO("Hint: testing ProofCache");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 64; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+
+    HashRequest req;
+    std::memcpy(req.piecesRoot, seeder.getRootHash().data(), 32);
+    req.baseLayer = 0;
+    req.index = 8;
+    req.length = 4;
+    req.proofLayers = 6;
+
+    std::vector<unsigned char> direct;
+    size_t bytes = encodeHashes(seeder, req, direct);
+    REQUIRE(bytes == HASH_REQUEST_SIZE + 8 * 32);
+
+    ProofCache cache(1 << 16, 4);
+    std::vector<unsigned char> out;
+    REQUIRE(cache.encodeHashes(seeder, req, out) == bytes);
+    REQUIRE(cache.misses() == 1);
+    REQUIRE(cache.size() == bytes);
+    REQUIRE(cache.encodeHashes(seeder, req, out) == bytes);
+    REQUIRE(cache.hits() == 1);
+    REQUIRE(out.size() == 2 * bytes);
+    REQUIRE(std::equal(direct.begin(), direct.end(), out.begin()));
+    REQUIRE(std::equal(direct.begin(), direct.end(), out.begin() + bytes));
+
+    //the same request for another tree is another entry
+    MerkleTree<std::string> copy(seeder);
+    out.clear();
+    REQUIRE(cache.encodeHashes(copy, req, out) == bytes);
+    REQUIRE(cache.misses() == 2);
+
+    //a tree built at the address of a destroyed one (same generation) does not get its entries
+    REQUIRE(copy.id() != seeder.id());
+    typedef MerkleTree<std::string> Tree;
+    std::aligned_storage<sizeof(Tree), alignof(Tree)>::type storage;
+    Tree* reused = new (&storage) Tree(seeder);
+    out.clear();
+    REQUIRE(cache.encodeHashes(*reused, req, out) == bytes);
+    reused->~Tree();
+    reused = new (&storage) Tree(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        reused->addBlock(i, (i == 9) ? std::string("other block") : blocks[i]);
+    std::vector<unsigned char> fresh;
+    REQUIRE(encodeHashes(*reused, req, fresh) == bytes);
+    out.clear();
+    REQUIRE(cache.encodeHashes(*reused, req, out) == bytes);
+    REQUIRE(out == fresh);
+    REQUIRE(cache.misses() == 4);
+    reused->~Tree();
+
+    //a change of the tree makes its entries stale
+    size_t generation = seeder.generation();
+    seeder.addBlock(9, std::string("new block"));
+    REQUIRE(seeder.generation() != generation);
+    out.clear();
+    REQUIRE(cache.encodeHashes(seeder, req, out) == bytes);
+    REQUIRE(cache.misses() == 5);
+    REQUIRE(std::equal(direct.begin(), direct.end(), out.begin()) == false);
+
+    //requests that can not be answered are not cached
+    MerkleTree<std::string> client(blocks.size(), copy.getRootHash());
+    REQUIRE(cache.encodeHashes(client, req, out) == 0);
+    REQUIRE(cache.size() == 4 * bytes);   //entries of destroyed trees wait for eviction
+
+    //the cache stays within its capacity
+    ProofCache small(4 * bytes, 2);
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        req.index = 4 * i;
+        REQUIRE(small.encodeHashes(copy, req, out) == bytes);
+    }
+    REQUIRE(small.size() <= 4 * bytes);
+    small.clear();
+    REQUIRE(small.size() == 0);
+
+    //serving a peer's queue through the cache
+    HashRequestQueue queue;
+    REQUIRE(queue.add(req));
+    out.clear();
+    REQUIRE(serveHashRequests(queue, [&](const unsigned char*) { return &copy; }, out, cache) == 1);
+    REQUIRE(out.size() == bytes);
+}
+
+TEST_CASE( "Merkle Tree Missing Proof Nodes", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::missingProofNodes and verifyBlocks");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 16; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+
+    MerkleTree<std::string> client(blocks.size(), seeder.getRootHash());
+    REQUIRE_THROWS(client.missingProofNodes(std::vector<size_t>({16})));
+
+    //a single block needs a full proof: one sibling per level
+    std::vector<size_t> nodes = client.missingProofNodes(std::vector<size_t>({5}));
+    REQUIRE(nodes == std::vector<size_t>({2, 3, 10, 19}));
+
+    //blocks 4 and 5 are siblings: they share their path
+    nodes = client.missingProofNodes(std::vector<size_t>({4, 5}));
+    REQUIRE(nodes == std::vector<size_t>({2, 3, 10}));
+
+    //a whole subtree only needs the siblings above it
+    nodes = client.missingProofNodes(std::vector<size_t>({4, 5, 6, 7}));
+    REQUIRE(nodes == std::vector<size_t>({2, 3}));
+
+    std::vector<Hash<std::string> > nodeHashes;
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodeHashes.push_back(seeder.getNode(nodes[i]));
+
+    std::vector<size_t> ids({4, 5, 6, 7});
+    std::vector<Hash<std::string> > hashes;
+    for (size_t i = 0; i < ids.size(); ++i)
+        hashes.push_back(Hash<std::string>(blocks[ids[i]]));
+
+    hashes[2] = Hash<std::string>(std::string("bad block"));
+    REQUIRE(client.verifyBlocks(ids, hashes, nodes, nodeHashes) == false);
+    REQUIRE(client.getNode(3).isEmpty());
+
+    hashes[2] = Hash<std::string>(blocks[6]);
+    REQUIRE(client.verifyBlocks(ids, hashes, nodes, nodeHashes));
+    REQUIRE(client.getNode(3) == seeder.getNode(3));
+
+    //known nodes are not needed again
+    nodes = client.missingProofNodes(std::vector<size_t>({1, 4, 9}));
+    REQUIRE(nodes == std::vector<size_t>({6, 8, 12, 15, 23}));
+    REQUIRE(client.missingProofNodes(std::vector<size_t>({4})).empty());
+    REQUIRE(client.verifyBlock(4, Hash<std::string>(blocks[4])));
+
+    //arity 4
+    MerkleTree<std::string, 4> seeder4(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder4.addBlock(i, blocks[i]);
+
+    MerkleTree<std::string, 4> client4(blocks.size(), seeder4.getRootHash());
+    nodes = client4.missingProofNodes(std::vector<size_t>({0, 1}));
+    REQUIRE(nodes == std::vector<size_t>({2, 3, 4, 7, 8}));
+
+    nodeHashes.clear();
+    for (size_t i = 0; i < nodes.size(); ++i)
+        nodeHashes.push_back(seeder4.getNode(nodes[i]));
+
+    ids = std::vector<size_t>({0, 1});
+    hashes = std::vector<Hash<std::string> >({Hash<std::string>(blocks[0]), Hash<std::string>(blocks[1])});
+    REQUIRE(client4.verifyBlocks(ids, hashes, nodes, nodeHashes));
+    REQUIRE(client4.verifyBlock(2, Hash<std::string>(blocks[2])));
+}
+
+TEST_CASE( "Merkle Tree Pending Blocks", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::addPending");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 16; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+
+    std::vector<Hash<std::string> > pieces(seeder.layerSize(2));
+    seeder.getLayer(2, pieces.data());
+
+    std::vector<std::pair<size_t, bool> > reported;
+    MerkleTree<std::string> client(blocks.size(), seeder.getRootHash());
+    client.setPendingCallback([&](size_t id, bool verified) { reported.push_back(std::make_pair(id, verified)); });
+    REQUIRE(client.setLayer(2, pieces.data(), pieces.size()));
+    REQUIRE_THROWS(client.addPending(16, Hash<std::string>(blocks[0])));
+
+    //blocks of a piece arriving out of order are verified once the piece is complete
+    REQUIRE(client.addPending(1, Hash<std::string>(blocks[1])) == false);
+    REQUIRE(client.addPending(0, Hash<std::string>(blocks[0])) == false);
+    REQUIRE(client.addPending(3, Hash<std::string>(blocks[3])) == false);
+    REQUIRE(client.pendingSize() == 3);
+    REQUIRE(reported.empty());
+
+    REQUIRE(client.addPending(2, Hash<std::string>(blocks[2])));
+    REQUIRE(client.pendingSize() == 0);
+    REQUIRE(reported.size() == 4);
+    for (size_t i = 0; i < reported.size(); ++i)
+        REQUIRE(reported[i] == std::make_pair(i, true));
+    REQUIRE(client.verifyBlock(0, Hash<std::string>(blocks[0])));
+
+    //a bad block rejects the blocks combined with it
+    reported.clear();
+    REQUIRE(client.addPending(4, Hash<std::string>(std::string("bad block"))) == false);
+    REQUIRE(client.addPending(5, Hash<std::string>(blocks[5])) == false);
+    REQUIRE(client.addPending(6, Hash<std::string>(blocks[6])) == false);
+    REQUIRE(client.addPending(7, Hash<std::string>(blocks[7])) == false);
+    REQUIRE(client.pendingSize() == 0);
+    REQUIRE(reported.size() == 4);
+    REQUIRE(reported[0] == std::make_pair((size_t)4, false));
+    REQUIRE(client.verifyBlock(5, Hash<std::string>(blocks[5])) == false);
+
+    //a client with only the root hash verifies everything with the last block
+    reported.clear();
+    MerkleTree<std::string> client2(blocks.size(), seeder.getRootHash());
+    client2.setPendingCallback([&](size_t id, bool verified) { reported.push_back(std::make_pair(id, verified)); });
+    for (size_t i = blocks.size() - 1; i > 0; --i)
+        REQUIRE(client2.addPending(i, Hash<std::string>(blocks[i])) == false);
+
+    REQUIRE(reported.empty());
+    REQUIRE(client2.addPending(0, Hash<std::string>(blocks[0])));
+    REQUIRE(reported.size() == blocks.size());
+    REQUIRE(client2.verifyBlock(9, Hash<std::string>(blocks[9])));
+
+    //pending blocks are verified when a proof installs the nodes they need
+    reported.clear();
+    MerkleTree<std::string> client3(blocks.size(), seeder.getRootHash());
+    client3.setPendingCallback([&](size_t id, bool verified) { reported.push_back(std::make_pair(id, verified)); });
+    REQUIRE(client3.addPending(9, Hash<std::string>(blocks[9])) == false);
+    REQUIRE(client3.addPending(10, Hash<std::string>(blocks[10])) == false);
+    REQUIRE(client3.addPending(11, Hash<std::string>(blocks[11])) == false);
+
+    std::vector<Hash<std::string> > proof(seeder.proofSize());
+    REQUIRE(seeder.getProof(8, proof.data(), proof.size()));
+    REQUIRE(client3.verifyBlock(8, Hash<std::string>(blocks[8]), proof.data(), proof.size()));
+    REQUIRE(client3.pendingSize() == 0);
+    REQUIRE(reported.size() == 3);
+
+    //so are those completed by added blocks
+    reported.clear();
+    for (size_t i = 13; i < 16; ++i)
+        REQUIRE(client3.addPending(i, Hash<std::string>(blocks[i])) == false);
+
+    client3.addBlock(12, blocks[12]);
+    REQUIRE(reported.size() == 3);
+    REQUIRE(reported[0] == std::make_pair((size_t)13, true));
+
+    //copies do not share pending blocks nor the callback (each block is reported once)
+    reported.clear();
+    MerkleTree<std::string> client4(blocks.size(), seeder.getRootHash());
+    client4.setPendingCallback([&](size_t id, bool verified) { reported.push_back(std::make_pair(id, verified)); });
+    std::vector<Hash<std::string> > pairs(seeder.layerSize(1));
+    seeder.getLayer(1, pairs.data());
+    REQUIRE(client4.setLayer(1, pairs.data(), pairs.size()));
+    REQUIRE(client4.addPending(1, Hash<std::string>(blocks[1])) == false);
+    MerkleTree<std::string> copy(client4);
+    REQUIRE(copy.pendingSize() == 0);
+    MerkleTree<std::string> assigned(blocks.size());
+    assigned.addPending(3, Hash<std::string>(blocks[3]));
+    assigned = client4;
+    REQUIRE(assigned.pendingSize() == 0);
+
+    REQUIRE(client4.addBlock(0, blocks[0]));
+    copy.addBlock(0, blocks[0]);
+    assigned.addBlock(0, blocks[0]);
+    REQUIRE(client4.pendingSize() == 0);
+    REQUIRE(reported.size() == 1);
+    REQUIRE(reported[0] == std::make_pair((size_t)1, true));
+}
+
+TEST_CASE( "Merkle Tree Verification Diagnostics", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::verifyBlock with VerifyResult");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 16; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+
+    MerkleTree<std::string> client(blocks.size(), seeder.getRootHash());
+    std::vector<Hash<std::string> > proof(seeder.proofSize());
+    VerifyResult result;
+
+    REQUIRE(client.verifyBlock(16, Hash<std::string>(blocks[0]), proof.data(), proof.size(), result) == false);
+    REQUIRE(result.status == VerifyResult::BAD_BLOCK_ID);
+    REQUIRE(client.verifyBlock(0, Hash<std::string>(blocks[0]), proof.data(), 3, result) == false);
+    REQUIRE(result.status == VerifyResult::BAD_PROOF_SIZE);
+
+    //nothing known but the root: only the root can tell
+    REQUIRE(seeder.getProof(0, proof.data(), proof.size()));
+    proof[2] = Hash<std::string>(std::string("bad hash"));
+    REQUIRE(client.verifyBlock(0, Hash<std::string>(blocks[0]), proof.data(), proof.size(), result) == false);
+    REQUIRE(result.status == VerifyResult::NODE_MISMATCH);
+    REQUIRE(result.level == 4);
+    REQUIRE(result.node == 0);
+
+    REQUIRE(seeder.getProof(0, proof.data(), proof.size()));
+    REQUIRE(client.verifyBlock(0, Hash<std::string>(blocks[0]), proof.data(), proof.size(), result));
+    REQUIRE(result.status == VerifyResult::VERIFIED);
+
+    //a proof entry that contradicts a verified node
+    REQUIRE(seeder.getProof(1, proof.data(), proof.size()));
+    proof[1] = Hash<std::string>(std::string("bad hash"));
+    REQUIRE(client.verifyBlock(1, Hash<std::string>(blocks[1]), proof.data(), proof.size(), result) == false);
+    REQUIRE(result.status == VerifyResult::PROOF_MISMATCH);
+    REQUIRE(result.proofEntry == 1);
+    REQUIRE(result.level == 1);
+    REQUIRE(result.node == 8);
+
+    //a block that contradicts a verified leaf
+    REQUIRE(seeder.getProof(1, proof.data(), proof.size()));
+    REQUIRE(client.verifyBlock(1, Hash<std::string>(blocks[2]), proof.data(), proof.size(), result) == false);
+    REQUIRE(result.status == VerifyResult::BLOCK_MISMATCH);
+    REQUIRE(result.level == 0);
+    REQUIRE(result.node == 16);
+
+    //the first verified ancestor tells the height of the divergence
+    REQUIRE(seeder.getProof(8, proof.data(), proof.size()));
+    proof[0] = Hash<std::string>(std::string("bad hash"));
+    REQUIRE(client.verifyBlock(8, Hash<std::string>(blocks[8]), proof.data(), proof.size(), result) == false);
+    REQUIRE(result.status == VerifyResult::NODE_MISMATCH);
+    REQUIRE(result.level == 3);
+    REQUIRE(result.node == 2);
+
+    //local verification
+    REQUIRE(client.verifyBlock(4, Hash<std::string>(blocks[4]), result) == false);
+    REQUIRE(result.status == VerifyResult::INCOMPLETE);
+    REQUIRE(result.level == 0);
+    REQUIRE(result.node == 20);
+
+    REQUIRE(client.verifyBlock(1, Hash<std::string>(blocks[3]), result) == false);
+    REQUIRE(result.status == VerifyResult::BLOCK_MISMATCH);
+    REQUIRE(client.verifyBlock(1, Hash<std::string>(blocks[1]), result));
+}
+
+TEST_CASE( "Merkle Tree Diff", "[MerkleDiff]" )
+{
+    INFO("Hint: testing diff and RemoteDiff");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 100; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> older(blocks.size());
+    MerkleTree<std::string> newer(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        older.addBlock(i, blocks[i]);
+        newer.addBlock(i, (i == 7 || i == 40 || i == 41 || i == 99) ? "changed" : blocks[i]);
+    }
+
+    std::vector<BlockRange> ranges = diff(older, newer);
+    REQUIRE(ranges.size() == 3);
+    REQUIRE(ranges[0].first == 7);
+    REQUIRE(ranges[0].last == 8);
+    REQUIRE(ranges[1].first == 40);
+    REQUIRE(ranges[1].last == 42);
+    REQUIRE(ranges[2].first == 99);
+    REQUIRE(ranges[2].last == 100);
+
+    REQUIRE(diff(older, older).empty());
+    REQUIRE_THROWS(diff(older, MerkleTree<std::string>(1000)));
+    REQUIRE_THROWS(diff(older, MerkleTree<std::string>(101)));   //same depth, other number of blocks
+
+    //unknown nodes count as different
+    MerkleTree<std::string> partial(blocks.size());
+    for (size_t i = 0; i < 64; ++i)
+        partial.addBlock(i, blocks[i]);
+    ranges = diff(older, partial);
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges[0].first == 64);
+    REQUIRE(ranges[0].last == 100);
+
+    //remote diff: the other side only sends node hashes
+    RemoteDiff<std::string> remote(older);
+    REQUIRE(remote.height() == older.depth());
+    while (!remote.done())
+    {
+        std::vector<Hash<std::string> > hashes;
+        for (size_t i = 0; i < remote.wanted().size(); ++i)
+            hashes.push_back(newer.getNode(remote.height(), remote.wanted()[i]));
+
+        remote.advance(hashes);
+    }
+
+    REQUIRE(remote.result().size() == 3);
+    REQUIRE(remote.result()[1].first == 40);
+    REQUIRE(remote.result()[1].last == 42);
+    REQUIRE(remote.compared() < 2 * 4 * older.depth() + 1);
+    REQUIRE_THROWS(remote.advance(std::vector<Hash<std::string> >()));
+
+    //a remote tree with more blocks (same depth): its extra blocks fall in the local padding
+    MerkleTree<std::string> longer(blocks.size() + 3);
+    for (size_t i = 0; i < blocks.size() + 3; ++i)
+        longer.addBlock(i, (i < blocks.size()) ? blocks[i] : std::string("extra"));
+    RemoteDiff<std::string> clamped(older);
+    while (!clamped.done())
+    {
+        std::vector<Hash<std::string> > hashes;
+        for (size_t i = 0; i < clamped.wanted().size(); ++i)
+            hashes.push_back(longer.getNode(clamped.height(), clamped.wanted()[i]));
+
+        clamped.advance(hashes);
+    }
+    REQUIRE(clamped.result().empty());
+
+    //arity 4
+    MerkleTree<std::string, 4> older4(blocks.size());
+    MerkleTree<std::string, 4> newer4(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        older4.addBlock(i, blocks[i]);
+        newer4.addBlock(i, (i == 50) ? "changed" : blocks[i]);
+    }
+
+    RemoteDiff<std::string, 4> remote4(older4);
+    REQUIRE(remote4.wanted().size() == 1);
+    remote4.advance(std::vector<Hash<std::string> >(1, newer4.getRootHash()));
+    REQUIRE(remote4.wanted().size() == 4);
+    REQUIRE(diff(older4, newer4).size() == 1);
+    REQUIRE(diff(older4, newer4)[0].first == 50);
+}
+
+TEST_CASE( "Merkle Tree Merge", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::merge");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 16; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+
+    //two sessions verify a half of the blocks each
+    MerkleTree<std::string> first(blocks.size(), seeder.getRootHash());
+    MerkleTree<std::string> second(blocks.size(), seeder.getRootHash());
+    std::vector<Hash<std::string> > proof(seeder.proofSize());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        MerkleTree<std::string>& session = (i < 8) ? first : second;
+        REQUIRE(seeder.getProof(i, proof.data(), proof.size()));
+        REQUIRE(session.verifyBlock(i, Hash<std::string>(blocks[i]), proof.data(), proof.size()));
+    }
+
+    REQUIRE(first.verifyBlock(12, Hash<std::string>(blocks[12])) == false);
+    REQUIRE(first.merge(second));
+    REQUIRE(first.verifyBlock(12, Hash<std::string>(blocks[12])));
+    REQUIRE(diff(first, seeder).empty());
+
+    //different root or geometry
+    REQUIRE(first.merge(MerkleTree<std::string>(blocks.size(), first.getNode(1))) == false);
+    REQUIRE(first.merge(MerkleTree<std::string>(100, seeder.getRootHash())) == false);
+
+    //contradicting nodes
+    MerkleTree<std::string> wrong(blocks.size(), seeder.getRootHash());
+    wrong.addBlock(3, std::string("bad block"));
+    REQUIRE(second.merge(wrong));
+    REQUIRE(first.merge(wrong) == false);
+    REQUIRE(first.getNode(0, 3) == Hash<std::string>(blocks[3]));
+
+    //contradiction where the nodes of both trees meet
+    std::vector<Hash<std::string> > layer(seeder.layerSize(1));
+    seeder.getLayer(1, layer.data());
+
+    MerkleTree<std::string> third(blocks.size(), seeder.getRootHash());
+    REQUIRE(third.setLayer(1, layer.data(), layer.size()));
+    third.addBlock(8, blocks[8]);
+
+    MerkleTree<std::string> fourth(blocks.size(), seeder.getRootHash());
+    fourth.addBlock(9, std::string("bad block"));
+    REQUIRE(third.merge(fourth) == false);
+    REQUIRE(third.getNode(0, 9).isEmpty());
+
+    fourth.addBlock(9, blocks[9]);
+    REQUIRE(third.merge(fourth));
+    REQUIRE(third.verifyBlock(9, Hash<std::string>(blocks[9])));
+
+    //arity 4 with trees using different allocators
+    MerkleTree<std::string, 4> seeder4(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder4.addBlock(i, blocks[i]);
+
+    MonotonicArena arena(1 << 12);
+    MerkleTree<std::string, 4> first4(blocks.size(), seeder4.getRootHash());
+    MerkleTree<std::string, 4, ResourceAllocator<Hash<std::string> > > second4(
+        blocks.size(), seeder4.getRootHash(), ResourceAllocator<Hash<std::string> >(&arena));
+
+    std::vector<Hash<std::string> > proof4(seeder4.proofSize());
+    REQUIRE(seeder4.getProof(0, proof4.data(), proof4.size()));
+    REQUIRE(first4.verifyBlock(0, Hash<std::string>(blocks[0]), proof4.data(), proof4.size()));
+    REQUIRE(seeder4.getProof(15, proof4.data(), proof4.size()));
+    REQUIRE(second4.verifyBlock(15, Hash<std::string>(blocks[15]), proof4.data(), proof4.size()));
+
+    REQUIRE(first4.merge(second4));
+    REQUIRE(first4.verifyBlock(8, Hash<std::string>(blocks[8])) == false);
+    REQUIRE(first4.verifyBlock(15, Hash<std::string>(blocks[15])));
+}
+
+TEST_CASE( "Merkle Tree Subtrees", "[MerkleTree<T>]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::extractSubtree and importSubtree");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 50; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> seeder(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder.addBlock(i, blocks[i]);
+
+    //the coordinator knows the piece layer (8 blocks per piece)
+    std::vector<Hash<std::string> > pieces(seeder.layerSize(3));
+    seeder.getLayer(3, pieces.data());
+    MerkleTree<std::string> coordinator(blocks.size(), seeder.getRootHash());
+    REQUIRE(coordinator.setLayer(3, pieces.data(), pieces.size()));
+
+    REQUIRE_THROWS(coordinator.extractSubtree(0, 0));
+    REQUIRE_THROWS(coordinator.extractSubtree(3, 8));
+
+    //a worker verifies the blocks of a piece on its own
+    MerkleSubtree<std::string> shard = coordinator.extractSubtree(3, 2);
+    REQUIRE(shard.firstBlock() == 16);
+    REQUIRE(shard.tree.layerSize(0) == 8);
+    REQUIRE(shard.uncles.size() == 3);
+    REQUIRE(shard.checkRoot(seeder.getRootHash()));
+    REQUIRE(shard.checkRoot(shard.uncles[0]) == false);
+
+    for (size_t i = 0; i < 8; ++i)
+        shard.tree.addPending(i, Hash<std::string>(blocks[shard.firstBlock() + i]));
+    REQUIRE(shard.tree.pendingSize() == 0);
+
+    REQUIRE(coordinator.verifyBlock(17, Hash<std::string>(blocks[17])) == false);
+    REQUIRE(coordinator.importSubtree(shard));
+    REQUIRE(coordinator.verifyBlock(17, Hash<std::string>(blocks[17])));
+
+    //the last piece is mostly padding
+    MerkleSubtree<std::string> last = coordinator.extractSubtree(3, 6);
+    REQUIRE(last.tree.addPending(0, Hash<std::string>(blocks[48])) == false);
+    REQUIRE(last.tree.addPending(1, Hash<std::string>(blocks[49])));
+    REQUIRE(coordinator.importSubtree(last));
+    REQUIRE(coordinator.verifyBlock(49, Hash<std::string>(blocks[49])));
+
+    //a subtree that does not match is not imported
+    MerkleSubtree<std::string> bad = coordinator.extractSubtree(3, 4);
+    for (size_t i = 0; i < 8; ++i)
+        bad.tree.addBlock(i, (i == 5) ? std::string("bad block") : blocks[bad.firstBlock() + i]);
+    REQUIRE(coordinator.importSubtree(bad) == false);
+    REQUIRE(coordinator.getNode(0, 32).isEmpty());
+
+    //a client that only knows the root checks the subtree through its uncles
+    MerkleSubtree<std::string> full = seeder.extractSubtree(2, 3);
+    MerkleTree<std::string> client(blocks.size(), seeder.getRootHash());
+    REQUIRE(client.importSubtree(full));
+    REQUIRE(client.verifyBlock(13, Hash<std::string>(blocks[13])));
+    REQUIRE(client.getNode(0, 11).isEmpty());
+
+    full.uncles[1] = Hash<std::string>(std::string("bad hash"));
+    MerkleTree<std::string> client2(blocks.size(), seeder.getRootHash());
+    REQUIRE(client2.importSubtree(full) == false);
+
+    //arity 4
+    MerkleTree<std::string, 4> seeder4(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        seeder4.addBlock(i, blocks[i]);
+
+    MerkleSubtree<std::string, 4> shard4 = seeder4.extractSubtree(1, 5);
+    REQUIRE(shard4.firstBlock() == 20);
+    REQUIRE(shard4.uncles.size() == 3 * 2);
+    REQUIRE(shard4.checkRoot(seeder4.getRootHash()));
+
+    MerkleTree<std::string, 4> client4(blocks.size(), seeder4.getRootHash());
+    REQUIRE(client4.importSubtree(shard4));
+    REQUIRE(client4.verifyBlock(22, Hash<std::string>(blocks[22])));
+}
+
+TEST_CASE( "Distributed Tree Creation", "[TreeAssembler]" )
+{
+    INFO("Hint: testing MerkleTree<T, K>::emptySubtree, ShardResult and TreeAssembler");
+
+    std::vector<std::string> blocks;
+    for (int i = 0; i < 100; ++i)
+        blocks.push_back("block #" + std::to_string(i));
+
+    MerkleTree<std::string> single(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        single.addBlock(i, blocks[i]);
+
+    REQUIRE(shardHeight<2>(blocks.size(), 4) == 5);
+    REQUIRE(shardHeight<2>(blocks.size(), 1000) == 1);
+    REQUIRE(shardHeight<4>(blocks.size(), 4) == 2);
+    REQUIRE_THROWS(MerkleTree<std::string>::emptySubtree(blocks.size(), 5, 4));
+
+    //workers in this process
+    size_t height = shardHeight<2>(blocks.size(), 3);
+    TreeAssembler<std::string> assembler(blocks.size(), height);
+    REQUIRE(assembler.numShards() == 4);
+
+    std::vector<unsigned char> wire;
+    for (size_t s = 0; s < assembler.numShards(); ++s)
+    {
+        MerkleSubtree<std::string> shard = MerkleTree<std::string>::emptySubtree(blocks.size(), height, s);
+        for (size_t i = 0; i < shard.tree.layerSize(0) && shard.firstBlock() + i < blocks.size(); ++i)
+            shard.tree.addBlock(i, blocks[shard.firstBlock() + i]);
+
+        encodeShardResult(makeShardResult(shard, 2), wire);
+    }
+
+    REQUIRE(assembler.assemble() == false);
+    size_t offset = 0, consumed;
+    ShardResult<std::string> result;
+    while (decodeShardResult(wire.data() + offset, wire.size() - offset, result, consumed))
+    {
+        REQUIRE(result.pieces.size() == 8);
+        REQUIRE(assembler.add(result));
+        offset += consumed;
+    }
+
+    REQUIRE(offset == wire.size());
+    REQUIRE(assembler.add(result) == false);
+    REQUIRE(assembler.complete());
+    REQUIRE(assembler.assemble());
+    REQUIRE(assembler.tree().getRootHash() == single.getRootHash());
+    REQUIRE(assembler.tree().getNode(2, 10) == single.getNode(2, 10));
+
+    //pieces that do not reduce to the root are refused
+    TreeAssembler<std::string> checked(blocks.size(), height);
+    decodeShardResult(wire.data(), wire.size(), result, consumed);
+    result.pieces[3] = Hash<std::string>(std::string("bad piece"));
+    REQUIRE(checked.add(result) == false);
+
+#if defined(__unix__) || defined(__APPLE__)
+    //lengths announcing more pieces than the bound are refused before reading
+    int bounded[2];
+    REQUIRE(pipe(bounded) == 0);
+    ShardResult<std::string> piecesRead;
+    unsigned char forged[4];
+    putUint32(forged, 0xfffffff4);  //a whole number of pieces, but about 128M of them
+    REQUIRE(write(bounded[1], forged, sizeof(forged)) == (ssize_t)sizeof(forged));
+    REQUIRE(readShardResult(bounded[0], piecesRead, checked.maxPieces()) == false);
+    REQUIRE(writeShardResult(bounded[1], result));
+    REQUIRE(readShardResult(bounded[0], piecesRead, result.pieces.size()));
+    REQUIRE(piecesRead.pieces.size() == result.pieces.size());
+    REQUIRE(writeShardResult(bounded[1], result));
+    REQUIRE(readShardResult(bounded[0], piecesRead, result.pieces.size() - 1) == false);
+    close(bounded[0]);
+    close(bounded[1]);
+
+    //worker processes reporting through pipes
+    size_t height4 = shardHeight<4>(blocks.size(), 4);
+    TreeAssembler<std::string, 4> assembler4(blocks.size(), height4);
+    REQUIRE(assembler4.numShards() == 7);
+    std::vector<int> pipes;
+    std::vector<pid_t> workers;
+
+    for (size_t s = 0; s < assembler4.numShards(); ++s)
+    {
+        int fds[2];
+        REQUIRE(pipe(fds) == 0);
+
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0)
+        {
+            close(fds[0]);
+            MerkleSubtree<std::string, 4> shard = MerkleTree<std::string, 4>::emptySubtree(blocks.size(), height4, s);
+            for (size_t i = 0; i < shard.tree.layerSize(0) && shard.firstBlock() + i < blocks.size(); ++i)
+                shard.tree.addBlock(i, blocks[shard.firstBlock() + i]);
+
+            _exit(writeShardResult(fds[1], makeShardResult(shard)) ? 0 : 1);
+        }
+
+        close(fds[1]);
+        pipes.push_back(fds[0]);
+        workers.push_back(pid);
+    }
+
+    for (size_t s = 0; s < pipes.size(); ++s)
+    {
+        REQUIRE(readShardResult(pipes[s], result, assembler4.maxPieces()));
+        REQUIRE(result.pieces.empty());
+        REQUIRE(assembler4.add(result));
+        REQUIRE(readShardResult(pipes[s], result, assembler4.maxPieces()) == false);
+        close(pipes[s]);
+
+        int status;
+        REQUIRE(waitpid(workers[s], &status, 0) == workers[s]);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+
+    MerkleTree<std::string, 4> single4(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        single4.addBlock(i, blocks[i]);
+
+    REQUIRE(assembler4.assemble());
+    REQUIRE(assembler4.tree().getRootHash() == single4.getRootHash());
+#endif
+}
+
+TEST_CASE( "Streaming Hash", "[Sha256Stream]" )
+{
+    std::string data(1000, 0);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 31 + 7);
+
+    INFO("Hint: testing Sha256Stream against known digests");
+    Sha256Stream stream;
+    REQUIRE(Hash<std::string>(stream).returnHashString() ==
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    stream.update((const unsigned char*)"abc", 3);
+    REQUIRE(Hash<std::string>(stream).returnHashString() ==
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    INFO("Hint: testing chunked input at and around block boundaries");
+    const size_t sizes[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 1000 };
+    const size_t chunks[] = { 1, 7, 63, 64, 65, 200 };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        std::string msg = data.substr(0, sizes[s]);
+        std::string expected = picosha2::hash256_hex_string(msg);
+
+        for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); ++c)
+        {
+            stream.reset();
+            for (size_t i = 0; i < msg.size(); i += chunks[c])
+                stream.update((const unsigned char*)msg.data() + i, std::min(chunks[c], msg.size() - i));
+
+            REQUIRE(stream.length() == msg.size());
+            REQUIRE(Hash<std::string>(stream).returnHashString() == expected);
+            REQUIRE(Hash<std::string>(stream) == Hash<std::string>((const unsigned char*)msg.data(), msg.size()));
+        }
+    }
+
+    INFO("Hint: testing that a digest does not end the stream");
+    stream.reset();
+    stream.update((const unsigned char*)data.data(), 500);
+    Hash<std::string> half(stream);
+    stream.update((const unsigned char*)data.data() + 500, 500);
+    REQUIRE(half == Hash<std::string>(data.substr(0, 500)));
+    REQUIRE(Hash<std::string>(stream) == Hash<std::string>(data));
+}
+
+TEST_CASE( "Piece Hasher", "[PieceHasher<T>]" )
+{
+    const size_t blockSize = 64;
+    std::string piece(5 * blockSize + 10, 0);   //5 whole blocks and a short one
+    for (size_t i = 0; i < piece.size(); ++i)
+        piece[i] = (char)(i * 13 + 1);
+    const unsigned char* data = (const unsigned char*)piece.data();
+
+    INFO("Hint: testing blocks received in order");
+    PieceHasher<std::string> inOrder(piece.size(), blockSize);
+    for (size_t offset = 0; offset < piece.size(); offset += blockSize)
+    {
+        REQUIRE(inOrder.complete() == false);
+        REQUIRE(inOrder.add(offset, data + offset, std::min(blockSize, piece.size() - offset)));
+        REQUIRE(inOrder.buffered() == 0);
+    }
+    REQUIRE(inOrder.complete());
+    REQUIRE(inOrder.hash() == Hash<std::string>(piece));
+
+    INFO("Hint: testing blocks received out of order");
+    PieceHasher<std::string> outOfOrder(piece.size(), blockSize);
+    REQUIRE_THROWS(outOfOrder.hash());
+    REQUIRE(outOfOrder.add(5 * blockSize, data + 5 * blockSize, 10));
+    REQUIRE(outOfOrder.add(2 * blockSize, data + 2 * blockSize, blockSize));
+    REQUIRE(outOfOrder.hashed() == 0);
+    REQUIRE(outOfOrder.buffered() == blockSize + 10);
+    REQUIRE(outOfOrder.add(0, data, blockSize));
+    REQUIRE(outOfOrder.hashed() == blockSize);
+    REQUIRE(outOfOrder.add(blockSize, data + blockSize, blockSize));
+    REQUIRE(outOfOrder.hashed() == 3 * blockSize);
+    REQUIRE(outOfOrder.buffered() == 10);
+    REQUIRE(outOfOrder.add(4 * blockSize, data + 4 * blockSize, blockSize));
+    REQUIRE(outOfOrder.buffered() == blockSize + 10);
+    REQUIRE(outOfOrder.add(3 * blockSize, data + 3 * blockSize, blockSize));
+    REQUIRE(outOfOrder.buffered() == 0);
+    REQUIRE(outOfOrder.complete());
+    REQUIRE(outOfOrder.hash() == Hash<std::string>(piece));
+
+    INFO("Hint: testing blocks that do not fit the piece");
+    PieceHasher<std::string> checked(piece.size(), blockSize);
+    REQUIRE(checked.add(1, data + 1, blockSize) == false);
+    REQUIRE(checked.add(6 * blockSize, data, blockSize) == false);
+    REQUIRE(checked.add(5 * blockSize, data + 5 * blockSize, blockSize) == false);
+    REQUIRE(checked.add(blockSize, data + blockSize, blockSize / 2) == false);
+    REQUIRE(checked.add(0, data, blockSize));
+    REQUIRE(checked.add(0, data, blockSize) == false);
+    REQUIRE(checked.add(2 * blockSize, data + 2 * blockSize, blockSize));
+    REQUIRE(checked.add(2 * blockSize, data + 2 * blockSize, blockSize) == false);
+    checked.reset();
+    REQUIRE(checked.hashed() == 0);
+    REQUIRE(checked.buffered() == 0);
+
+    INFO("Hint: testing MerkleTree addBlock and verifyBlock with piece hashes");
+    std::vector<std::string> pieces = { piece, piece.substr(1), piece.substr(2) };
+    MerkleTree<std::string> source(pieces.size());
+    MerkleTree<std::string> built(pieces.size());
+    for (size_t i = 0; i < pieces.size(); ++i)
+    {
+        source.addBlock(i, pieces[i]);
+
+        PieceHasher<std::string> hasher(pieces[i].size(), blockSize);
+        for (size_t offset = 0; offset < pieces[i].size(); offset += blockSize)
+            hasher.add(offset, (const unsigned char*)pieces[i].data() + offset,
+                       std::min(blockSize, pieces[i].size() - offset));
+        REQUIRE(built.addBlock(i, hasher.hash()));
+    }
+    REQUIRE(built.getRootHash() == source.getRootHash());
+    REQUIRE_THROWS(built.addBlock(0, Hash<std::string>()));
+    REQUIRE_THROWS(built.addBlock(3, Hash<std::string>(piece)));
+
+    MerkleTree<std::string> client(pieces.size(), source.getRootHash());
+    std::vector<Hash<std::string> > proof(source.proofSize());
+    REQUIRE(source.getProof(0, proof.data(), proof.size()));
+    REQUIRE(client.verifyBlock(0, inOrder.hash(), proof.data(), proof.size()));
+}
+
+TEST_CASE( "Streaming Hash Checkpoints", "[Sha256Stream]" )
+{
+    std::string data(300, 0);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 7 + 3);
+    const unsigned char* bytes = (const unsigned char*)data.data();
+
+    INFO("Hint: testing that a restored stream goes on from the checkpoint");
+    const size_t cuts[] = { 0, 1, 63, 64, 65, 200 };
+    for (size_t c = 0; c < sizeof(cuts) / sizeof(cuts[0]); ++c)
+    {
+        Sha256Stream stream;
+        stream.update(bytes, cuts[c]);
+
+        unsigned char state[SHA256_STATE_MAX_SIZE];
+        size_t size = stream.saveState(state);
+        REQUIRE(size == 40 + cuts[c] % 64);
+
+        Sha256Stream restored;
+        restored.update(bytes, 10);
+        REQUIRE(restored.loadState(state, size));
+        REQUIRE(restored.length() == cuts[c]);
+        restored.update(bytes + cuts[c], data.size() - cuts[c]);
+        REQUIRE(Hash<std::string>(restored) == Hash<std::string>(data));
+    }
+
+    INFO("Hint: testing malformed checkpoints");
+    Sha256Stream stream;
+    stream.update(bytes, 70);
+    unsigned char state[SHA256_STATE_MAX_SIZE];
+    size_t size = stream.saveState(state);
+    Sha256Stream other;
+    REQUIRE(other.loadState(state, size - 1) == false);
+    REQUIRE(other.loadState(state, 39) == false);
+    REQUIRE(other.length() == 0);
+
+    INFO("Hint: testing a piece hasher resumed from a checkpoint");
+    const size_t blockSize = 64;
+    PieceHasher<std::string> hasher(data.size(), blockSize);
+    REQUIRE(hasher.add(0, bytes, blockSize));
+    REQUIRE(hasher.add(blockSize, bytes + blockSize, blockSize));
+    REQUIRE(hasher.add(3 * blockSize, bytes + 3 * blockSize, blockSize));    //buffered, not saved
+    size = hasher.saveState(state);
+
+    PieceHasher<std::string> resumed(data.size(), blockSize);
+    REQUIRE(resumed.loadState(state, size));
+    REQUIRE(resumed.hashed() == 2 * blockSize);
+    REQUIRE(resumed.buffered() == 0);
+    for (size_t offset = 2 * blockSize; offset < data.size(); offset += blockSize)
+        REQUIRE(resumed.add(offset, bytes + offset, std::min(blockSize, data.size() - offset)));
+    REQUIRE(resumed.hash() == Hash<std::string>(data));
+
+    INFO("Hint: testing checkpoints that do not fit the piece");
+    PieceHasher<std::string> misaligned(data.size(), 96);
+    REQUIRE(misaligned.loadState(state, size) == false);    //128 bytes is not a block boundary
+    stream.reset();
+    stream.update(bytes, data.size());
+    stream.update(bytes, 1);
+    size = stream.saveState(state);
+    REQUIRE(resumed.loadState(state, size) == false);       //longer than the piece
+}
+
+// span-like view of bytes: data(), size(), begin() and end() but no const_iterator
+struct ByteSpan
+{
+    typedef char value_type;
+
+    const char* first;
+    size_t count;
+
+    const char* data() const { return first; }
+    size_t size() const { return count; }
+    const char* begin() const { return first; }
+    const char* end() const { return first + count; }
+};
+
+TEST_CASE( "Hash From Containers", "[Hash<T>]" )
+{
+    std::string data(1000, 0);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 17 + 5);
+    Hash<std::string> expected(data);
+    REQUIRE(expected.returnHashString() == picosha2::hash256_hex_string(data));
+
+    INFO("Hint: testing contiguous containers");
+    std::vector<unsigned char> bytes(data.begin(), data.end());
+    REQUIRE(Hash<std::vector<unsigned char> >(bytes).returnHash() == expected.returnHash());
+    typedef std::array<char, 3> Abc;
+    Abc abc = { { 'a', 'b', 'c' } };
+    REQUIRE(Hash<Abc>(abc).returnHashString() ==
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    ByteSpan span = { data.data(), data.size() };
+    REQUIRE(Hash<ByteSpan>(span).returnHash() == expected.returnHash());
+
+    INFO("Hint: testing non-contiguous containers");
+    std::deque<char> deque(data.begin(), data.end());
+    REQUIRE(Hash<std::deque<char> >(deque).returnHash() == expected.returnHash());
+    std::list<char> list(data.begin(), data.end());
+    REQUIRE(Hash<std::list<char> >(list).returnHash() == expected.returnHash());
+    std::deque<char> large(100000, 'z');
+    REQUIRE(Hash<std::deque<char> >(large).returnHashString() ==
+            picosha2::hash256_hex_string(std::string(100000, 'z')));
+    REQUIRE(Hash<std::list<char> >(std::list<char>()).returnHashString() ==
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    INFO("Hint: testing containers of wider elements (low byte of each element, as picosha2)");
+    std::vector<int> wide(data.begin(), data.end());
+    for (size_t i = 0; i < wide.size(); ++i)
+        wide[i] += 0x100;
+    REQUIRE(Hash<std::vector<int> >(wide).returnHashString() == picosha2::hash256_hex_string(wide));
+}
+
+TEST_CASE( "Hash From Segments", "[Hash<T>]" )
+{
+    std::string data(300, 0);
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = (char)(i * 11 + 2);
+    const unsigned char* bytes = (const unsigned char*)data.data();
+
+    INFO("Hint: testing segments of any size, including empty ones");
+    HashSegment segments[] = { { bytes, 1 }, { bytes + 1, 0 }, { bytes + 1, 100 }, { bytes + 101, 63 },
+                               { bytes + 164, 136 } };
+    REQUIRE(Hash<std::string>(segments, 5) == Hash<std::string>(data));
+    REQUIRE(Hash<std::string>(segments, 0).returnHashString() ==
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+    INFO("Hint: testing a ring buffer wraparound");
+    std::string ring = data.substr(200) + data.substr(0, 200);   //block starts at offset 100
+    HashSegment wrapped[] = { { (const unsigned char*)ring.data() + 100, 200 },
+                              { (const unsigned char*)ring.data(), 100 } };
+    REQUIRE(Hash<std::string>(wrapped, 2) == Hash<std::string>(data));
+
+    INFO("Hint: testing MerkleTree addBlock with segments");
+    MerkleTree<std::string> tree(2);
+    MerkleTree<std::string> expected(2);
+    REQUIRE(tree.addBlock(0, segments, 5));
+    REQUIRE(tree.addBlock(1, wrapped, 1));
+    expected.addBlock(0, data);
+    expected.addBlock(1, data.substr(0, 200));
+    REQUIRE(tree.getRootHash() == expected.getRootHash());
+    REQUIRE_THROWS(tree.addBlock(2, segments, 5));
+}
+
+TEST_CASE( "Hybrid Hashing", "[HybridHasher<T>]" )
+{
+    INFO("Hint: testing Sha1Stream against known digests");
+    unsigned char digest[SHA1_DIGEST_SIZE];
+    Sha1Stream sha1;
+    sha1.digest(digest);
+    REQUIRE(picosha2::bytes_to_hex_string(digest, digest + SHA1_DIGEST_SIZE) ==
+            "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    sha1.update((const unsigned char*)"abc", 3);
+    sha1.digest(digest);
+    REQUIRE(picosha2::bytes_to_hex_string(digest, digest + SHA1_DIGEST_SIZE) ==
+            "a9993e364706816aba3e25717850c26c9cd0d89d");
+    std::string a(1000, 'a');
+    sha1.reset();
+    for (size_t i = 0; i < 1000; ++i)
+        sha1.update((const unsigned char*)a.data(), a.size());
+    sha1.digest(digest);
+    REQUIRE(picosha2::bytes_to_hex_string(digest, digest + SHA1_DIGEST_SIZE) ==
+            "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+    INFO("Hint: testing v1 pieces and v2 leaves of two files hashed in one pass");
+    const size_t blockSize = 64;
+    const size_t pieceSize = 4 * blockSize;
+    std::string files[] = { std::string(300, 0), std::string(), std::string(520, 0) };
+    for (size_t f = 0; f < 3; ++f)
+        for (size_t i = 0; i < files[f].size(); ++i)
+            files[f][i] = (char)(i * 5 + f);
+
+    HybridHasher<std::string> hybrid(pieceSize, blockSize);
+    std::vector<std::vector<Hash<std::string> > > blocks(3);
+    size_t padding[3];
+    for (size_t f = 0; f < 3; ++f)
+    {
+        for (size_t i = 0; i < files[f].size(); i += 37)
+            hybrid.update((const unsigned char*)files[f].data() + i, std::min((size_t)37, files[f].size() - i));
+        padding[f] = hybrid.endFile(blocks[f], f == 2);
+    }
+    REQUIRE(padding[0] == 2 * pieceSize - 300);
+    REQUIRE(padding[1] == 0);
+    REQUIRE(padding[2] == 0);
+
+    std::string v1 = files[0] + std::string(padding[0], 0) + files[2];
+    REQUIRE(hybrid.pieces().size() == 5 * SHA1_DIGEST_SIZE);
+    for (size_t p = 0; p < 5; ++p)
+    {
+        sha1.reset();
+        sha1.update((const unsigned char*)v1.data() + p * pieceSize, std::min(pieceSize, v1.size() - p * pieceSize));
+        sha1.digest(digest);
+        REQUIRE(std::equal(digest, digest + SHA1_DIGEST_SIZE, &hybrid.pieces()[p * SHA1_DIGEST_SIZE]));
+    }
+
+    REQUIRE(blocks[1].empty());
+    for (size_t f = 0; f < 3; f += 2)
+    {
+        REQUIRE(blocks[f].size() == (files[f].size() + blockSize - 1) / blockSize);
+        MerkleTree<std::string> tree(blocks[f].size());
+        MerkleTree<std::string> expected(blocks[f].size());
+        for (size_t b = 0; b < blocks[f].size(); ++b)
+        {
+            tree.addBlock(b, blocks[f][b]);
+            expected.addBlock(b, files[f].substr(b * blockSize, blockSize));
+        }
+        REQUIRE(tree.getRootHash() == expected.getRootHash());
+    }
+
+    REQUIRE_THROWS(HybridHasher<std::string>(100, 64));
+}
+
+TEST_CASE( "Hash Policies", "[Hash<T>]" )
+{
+    std::vector<std::string> blocks;
+    for (size_t i = 0; i < 5; ++i)
+        blocks.push_back(std::string(100 + i, (char)('a' + i)));
+
+    INFO("Hint: testing the SHA-1 policy");
+    typedef Hash<std::string, Sha1Policy> Sha1Hash;
+    REQUIRE(Sha1Hash::size() == 20);
+    REQUIRE(Hash<std::string>::size() == 32);
+    REQUIRE(Sha1Hash(std::string("abc")).returnHashString() == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    Sha1Hash ab = Sha1Hash(std::string("a")) + Sha1Hash(std::string("b"));
+    std::vector<unsigned char> both = Sha1Hash(std::string("a")).returnHash();
+    std::vector<unsigned char> b = Sha1Hash(std::string("b")).returnHash();
+    both.insert(both.end(), b.begin(), b.end());
+    REQUIRE(ab == Sha1Hash(both.data(), both.size()));
+    REQUIRE_THROWS(Sha1Hash().setHash(std::vector<unsigned char>(32, 0)));
+
+    INFO("Hint: testing a Merkle tree with the SHA-1 policy");
+    typedef MerkleTree<std::string, 2, std::allocator<Hash<std::string> >, Sha1Policy> Sha1Tree;
+    Sha1Tree tree(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+        tree.addBlock(i, blocks[i]);
+    Sha1Hash l01 = Sha1Hash(blocks[0]) + Sha1Hash(blocks[1]);
+    Sha1Hash l23 = Sha1Hash(blocks[2]) + Sha1Hash(blocks[3]);
+    Sha1Hash pad;
+    pad.setHash(std::vector<unsigned char>(20, 0));
+    Sha1Hash l47 = (Sha1Hash(blocks[4]) + pad) + (pad + pad);
+    REQUIRE(tree.getRootHash() == (l01 + l23) + l47);
+
+    Sha1Tree client(blocks.size(), tree.getRootHash());
+    std::vector<Sha1Hash> proof(tree.proofSize());
+    REQUIRE(tree.getProof(3, proof.data(), proof.size()));
+    REQUIRE(client.verifyBlock(3, Sha1Hash(blocks[3]), proof.data(), proof.size()));
+    REQUIRE(client.verifyBlock(2, Sha1Hash(blocks[3])) == false);
+
+    INFO("Hint: testing the modules built on trees with the SHA-1 policy");
+    Sha1Tree other(tree);
+    other.addBlock(1, std::string("other block"));
+    std::vector<BlockRange> ranges = diff(tree, other);
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges[0].first == 1);
+
+    MerkleSubtree<std::string, 2, std::allocator<Hash<std::string> >, Sha1Policy> shard = tree.extractSubtree(1, 1);
+    ShardResult<std::string, Sha1Policy> result = makeShardResult(shard, 0), decoded;
+    std::vector<unsigned char> wire;
+    size_t consumed = 0;
+    REQUIRE(encodeShardResult(result, wire) == 4 + 4 + 4 + 20 + 4 + 4 + 2 * 20);
+    REQUIRE(decodeShardResult(wire.data(), wire.size(), decoded, consumed));
+    REQUIRE(decoded.root == result.root);
+    REQUIRE(decoded.pieces == result.pieces);
+
+    PieceHasher<std::string, Sha1Policy> piece(blocks[0].size(), 64);
+    piece.add(64, (const unsigned char*)blocks[0].data() + 64, blocks[0].size() - 64);
+    piece.add(0, (const unsigned char*)blocks[0].data(), 64);
+    REQUIRE(piece.hash() == Sha1Hash(blocks[0]));
+
+    FixedMerkleTree<std::string, 5, Sha1Policy> fixedTree;
+    MerkleForest<std::string, Sha1Policy> forest;
+    BudgetedMerkleTree<std::string, Sha1Policy> budgeted(blocks.size(), 0, 1);
+    size_t treeID = forest.addTree(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        fixedTree.addBlock(i, blocks[i]);
+        forest.addBlock(treeID, i, blocks[i]);
+        budgeted.addBlock(i, blocks[i]);
+    }
+    REQUIRE(fixedTree.getRootHash() == tree.getRootHash());
+    REQUIRE(forest.getRootHash(treeID) == tree.getRootHash());
+    REQUIRE(budgeted.getRootHash() == tree.getRootHash());
+
+    INFO("Hint: testing one-shot stream digests");
+    Sha1Stream sha1Stream;
+    sha1Stream.update((const unsigned char*)blocks[1].data(), blocks[1].size());
+    unsigned char kept[SHA1_DIGEST_SIZE], finalized[SHA1_DIGEST_SIZE];
+    sha1Stream.digest(kept);
+    sha1Stream.finalize(finalized);
+    REQUIRE(std::memcmp(kept, finalized, SHA1_DIGEST_SIZE) == 0);
+
+#ifdef HASH_USE_OPENSSL
+    INFO("Hint: testing the system crypto library policy against the default one");
+    typedef Hash<std::string, OpenSslSha256Policy> SslHash;
+    for (size_t i = 0; i < blocks.size(); ++i)
+        REQUIRE(SslHash(blocks[i]).returnHash() == Hash<std::string>(blocks[i]).returnHash());
+
+    OpenSslSha256Stream stream;
+    stream.update((const unsigned char*)blocks[0].data(), 50);
+    SslHash half(stream);
+    stream.update((const unsigned char*)blocks[0].data() + 50, 50);
+    REQUIRE(half.returnHash() == Hash<std::string>(blocks[0].substr(0, 50)).returnHash());
+    REQUIRE(SslHash(stream).returnHash() == Hash<std::string>(blocks[0]).returnHash());
+    unsigned char sslDigest[32];
+    stream.finalize(sslDigest);
+    REQUIRE(std::vector<unsigned char>(sslDigest, sslDigest + 32) == Hash<std::string>(blocks[0]).returnHash());
+    REQUIRE((SslHash(blocks[0]) + SslHash(blocks[1])).returnHash() ==
+            (Hash<std::string>(blocks[0]) + Hash<std::string>(blocks[1])).returnHash());
+
+    MerkleTree<std::string, 4, std::allocator<Hash<std::string> >, OpenSslSha256Policy> sslTree(blocks.size());
+    MerkleTree<std::string, 4> defaultTree(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        sslTree.addBlock(i, blocks[i]);
+        defaultTree.addBlock(i, blocks[i]);
+    }
+    REQUIRE(sslTree.getRootHash().returnHash() == defaultTree.getRootHash().returnHash());
+#endif
+}
+
+TEST_CASE( "Hash Hex Codec", "[Hash<T>]" )
+{
+    Hash<std::string> hash(std::string("abc"));
+    std::string expected = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+
+    INFO("Hint: testing hex encoding");
+    char hex[64];
+    REQUIRE(hash.toHex(hex) == 64);
+    REQUIRE(std::string(hex, 64) == expected);
+    REQUIRE(hash.returnHashString() == expected);
+    std::ostringstream os;
+    os << hash << Hash<std::string>();
+    REQUIRE(os.str() == expected);
+    REQUIRE_THROWS(Hash<std::string>().toHex(hex));
+
+    INFO("Hint: testing hex parsing");
+    Hash<std::string> parsed;
+    REQUIRE(parsed.fromHex(expected.data(), expected.size()));
+    REQUIRE(parsed == hash);
+    std::string upper = "BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD";
+    Hash<std::string> parsedUpper;
+    REQUIRE(parsedUpper.fromHex(upper.data(), upper.size()));
+    REQUIRE(parsedUpper == hash);
+
+    INFO("Hint: testing invalid hex");
+    Hash<std::string> invalid;
+    REQUIRE(invalid.fromHex(expected.data(), 63) == false);
+    const char badChars[] = { 'g', 'G', ' ', '/', ':', '@', '`', '\0', (char)0xe0 };
+    for (size_t i = 0; i < sizeof(badChars); ++i)
+    {
+        std::string bad = expected;
+        bad[17] = badChars[i];
+        REQUIRE(invalid.fromHex(bad.data(), bad.size()) == false);
+        REQUIRE(parsed.fromHex(bad.data(), bad.size()) == false);
+    }
+    REQUIRE(invalid.isEmpty());
+    REQUIRE(parsed == hash);
+
+    INFO("Hint: testing the hex codec of another digest size");
+    Hash<std::string, Sha1Policy> sha1(std::string("abc"));
+    Hash<std::string, Sha1Policy> sha1Parsed;
+    REQUIRE(sha1.toHex(hex) == 40);
+    REQUIRE(sha1Parsed.fromHex(hex, 40));
+    REQUIRE(sha1Parsed == sha1);
+    REQUIRE(sha1Parsed.fromHex(expected.data(), expected.size()) == false);
+}
+
+// SHA-256 stream that counts the bytes fed to it (to tell the zero block fast path from hashing)
+struct CountingSha256Stream : Sha256Stream
+{
+    static size_t bytesFed;
+
+    void update(const unsigned char* data, size_t size)
+    {
+        bytesFed += size;
+        Sha256Stream::update(data, size);
+    }
+};
+
+size_t CountingSha256Stream::bytesFed = 0;
+
+struct CountingSha256Policy
+{
+    static const size_t digestSize = 32;
+    typedef CountingSha256Stream Stream;
+};
+
+TEST_CASE( "Zero Blocks", "[Hash<T>]" )
+{
+    const size_t blockSize = 1024;
+    std::string zeros(blockSize, 0);
+
+    INFO("Hint: testing the zero block hash");
+    Hash<std::string> zero = Hash<std::string>::zeroBlock(blockSize);
+    REQUIRE(zero.returnHashString() == picosha2::hash256_hex_string(zeros));
+    REQUIRE(Hash<std::string>((const unsigned char*)zeros.data(), blockSize) == zero);
+    REQUIRE(Hash<std::string>::zeroBlock(blockSize) == zero);
+    REQUIRE(Hash<std::string>::zeroBlock(0).returnHashString() ==
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    typedef Hash<std::string, Sha1Policy> Sha1Hash;
+    REQUIRE(Sha1Hash::zeroBlock(3).returnHashString() == Sha1Hash(std::string(3, 0)).returnHashString());
+    REQUIRE(Hash<std::string>((const unsigned char*)zeros.data(), 1000) == Hash<std::string>::zeroBlock(1000));
+    REQUIRE(Hash<std::string>((const unsigned char*)zeros.data(), 0) == Hash<std::string>::zeroBlock(0));
+    for (size_t i = 0; i < blockSize; i += 99)
+    {
+        std::string nearlyZero = zeros;
+        nearlyZero[i] = 1;
+        REQUIRE(Hash<std::string>((const unsigned char*)nearlyZero.data(), blockSize).returnHashString() ==
+                picosha2::hash256_hex_string(nearlyZero));
+    }
+
+    INFO("Hint: testing the zero block fast path of containers, segments and addBlock");
+    typedef Hash<std::string, CountingSha256Policy> CountedHash;
+    CountedHash countedZero = CountedHash::zeroBlock(blockSize);
+    REQUIRE(countedZero == CountedHash(zeros));
+    std::vector<unsigned char> zeroBytes(blockSize, 0);
+    HashSegment halves[] = { { zeroBytes.data(), blockSize / 2 }, { zeroBytes.data(), blockSize / 2 } };
+    typedef Hash<std::vector<unsigned char>, CountingSha256Policy> CountedBytesHash;
+    CountedBytesHash countedBytesZero = CountedBytesHash::zeroBlock(blockSize);  //cached per Hash type
+    CountingSha256Stream::bytesFed = 0;
+    REQUIRE(CountedHash(zeros) == countedZero);
+    REQUIRE(CountedHash(halves, 2) == countedZero);
+    REQUIRE(CountedBytesHash(zeroBytes) == countedBytesZero);
+    typedef MerkleTree<std::string, 2, std::allocator<Hash<std::string> >, CountingSha256Policy> CountedTree;
+    CountedTree counted(2);
+    counted.addBlock(0, zeros);
+    CountedHash countedLeaves[2];
+    counted.getLayer(0, countedLeaves);
+    REQUIRE(countedLeaves[0] == countedZero);
+    REQUIRE(CountingSha256Stream::bytesFed == 0);
+    std::string nonZero = zeros;
+    nonZero[blockSize / 2] = 1;
+    REQUIRE(CountedHash(nonZero) != countedZero);
+    REQUIRE(CountingSha256Stream::bytesFed == blockSize);
+
+    INFO("Hint: testing a bulk build over runs of zero blocks");
+    const size_t n = 37;
+    std::vector<std::string> blocks(n, zeros);
+    blocks[5][0] = 1;
+    blocks[30][blockSize - 1] = 1;
+    MerkleTree<std::string> incremental(n);
+    std::vector<Hash<std::string> > leaves;
+    for (size_t i = 0; i < n; ++i)
+    {
+        incremental.addBlock(i, (const unsigned char*)blocks[i].data(), blockSize);
+        leaves.push_back(Hash<std::string>(blocks[i]));
+    }
+    MerkleTree<std::string> bulk(n);
+    REQUIRE(bulk.setLayer(0, leaves.data(), n));
+    REQUIRE(bulk.getRootHash() == incremental.getRootHash());
+
+    MerkleTree<std::string, 4> bulk4(n);
+    MerkleTree<std::string, 4> incremental4(n);
+    for (size_t i = 0; i < n; ++i)
+        incremental4.addBlock(i, blocks[i]);
+    REQUIRE(bulk4.setLayer(0, leaves.data(), n));
+    REQUIRE(bulk4.getRootHash() == incremental4.getRootHash());
+}
+
+TEST_CASE( "Sparse File Hashing", "[FileHasher]" )
+{
+#if defined(__unix__) || defined(__APPLE__)
+    const size_t blockSize = 64 << 10;
+    const size_t numBlocks = 40;
+    const off_t size = (off_t)(numBlocks * blockSize - 1000);    //short last block
+
+    char path[] = "/tmp/merkle_sparse_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    unlink(path);
+
+    //data at the start, in the middle (not block aligned) and at the end; holes elsewhere
+    std::string data(100000, 'd');
+    const off_t offsets[] = { 0, (off_t)(10 * blockSize + 5000), size - 100 };
+    const size_t lengths[] = { 3000, data.size(), 100 };
+    REQUIRE(ftruncate(fd, size) == 0);
+    for (size_t i = 0; i < 3; ++i)
+        REQUIRE(pwrite(fd, data.data(), lengths[i], offsets[i]) == (ssize_t)lengths[i]);
+
+    std::string contents(size, 0);
+    for (size_t i = 0; i < 3; ++i)
+        contents.replace(offsets[i], lengths[i], data.substr(0, lengths[i]));
+
+    INFO("Hint: testing that block hashes match the file contents");
+    std::vector<Hash<std::string> > leaves;
+    FileHashStats stats;
+    REQUIRE(hashFileBlocks(fd, blockSize, leaves, &stats));
+    REQUIRE(leaves.size() == numBlocks);
+    for (size_t b = 0; b < numBlocks; ++b)
+        REQUIRE(leaves[b] == Hash<std::string>(contents.substr(b * blockSize, blockSize)));
+    REQUIRE(stats.bytesRead + stats.holeBytes == (uint64_t)size);
+    REQUIRE(stats.bytesRead >= 4 * blockSize - 1000);   //blocks 0, 10, 11 and the last one hold data
+
+    INFO("Hint: testing creation and recheck of a tree");
+    MerkleTree<std::string> created(numBlocks);
+    REQUIRE(hashFile(fd, blockSize, created));
+    MerkleTree<std::string> expected(numBlocks);
+    for (size_t b = 0; b < numBlocks; ++b)
+        expected.addBlock(b, contents.substr(b * blockSize, blockSize));
+    REQUIRE(created.getRootHash() == expected.getRootHash());
+    REQUIRE(created.getNumBlocks() == numBlocks);
+
+    MerkleTree<std::string> recheck(numBlocks, expected.getRootHash());
+    REQUIRE(hashFile(fd, blockSize, recheck));
+    MerkleTree<std::string> corrupted(numBlocks, Hash<std::string>(std::string("other")));
+    REQUIRE(hashFile(fd, blockSize, corrupted) == false);
+    REQUIRE(corrupted.getNode(0, 0).isEmpty());     //the leaves hashed in place are dropped
+    REQUIRE(corrupted.getRootHash() == Hash<std::string>(std::string("other")));
+    MerkleTree<std::string> wrongSize(numBlocks + 1);
+    REQUIRE(hashFile(fd, blockSize, wrongSize) == false);
+
+    INFO("Hint: testing an empty file and a bad descriptor");
+    REQUIRE(ftruncate(fd, 0) == 0);
+    REQUIRE(hashFileBlocks(fd, blockSize, leaves, &stats));
+    REQUIRE(leaves.empty());
+    close(fd);
+    REQUIRE(hashFileBlocks(fd, blockSize, leaves) == false);
+#endif
+}